@@ -571,9 +571,25 @@ static int semanage_direct_update_user_extra(semanage_handle_t * sh, cil_db_t *c
 		if (retval < 0)
 			return retval;
 
+		/* Keep an unmerged copy so later commits can skip relinking. */
+		ofilename = semanage_path(SEMANAGE_TMP, SEMANAGE_USERS_EXTRA_LINKED);
+		if (ofilename == NULL) {
+			return -1;
+		}
+		retval = write_file(sh, ofilename, data, size);
+		if (retval < 0)
+			return retval;
+
 		pusers_extra->dtable->drop_cache(pusers_extra->dbase);
 		
 	} else {
+		if (unlink(semanage_path(SEMANAGE_TMP, SEMANAGE_USERS_EXTRA_LINKED)) == -1 &&
+		    errno != ENOENT) {
+			ERR(sh, "Error removing %s.",
+			    semanage_path(SEMANAGE_TMP, SEMANAGE_USERS_EXTRA_LINKED));
+			retval = -1;
+			goto cleanup;
+		}
 		retval =  pusers_extra->dtable->clear(sh, pusers_extra->dbase);
 	}
 
@@ -603,9 +619,26 @@ static int semanage_direct_update_seuser(semanage_handle_t * sh, cil_db_t *cildb
 			return -1;
 		}
 		retval = write_file(sh, ofilename, data, size);
+		if (retval < 0)
+			goto cleanup;
+
+		/* Keep an unmerged copy so later commits can skip relinking. */
+		ofilename = semanage_path(SEMANAGE_TMP, SEMANAGE_SEUSERS_LINKED);
+		if (ofilename == NULL) {
+			retval = -1;
+			goto cleanup;
+		}
+		retval = write_file(sh, ofilename, data, size);
 
 		pseusers->dtable->drop_cache(pseusers->dbase);
 	} else {
+		if (unlink(semanage_path(SEMANAGE_TMP, SEMANAGE_SEUSERS_LINKED)) == -1 &&
+		    errno != ENOENT) {
+			ERR(sh, "Error removing %s.",
+			    semanage_path(SEMANAGE_TMP, SEMANAGE_SEUSERS_LINKED));
+			retval = -1;
+			goto cleanup;
+		}
 		retval = pseusers->dtable->clear(sh, pseusers->dbase);
 	}
 
@@ -615,6 +648,35 @@ cleanup:
 	return retval;
 }
 
+/* Restore a policy-derived component file from the unmerged copy saved by
+ * the last full rebuild, so local modifications can be merged afresh
+ * without relinking the modules.  Returns 0 on success, -1 on error.
+ */
+static int semanage_direct_restore_linked(semanage_handle_t * sh,
+					  enum semanage_sandbox_defs linked,
+					  enum semanage_sandbox_defs file,
+					  dbase_config_t * dconfig)
+{
+	const char *path = semanage_path(SEMANAGE_TMP, linked);
+
+	if (access(path, F_OK) == 0) {
+		if (semanage_copy_file(path, semanage_path(SEMANAGE_TMP, file),
+				       sh->conf->file_mode) < 0) {
+			ERR(sh, "Could not copy %s.", path);
+			return -1;
+		}
+		dconfig->dtable->drop_cache(dconfig->dbase);
+	} else if (errno == ENOENT) {
+		if (dconfig->dtable->clear(sh, dconfig->dbase) < 0)
+			return -1;
+	} else {
+		ERR(sh, "Unable to access %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
 static int read_from_pipe_to_data(semanage_handle_t *sh, size_t initial_len, int fd, char **out_data_read, size_t *out_read_len)
 {
 	size_t max_len = initial_len;
@@ -1036,7 +1098,8 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	const char *ofilename = NULL;
 	const char *path;
 	int retval = -1, num_modinfos = 0, i, missing_policy_kern = 0,
-		missing_seusers = 0, missing_fc = 0, missing = 0;
+		missing_seusers = 0, missing_fc = 0, missing_linked = 0,
+		missing = 0, do_rebuild = 0, do_write_kernel = 0, do_install = 0;
 	sepol_policydb_t *out = NULL;
 	struct cil_db *cildb = NULL;
 	semanage_module_info_t *modinfos = NULL;
@@ -1061,6 +1124,8 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	dbase_config_t *fcontexts = semanage_fcontext_dbase_local(sh);
 	dbase_config_t *pfcontexts = semanage_fcontext_dbase_policy(sh);
 	dbase_config_t *seusers = semanage_seuser_dbase_local(sh);
+	dbase_config_t *pseusers = semanage_seuser_dbase_policy(sh);
+	dbase_config_t *pusers_extra = semanage_user_extra_dbase_policy(sh);
 
 	/* Create or remove the disable_dontaudit flag file. */
 	path = semanage_path(SEMANAGE_TMP, SEMANAGE_DISABLE_DONTAUDIT);
@@ -1138,11 +1203,26 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	modified |= dontaudit_modified;
 	modified |= preserve_tunables_modified;
 
+	/* Only module changes and the global dontaudit/tunable settings
+	 * require the modules to be recompiled and relinked.  Other local
+	 * changes are merged into the saved linked policy. */
+	do_rebuild = sh->do_rebuild;
+	do_rebuild |= sh->modules_modified;
+	do_rebuild |= dontaudit_modified;
+	do_rebuild |= preserve_tunables_modified;
+
 	/* This is for systems that have already migrated with an older version
 	 * of semanage_migrate_store. The older version did not copy policy.kern so
-	 * the policy binary must be rebuilt here.
+	 * the policy binary must be rebuilt here.  Stores written before the
+	 * linked policy was saved must be rebuilt once as well.
 	 */
-	if (!sh->do_rebuild && !modified) {
+	if (!do_rebuild) {
+		path = semanage_path(SEMANAGE_TMP, SEMANAGE_LINKED);
+
+		if (access(path, F_OK) != 0) {
+			missing_linked = 1;
+		}
+
 		path = semanage_path(SEMANAGE_TMP, SEMANAGE_STORE_KERNEL);
 
 		if (access(path, F_OK) != 0) {
@@ -1165,9 +1245,18 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	missing |= missing_policy_kern;
 	missing |= missing_fc;
 	missing |= missing_seusers;
+	missing |= missing_linked;
+
+	do_rebuild |= missing;
+
+	/* The kernel policy must be written if it was rebuilt or if any local
+	 * component that lives in the kernel policy was modified. The store
+	 * must be installed if any of the files it manages changed. */
+	do_write_kernel = do_rebuild | modified | bools_modified;
+	do_install = do_write_kernel | fcontexts_modified;
 
 	/* If there were policy changes, or explicitly requested, rebuild the policy */
-	if (sh->do_rebuild || modified || missing) {
+	if (do_rebuild) {
 		/* =================== Module expansion =============== */
 
 		retval = semanage_get_active_modules(sh, &modinfos, &num_modinfos);
@@ -1253,19 +1342,45 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 			goto cleanup;
 
 		cil_db_destroy(&cildb);
-	
+
+		/* Save the linked policy before local changes are merged */
+		retval = semanage_write_policydb(sh, out, SEMANAGE_LINKED);
+		if (retval < 0)
+			goto cleanup;
 	} else {
-		/* Load already linked policy */
 		retval = sepol_policydb_create(&out);
 		if (retval < 0)
 			goto cleanup;
 
-		retval = semanage_read_policydb(sh, out);
+		if (do_write_kernel) {
+			/* Load the saved linked policy, without local changes */
+			retval = semanage_read_policydb(sh, out, SEMANAGE_LINKED);
+		} else {
+			/* Load already linked policy */
+			retval = semanage_read_policydb(sh, out,
+							SEMANAGE_STORE_KERNEL);
+		}
+		if (retval < 0)
+			goto cleanup;
+
+		/* Start from the module-provided seusers and user prefixes
+		 * so that removed local entries do not linger. */
+		retval = semanage_direct_restore_linked(sh,
+							SEMANAGE_SEUSERS_LINKED,
+							SEMANAGE_STORE_SEUSERS,
+							pseusers);
+		if (retval < 0)
+			goto cleanup;
+
+		retval = semanage_direct_restore_linked(sh,
+							SEMANAGE_USERS_EXTRA_LINKED,
+							SEMANAGE_USERS_EXTRA,
+							pusers_extra);
 		if (retval < 0)
 			goto cleanup;
 	}
 
-	if (sh->do_rebuild || modified || bools_modified) {
+	if (do_write_kernel) {
 		/* Attach to policy databases that work with a policydb. */
 		dbase_policydb_attach((dbase_policydb_t *) pusers_base->dbase, out);
 		dbase_policydb_attach((dbase_policydb_t *) pports->dbase, out);
@@ -1279,7 +1394,7 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 		if (retval < 0)
 			goto cleanup;
 
-		retval = semanage_write_policydb(sh, out);
+		retval = semanage_write_policydb(sh, out, SEMANAGE_STORE_KERNEL);
 		if (retval < 0)
 			goto cleanup;
 
@@ -1298,21 +1413,21 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	 * Note: those are still cached, even though they've been 
 	 * merged into the main file_contexts. We won't check the 
 	 * large file_contexts - checked at compile time */
-	if (sh->do_rebuild || modified || fcontexts_modified) {
+	if (do_rebuild || modified || fcontexts_modified) {
 		retval = semanage_fcontext_validate_local(sh, out);
 		if (retval < 0)
 			goto cleanup;
 	}
 
 	/* Validate local seusers against policy */
-	if (sh->do_rebuild || modified || seusers_modified) {
+	if (do_rebuild || modified || seusers_modified) {
 		retval = semanage_seuser_validate_local(sh, out);
 		if (retval < 0)
 			goto cleanup;
 	}
 
 	/* Validate local ports for overlap */
-	if (sh->do_rebuild || modified || ports_modified) {
+	if (do_rebuild || modified || ports_modified) {
 		retval = semanage_port_validate_local(sh);
 		if (retval < 0)
 			goto cleanup;
@@ -1386,7 +1501,7 @@ static int semanage_direct_commit(semanage_handle_t * sh)
 	unlink(semanage_path(SEMANAGE_TMP, SEMANAGE_HOMEDIR_TMPL));
 	unlink(semanage_path(SEMANAGE_TMP, SEMANAGE_USERS_EXTRA));
 
-	if (sh->do_rebuild || modified || bools_modified || fcontexts_modified) {
+	if (do_install) {
 		retval = semanage_install_sandbox(sh);
 	}
 
@@ -1400,7 +1515,7 @@ cleanup:
 		free(mod_filenames[i]);
 	}
 
-	if (modified || bools_modified) {
+	if (do_write_kernel) {
 		/* Detach from policydb, so it can be freed */
 		dbase_policydb_detach((dbase_policydb_t *) pusers_base->dbase);
 		dbase_policydb_detach((dbase_policydb_t *) pports->dbase);
@@ -1828,7 +1943,7 @@ int semanage_direct_mls_enabled(semanage_handle_t * sh)
 	if (retval < 0)
 		goto cleanup;
 
-	retval = semanage_read_policydb(sh, p);
+	retval = semanage_read_policydb(sh, p, SEMANAGE_STORE_KERNEL);
 	if (retval < 0)
 		goto cleanup;
 
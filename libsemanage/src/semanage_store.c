@@ -70,6 +70,7 @@ enum semanage_file_defs {
 	SEMANAGE_ROOT,
 	SEMANAGE_TRANS_LOCK,
 	SEMANAGE_READ_LOCK,
+	SEMANAGE_CIL_CACHE,
 	SEMANAGE_NUM_FILES
 };
 
@@ -81,7 +82,8 @@ static int semanage_paths_initialized = 0;
 static const char *semanage_relative_files[SEMANAGE_NUM_FILES] = {
 	"",
 	"/semanage.trans.LOCK",
-	"/semanage.read.LOCK"
+	"/semanage.read.LOCK",
+	"/cil_cache"
 };
 
 static const char *semanage_store_paths[SEMANAGE_NUM_STORES] = {
@@ -95,7 +97,7 @@ static const char *semanage_store_paths[SEMANAGE_NUM_STORES] = {
 static const char *semanage_sandbox_paths[SEMANAGE_STORE_NUM_PATHS] = {
 	"",
 	"/modules",
-	"/base.linked",
+	"/policy.linked",
 	"/homedir_template",
 	"/file_contexts.template",
 	"/commit_num",
@@ -113,7 +115,9 @@ static const char *semanage_sandbox_paths[SEMANAGE_STORE_NUM_PATHS] = {
 	"/policy.kern",
 	"/file_contexts.local",
 	"/file_contexts",
-	"/seusers"
+	"/seusers",
+	"/seusers.linked",
+	"/users_extra.linked"
 };
 
 static char const * const semanage_final_prefix[SEMANAGE_FINAL_NUM] = {
@@ -1943,12 +1947,21 @@ int semanage_direct_get_serial(semanage_handle_t * sh)
 int semanage_load_files(semanage_handle_t * sh, cil_db_t *cildb, char **filenames, int numfiles)
 {
 	int retval = 0;
-	FILE *fp;
+	FILE *fp = NULL;
 	ssize_t size;
-	char *data = NULL;
+	char **data = NULL;
+	size_t *sizes = NULL;
 	char *filename;
+	const char *cache_dir = semanage_files[SEMANAGE_CIL_CACHE];
 	int i;
 
+	data = calloc(numfiles, sizeof(*data));
+	sizes = calloc(numfiles, sizeof(*sizes));
+	if (numfiles > 0 && (data == NULL || sizes == NULL)) {
+		ERR(sh, "Out of memory!");
+		goto cleanup;
+	}
+
 	for (i = 0; i < numfiles; i++) {
 		filename = filenames[i];
 
@@ -1957,7 +1970,7 @@ int semanage_load_files(semanage_handle_t * sh, cil_db_t *cildb, char **filename
 			goto cleanup;
 		}
 
-		if ((size = bunzip(sh, fp, &data)) <= 0) {
+		if ((size = bunzip(sh, fp, &data[i])) <= 0) {
 			rewind(fp);
 			__fsetlocking(fp, FSETLOCKING_BYCALLER);
 
@@ -1968,33 +1981,61 @@ int semanage_load_files(semanage_handle_t * sh, cil_db_t *cildb, char **filename
 			size = ftell(fp);
 			rewind(fp);
 
-			data = malloc(size);
-			if (fread(data, size, 1, fp) != 1) {
+			data[i] = malloc(size);
+			if (fread(data[i], size, 1, fp) != 1) {
 				ERR(sh, "Failed to read file %s.", filename);
 				goto cleanup;
 			}
 		}
+		sizes[i] = size;
 
 		fclose(fp);
 		fp = NULL;
+	}
 
-		retval = cil_add_file(cildb, filename, data, size);
-		if (retval != SEPOL_OK) {
-			ERR(sh, "Error while reading from file %s.", filename);
-			goto cleanup;
+	/* With cil-parse-cache set, the parse trees of modules are kept
+	 * beside the lock files, outside of the sandbox, and reused by later
+	 * transactions in which the modules are unchanged. Each cache file
+	 * holds an uncompressed copy of its module as well, so the cache is
+	 * off by default and removed when it is turned off. It is only an
+	 * optimization, so it is not used if it cannot be created. */
+	if (sh->conf->cil_parse_cache) {
+		if (mkdir(cache_dir, S_IRWXU) == 0 || errno == EEXIST) {
+			cil_set_parse_cache_dir(cildb, cache_dir);
 		}
-	
-		free(data);
-		data = NULL;
+	} else if (access(cache_dir, F_OK) == 0) {
+		semanage_remove_directory(cache_dir);
+	}
+
+	/* The module files are independent of each other, so they are handed
+	 * to libsepol together to be parsed in parallel. */
+	retval = cil_add_files(cildb, numfiles, filenames, data, sizes);
+	if (retval != SEPOL_OK) {
+		ERR(sh, "Error while reading from module files.");
+		goto cleanup;
 	}
 
+	cil_prune_parse_cache(cildb);
+
+	for (i = 0; i < numfiles; i++) {
+		free(data[i]);
+	}
+	free(data);
+	free(sizes);
+
 	return retval;
 
       cleanup:
 	if (fp != NULL) {
 		fclose(fp);
 	}
+	if (data != NULL) {
+		for (i = 0; i < numfiles; i++) {
+			free(data[i]);
+		}
+	}
 	free(data);
+	free(sizes);
 	return -1;
 }
 
@@ -2003,9 +2044,10 @@ int semanage_load_files(semanage_handle_t * sh, cil_db_t *cildb, char **filename
  */
 
 /**
- * Read the policy from the sandbox (kernel)
+ * Read the policy from the sandbox (linked or kernel)
  */
-int semanage_read_policydb(semanage_handle_t * sh, sepol_policydb_t * in)
+int semanage_read_policydb(semanage_handle_t * sh, sepol_policydb_t * in,
+			   enum semanage_sandbox_defs file)
 {
 
 	int retval = STATUS_ERR;
@@ -2014,7 +2056,7 @@ int semanage_read_policydb(semanage_handle_t * sh, sepol_policydb_t * in)
 	FILE *infile = NULL;
 
 	if ((kernel_filename =
-	     semanage_path(SEMANAGE_ACTIVE, SEMANAGE_STORE_KERNEL)) == NULL) {
+	     semanage_path(SEMANAGE_ACTIVE, file)) == NULL) {
 		goto cleanup;
 	}
 	if ((infile = fopen(kernel_filename, "r")) == NULL) {
@@ -2044,43 +2086,86 @@ int semanage_read_policydb(semanage_handle_t * sh, sepol_policydb_t * in)
 	return retval;
 }
 /**
- * Writes the final policy to the sandbox (kernel)
+ * Writes the policy to the sandbox (linked or kernel)
+ *
+ * The size of the image is computed first so that the policy can be
+ * serialized into a single buffer and written out with one write
+ * rather than through many small stdio writes.
  */
-int semanage_write_policydb(semanage_handle_t * sh, sepol_policydb_t * out)
+int semanage_write_policydb(semanage_handle_t * sh, sepol_policydb_t * out,
+			    enum semanage_sandbox_defs file)
 {
 
 	int retval = STATUS_ERR;
 	const char *kernel_filename = NULL;
 	struct sepol_policy_file *pf = NULL;
-	FILE *outfile = NULL;
+	char *data = NULL;
+	size_t len = 0, written = 0;
+	ssize_t amount;
+	int fd = -1;
 
 	if ((kernel_filename =
-	     semanage_path(SEMANAGE_TMP, SEMANAGE_STORE_KERNEL)) == NULL) {
+	     semanage_path(SEMANAGE_TMP, file)) == NULL) {
 		goto cleanup;
 	}
-	if ((outfile = fopen(kernel_filename, "wb")) == NULL) {
-		ERR(sh, "Could not open kernel policy %s for writing.",
+	if (sepol_policy_file_create(&pf)) {
+		ERR(sh, "Out of memory!");
+		goto cleanup;
+	}
+	sepol_policy_file_set_handle(pf, sh->sepolh);
+
+	/* A zero length selects the sizing mode of the policy file. */
+	sepol_policy_file_set_mem(pf, NULL, 0);
+	if (sepol_policydb_write(out, pf) == -1 ||
+	    sepol_policy_file_get_len(pf, &len) == -1) {
+		ERR(sh, "Error while computing the size of kernel policy %s.",
 		    kernel_filename);
 		goto cleanup;
 	}
-	__fsetlocking(outfile, FSETLOCKING_BYCALLER);
-	if (sepol_policy_file_create(&pf)) {
+
+	if ((data = malloc(len)) == NULL) {
 		ERR(sh, "Out of memory!");
 		goto cleanup;
 	}
-	sepol_policy_file_set_fp(pf, outfile);
-	sepol_policy_file_set_handle(pf, sh->sepolh);
+	sepol_policy_file_set_mem(pf, data, len);
 	if (sepol_policydb_write(out, pf) == -1) {
 		ERR(sh, "Error while writing kernel policy to %s.",
 		    kernel_filename);
 		goto cleanup;
 	}
+
+	if ((fd = open(kernel_filename, O_WRONLY | O_CREAT | O_TRUNC,
+		       S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP |
+		       S_IROTH | S_IWOTH)) == -1) {
+		ERR(sh, "Could not open kernel policy %s for writing.",
+		    kernel_filename);
+		goto cleanup;
+	}
+	while (written < len) {
+		amount = write(fd, data + written, len - written);
+		if (amount < 0) {
+			if (errno == EINTR)
+				continue;
+			ERR(sh, "Error while writing kernel policy to %s.",
+			    kernel_filename);
+			goto cleanup;
+		}
+		written += amount;
+	}
+	if (close(fd) == -1) {
+		fd = -1;
+		ERR(sh, "Error while writing kernel policy to %s.",
+		    kernel_filename);
+		goto cleanup;
+	}
+	fd = -1;
 	retval = STATUS_SUCCESS;
 
       cleanup:
-	if (outfile != NULL) {
-		fclose(outfile);
+	if (fd != -1) {
+		close(fd);
 	}
+	free(data);
 	sepol_policy_file_free(pf);
 	return retval;
 }
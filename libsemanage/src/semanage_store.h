@@ -59,6 +59,8 @@ enum semanage_sandbox_defs {
 	SEMANAGE_STORE_FC_LOCAL,
 	SEMANAGE_STORE_FC,
 	SEMANAGE_STORE_SEUSERS,
+	SEMANAGE_SEUSERS_LINKED,
+	SEMANAGE_USERS_EXTRA_LINKED,
 	SEMANAGE_STORE_NUM_PATHS
 };
 
@@ -126,10 +128,12 @@ int semanage_load_files(semanage_handle_t * sh,
 			    cil_db_t *cildb, char **filenames, int num_modules);
 
 int semanage_read_policydb(semanage_handle_t * sh,
-			    sepol_policydb_t * policydb);
+			    sepol_policydb_t * policydb,
+			    enum semanage_sandbox_defs file);
 
 int semanage_write_policydb(semanage_handle_t * sh,
-			    sepol_policydb_t * policydb);
+			    sepol_policydb_t * policydb,
+			    enum semanage_sandbox_defs file);
 
 int semanage_install_sandbox(semanage_handle_t * sh);
 
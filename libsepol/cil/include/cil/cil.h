@@ -39,12 +39,19 @@ extern void cil_db_init(cil_db_t **db);
 extern void cil_db_destroy(cil_db_t **db);
 
 extern int cil_add_file(cil_db_t *db, char *name, char *data, size_t size);
+extern int cil_add_files(cil_db_t *db, int count, char **names, char **data, size_t *sizes);
+extern void cil_set_parse_cache_dir(cil_db_t *db, const char *dir);
+extern int cil_prune_parse_cache(cil_db_t *db);
 
 extern int cil_compile(cil_db_t *db);
 extern int cil_build_policydb(cil_db_t *db, sepol_policydb_t **sepol_db);
 extern int cil_userprefixes_to_string(cil_db_t *db, char **out, size_t *size);
 extern int cil_selinuxusers_to_string(cil_db_t *db, char **out, size_t *size);
 extern int cil_filecons_to_string(cil_db_t *db, char **out, size_t *size);
+extern void cil_set_profile(cil_db_t *db, int profile);
+extern void cil_profile_begin(cil_db_t *db, const char *phase);
+extern void cil_profile_end(cil_db_t *db);
+extern int cil_profile_to_json(cil_db_t *db, char **out, size_t *size);
 extern void cil_set_disable_dontaudit(cil_db_t *db, int disable_dontaudit);
 extern void cil_set_disable_neverallow(cil_db_t *db, int disable_neverallow);
 extern void cil_set_preserve_tunables(cil_db_t *db, int preserve_tunables);
@@ -59,6 +66,9 @@ enum cil_log_level {
 	CIL_INFO
 };
 extern void cil_set_log_level(enum cil_log_level lvl);
+/* The log and malloc error handlers are also called from the threads
+ * started by cil_add_files() and cil_build_policydb(), so a handler that
+ * replaces the default one must be thread-safe. */
 extern void cil_set_log_handler(void (*handler)(int lvl, char *msg));
 
 #ifdef __GNUC__
@@ -29,6 +29,8 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include <sepol/policydb/policydb.h>
 #include <sepol/policydb/symtab.h>
@@ -50,6 +52,8 @@
 #include "cil_binary.h"
 #include "cil_policy.h"
 #include "cil_strpool.h"
+#include "cil_parse_cache.h"
+#include "cil_profile.h"
 #include "dso.h"
 
 #ifndef DISABLE_SYMVER
@@ -225,12 +229,25 @@ static void cil_init_keys(void)
 	CIL_KEY_PERM = cil_strpool_add("perm");
 }
 
+/* The string pool and the keys interned in it are shared by every db.
+ * They are set up by the first db created and freed with the last one
+ * destroyed. */
+static pthread_mutex_t cil_db_count_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int cil_db_count;
+
 void cil_db_init(struct cil_db **db)
 {
+	struct cil_pool node_pool = CIL_POOL_INIT(struct cil_tree_node);
+
 	*db = cil_malloc(sizeof(**db));
+	(*db)->node_pool = node_pool;
 
-	cil_strpool_init();
-	cil_init_keys();
+	pthread_mutex_lock(&cil_db_count_lock);
+	if (cil_db_count++ == 0) {
+		cil_strpool_init();
+		cil_init_keys();
+	}
+	pthread_mutex_unlock(&cil_db_count_lock);
 
 	cil_tree_init(&(*db)->parse);
 	cil_tree_init(&(*db)->ast);
@@ -272,6 +289,10 @@ void cil_db_init(struct cil_db **db)
 	(*db)->mls = -1;
 	(*db)->target_platform = SEPOL_TARGET_SELINUX;
 	(*db)->policy_version = POLICYDB_VERSION_MAX;
+	(*db)->parse_cache_dir = NULL;
+	(*db)->parse_cache_used = NULL;
+	(*db)->parse_cache_num_used = 0;
+	(*db)->profile = NULL;
 }
 
 void cil_db_destroy(struct cil_db **db)
@@ -303,9 +324,17 @@ void cil_db_destroy(struct cil_db **db)
 
 	cil_destroy_type((*db)->selftype);
 
-	cil_strpool_destroy();
+	pthread_mutex_lock(&cil_db_count_lock);
+	if (--cil_db_count == 0) {
+		cil_strpool_destroy();
+	}
+	pthread_mutex_unlock(&cil_db_count_lock);
 	free((*db)->val_to_type);
 	free((*db)->val_to_role);
+	free((*db)->parse_cache_dir);
+	free((*db)->parse_cache_used);
+	cil_profile_destroy(&(*db)->profile);
+	cil_pool_release(&(*db)->node_pool);
 
 	free(*db);
 	*db = NULL;	
@@ -328,34 +357,215 @@ void cil_root_destroy(struct cil_root *root)
 	free(root);
 }
 
-int cil_add_file(cil_db_t *db, char *name, char *data, size_t size)
+#define CIL_PARSE_MAX_THREADS 8
+
+struct cil_parse_job {
+	char *name;
+	char *data;
+	size_t size;
+	const char *cache_dir;
+	char cache_name[CIL_PARSE_CACHE_NAME_LEN + 1];
+	struct cil_tree *tree;
+	int rc;
+};
+
+struct cil_parse_queue {
+	pthread_mutex_t lock;
+	struct cil_parse_job *jobs;
+	int count;
+	int next;
+};
+
+static void __cil_parse_job(struct cil_parse_job *job)
 {
 	char *buffer = NULL;
-	int rc;
 
-	cil_log(CIL_INFO, "Parsing %s\n", name);
+	if (job->cache_dir != NULL) {
+		cil_parse_cache_name(job->data, job->size, job->cache_name);
+		job->rc = cil_parse_cache_load(job->cache_dir, job->cache_name, job->name, job->data, job->size, job->tree);
+		if (job->rc == SEPOL_OK) {
+			return;
+		}
+	}
+
+	buffer = cil_malloc(job->size + 2);
+	memcpy(buffer, job->data, job->size);
+	memset(buffer + job->size, 0, 2);
+
+	job->rc = cil_parser(job->name, buffer, job->size + 2, &job->tree);
+
+	free(buffer);
+
+	/* A cache that cannot be written only costs the next run a parse */
+	if (job->rc == SEPOL_OK && job->cache_dir != NULL) {
+		cil_parse_cache_store(job->cache_dir, job->cache_name, job->data, job->size, job->tree);
+	}
+}
+
+static void *__cil_parse_worker(void *arg)
+{
+	struct cil_parse_queue *queue = arg;
+	struct cil_parse_job *job = NULL;
+
+	for (;;) {
+		pthread_mutex_lock(&queue->lock);
+		if (queue->next == queue->count) {
+			pthread_mutex_unlock(&queue->lock);
+			break;
+		}
+		job = &queue->jobs[queue->next++];
+		pthread_mutex_unlock(&queue->lock);
+
+		__cil_parse_job(job);
+	}
+
+	return NULL;
+}
+
+static void __cil_parse_tree_splice(struct cil_tree_node *root, struct cil_tree *tree)
+{
+	struct cil_tree_node *node = NULL;
 
-	buffer = cil_malloc(size + 2);
-	memcpy(buffer, data, size);
-	memset(buffer + size, 0, 2);
+	if (tree->root->cl_head == NULL) {
+		return;
+	}
+
+	for (node = tree->root->cl_head; node != NULL; node = node->next) {
+		node->parent = root;
+	}
+
+	if (root->cl_head == NULL) {
+		root->cl_head = tree->root->cl_head;
+	} else {
+		root->cl_tail->next = tree->root->cl_head;
+	}
+	root->cl_tail = tree->root->cl_tail;
 
-	rc = cil_parser(name, buffer, size + 2, &db->parse);
+	tree->root->cl_head = NULL;
+	tree->root->cl_tail = NULL;
+}
+
+/* Each file is parsed into a tree of its own, on as many threads as there are
+ * CPUs available; the trees are then appended to the parse tree in the order
+ * in which the files were given, so the result is the same as calling
+ * cil_add_file() on each file in turn. */
+int cil_add_files(cil_db_t *db, int count, char **names, char **data, size_t *sizes)
+{
+	struct cil_parse_queue queue;
+	pthread_t *threads = NULL;
+	int num_threads = 0;
+	long num_cpus;
+	int rc = SEPOL_ERR;
+	int i;
+
+	if (count <= 0) {
+		return SEPOL_OK;
+	}
+
+	queue.jobs = cil_malloc(sizeof(*queue.jobs) * count);
+	queue.count = count;
+	queue.next = 0;
+	pthread_mutex_init(&queue.lock, NULL);
+
+	for (i = 0; i < count; i++) {
+		cil_log(CIL_INFO, "Parsing %s\n", names[i]);
+		queue.jobs[i].name = names[i];
+		queue.jobs[i].data = data[i];
+		queue.jobs[i].size = sizes[i];
+		queue.jobs[i].cache_dir = db->parse_cache_dir;
+		queue.jobs[i].rc = SEPOL_ERR;
+		cil_tree_init(&queue.jobs[i].tree);
+	}
+
+	cil_profile_phase_begin(db->profile, "parse");
+
+	num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_cpus > CIL_PARSE_MAX_THREADS) {
+		num_cpus = CIL_PARSE_MAX_THREADS;
+	}
+	if (num_cpus > count) {
+		num_cpus = count;
+	}
+
+	/* The calling thread works through the queue as well */
+	if (num_cpus > 1) {
+		threads = cil_malloc(sizeof(*threads) * (num_cpus - 1));
+		for (num_threads = 0; num_threads < num_cpus - 1; num_threads++) {
+			if (pthread_create(&threads[num_threads], NULL, __cil_parse_worker, &queue) != 0) {
+				break;
+			}
+		}
+	}
+
+	__cil_parse_worker(&queue);
+
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	cil_profile_phase_end(db->profile);
+
+	rc = SEPOL_OK;
+	for (i = 0; i < count; i++) {
+		if (queue.jobs[i].rc != SEPOL_OK) {
+			cil_log(CIL_ERR, "Failure adding %s\n", names[i]);
+			if (rc == SEPOL_OK) {
+				rc = queue.jobs[i].rc;
+			}
+		}
+	}
 	if (rc != SEPOL_OK) {
-		cil_log(CIL_INFO, "Failed to parse %s\n", name);
 		goto exit;
 	}
 
-	free(buffer);
-	buffer = NULL;
+	for (i = 0; i < count; i++) {
+		__cil_parse_tree_splice(db->parse->root, queue.jobs[i].tree);
+	}
+
+	if (db->parse_cache_dir != NULL) {
+		db->parse_cache_used = cil_realloc(db->parse_cache_used, sizeof(*db->parse_cache_used) * (db->parse_cache_num_used + count));
+		for (i = 0; i < count; i++) {
+			db->parse_cache_used[db->parse_cache_num_used++] = cil_strpool_add(queue.jobs[i].cache_name);
+		}
+	}
 
 	rc = SEPOL_OK;
 
 exit:
-	free(buffer);
+	for (i = 0; i < count; i++) {
+		cil_tree_destroy(&queue.jobs[i].tree);
+	}
+	pthread_mutex_destroy(&queue.lock);
+	free(queue.jobs);
+	free(threads);
 
 	return rc;
 }
 
+int cil_add_file(cil_db_t *db, char *name, char *data, size_t size)
+{
+	return cil_add_files(db, 1, &name, &data, &size);
+}
+
+/* Parse trees of files added after this call are kept in dir, keyed by a
+ * hash of the file contents, and are loaded from there instead of being
+ * parsed again when the same contents are added later. */
+void cil_set_parse_cache_dir(cil_db_t *db, const char *dir)
+{
+	free(db->parse_cache_dir);
+	db->parse_cache_dir = (dir != NULL) ? cil_strdup(dir) : NULL;
+}
+
+/* Removes the cache files not used by any file added to db */
+int cil_prune_parse_cache(cil_db_t *db)
+{
+	if (db->parse_cache_dir == NULL) {
+		return SEPOL_OK;
+	}
+
+	return cil_parse_cache_prune(db);
+}
+
 #ifdef DISABLE_SYMVER
 int cil_compile(struct cil_db *db)
 #else
@@ -369,7 +579,9 @@ int cil_compile_nopdb(struct cil_db *db)
 	}
 
 	cil_log(CIL_INFO, "Building AST from Parse Tree\n");
+	cil_profile_phase_begin(db->profile, "build_ast");
 	rc = cil_build_ast(db, db->parse->root, db->ast->root);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to build ast\n");
 		goto exit;
@@ -379,26 +591,34 @@ int cil_compile_nopdb(struct cil_db *db)
 	cil_tree_destroy(&db->parse);
 
 	cil_log(CIL_INFO, "Resolving AST\n");
+	cil_profile_phase_begin(db->profile, "resolve");
 	rc = cil_resolve_ast(db, db->ast->root);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to resolve ast\n");
 		goto exit;
 	}
 
 	cil_log(CIL_INFO, "Qualifying Names\n");
+	cil_profile_phase_begin(db->profile, "fqn");
 	rc = cil_fqn_qualify(db->ast->root);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to qualify names\n");
 		goto exit;
 	}
 
 	cil_log(CIL_INFO, "Compile post process\n");
+	cil_profile_phase_begin(db->profile, "post");
 	rc = cil_post_process(db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK ) {
 		cil_log(CIL_INFO, "Post process failed\n");
 		goto exit;
 	}
 
+	cil_strpool_stats();
+
 exit:
 
 	return rc;
@@ -415,7 +635,9 @@ int cil_build_policydb_pdb(cil_db_t *db, sepol_policydb_t *sepol_db)
 	int rc;
 
 	cil_log(CIL_INFO, "Building policy binary\n");
+	cil_profile_phase_begin(db->profile, "binary");
 	rc = cil_binary_create_allocated_pdb(db, sepol_db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_ERR, "Failed to generate binary\n");
 		goto exit;
@@ -435,7 +657,9 @@ int cil_build_policydb_create_pdb(cil_db_t *db, sepol_policydb_t **sepol_db)
 	int rc;
 
 	cil_log(CIL_INFO, "Building policy binary\n");
+	cil_profile_phase_begin(db->profile, "binary");
 	rc = cil_binary_create(db, sepol_db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_ERR, "Failed to generate binary\n");
 		goto exit;
@@ -1556,6 +1780,32 @@ int cil_filecons_to_string_pdb(struct cil_db *db, __attribute__((unused)) sepol_
 }
 #endif
 
+void cil_set_profile(struct cil_db *db, int profile)
+{
+	if (profile) {
+		if (db->profile == NULL) {
+			cil_profile_init(&db->profile);
+		}
+	} else {
+		cil_profile_destroy(&db->profile);
+	}
+}
+
+void cil_profile_begin(struct cil_db *db, const char *phase)
+{
+	cil_profile_phase_begin(db->profile, phase);
+}
+
+void cil_profile_end(struct cil_db *db)
+{
+	cil_profile_phase_end(db->profile);
+}
+
+int cil_profile_to_json(struct cil_db *db, char **out, size_t *size)
+{
+	return cil_profile_report(db->profile, out, size);
+}
+
 void cil_set_disable_dontaudit(struct cil_db *db, int disable_dontaudit)
 {
 	db->disable_dontaudit = disable_dontaudit;
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <netinet/in.h>
 
 #include <sepol/policydb/policydb.h>
@@ -48,6 +50,7 @@
 #include "cil_binary.h"
 #include "cil_symtab.h"
 #include "cil_find.h"
+#include "cil_profile.h"
 
 /* There are 44000 filename_trans in current fedora policy. 1.33 times this is the recommended
  * size of a hashtable. The next power of 2 of this is 2 ** 16.
@@ -56,6 +59,8 @@
 #define RANGE_TRANS_TABLE_SIZE 1 << 13
 #define ROLE_TRANS_TABLE_SIZE 1 << 10
 #define PERMS_PER_CLASS 32
+#define CIL_BINARY_MAX_THREADS 8
+#define CIL_BINARY_MIN_NEVERALLOWS_PER_THREAD 16
 
 struct cil_args_binary {
 	const struct cil_db *db;
@@ -3848,23 +3853,346 @@ static void __cil_print_rule(const char *pad, const char *kind, struct cil_avrul
 	cil_log(CIL_ERR,")\n");
 }
 
+/* An allow rule of the policy, either unconditional or conditional */
+struct cil_neverallow_entry {
+	uint32_t source;
+	uint32_t target;
+	uint32_t data;
+	uint32_t tclass;
+};
+
+/* The allow rules of the policy sorted by class, source and target. The rules
+ * of a class are entries[class_start[class - 1]] to
+ * entries[class_start[class] - 1], and class_sources[class - 1] has a bit set
+ * for each type or attribute that is the source of one of them. */
+struct cil_neverallow_index {
+	struct cil_neverallow_entry *entries;
+	uint32_t count;
+	uint32_t *class_start;
+	ebitmap_t *class_sources;
+	uint32_t nclasses;
+};
+
+struct cil_neverallow_checks {
+	const struct cil_db *db;
+	policydb_t *pdb;
+	struct cil_neverallow_index *index;
+	struct cil_tree_node **nodes;
+	int *results;
+	uint32_t count;
+	uint32_t next;
+};
+
+static int __cil_neverallow_index_add(avtab_key_t *k, avtab_datum_t *d, void *args)
+{
+	struct cil_neverallow_index *index = args;
+	struct cil_neverallow_entry *entry;
+
+	if (k->specified != AVTAB_ALLOWED) {
+		return SEPOL_OK;
+	}
+
+	entry = &index->entries[index->count++];
+	entry->source = k->source_type;
+	entry->target = k->target_type;
+	entry->data = d->data;
+	entry->tclass = k->target_class;
+
+	return SEPOL_OK;
+}
+
+static int __cil_neverallow_entry_compare(const void *a, const void *b)
+{
+	const struct cil_neverallow_entry *e1 = a;
+	const struct cil_neverallow_entry *e2 = b;
+
+	if (e1->tclass != e2->tclass) {
+		return (e1->tclass < e2->tclass) ? -1 : 1;
+	}
+	if (e1->source != e2->source) {
+		return (e1->source < e2->source) ? -1 : 1;
+	}
+	if (e1->target != e2->target) {
+		return (e1->target < e2->target) ? -1 : 1;
+	}
+	return 0;
+}
+
+static void __cil_neverallow_index_destroy(struct cil_neverallow_index *index)
+{
+	uint32_t i;
+
+	if (index->class_sources != NULL) {
+		for (i = 0; i < index->nclasses; i++) {
+			ebitmap_destroy(&index->class_sources[i]);
+		}
+	}
+	free(index->class_sources);
+	free(index->class_start);
+	free(index->entries);
+}
+
+static int __cil_neverallow_index_init(policydb_t *pdb, struct cil_neverallow_index *index)
+{
+	int rc = SEPOL_ERR;
+	struct cil_neverallow_entry *entry;
+	uint32_t i;
+
+	index->count = 0;
+	index->nclasses = pdb->p_classes.nprim;
+	index->entries = cil_malloc(sizeof(*index->entries) * (pdb->te_avtab.nel + pdb->te_cond_avtab.nel + 1));
+	index->class_start = cil_calloc(index->nclasses + 1, sizeof(*index->class_start));
+	index->class_sources = cil_malloc(sizeof(*index->class_sources) * index->nclasses);
+	for (i = 0; i < index->nclasses; i++) {
+		ebitmap_init(&index->class_sources[i]);
+	}
+
+	avtab_map(&pdb->te_avtab, __cil_neverallow_index_add, index);
+	avtab_map(&pdb->te_cond_avtab, __cil_neverallow_index_add, index);
+
+	qsort(index->entries, index->count, sizeof(*index->entries), __cil_neverallow_entry_compare);
+
+	for (i = 0; i < index->count; i++) {
+		entry = &index->entries[i];
+		index->class_start[entry->tclass]++;
+		rc = ebitmap_set_bit(&index->class_sources[entry->tclass - 1], entry->source - 1, 1);
+		if (rc != SEPOL_OK) {
+			goto exit;
+		}
+	}
+	for (i = 1; i <= index->nclasses; i++) {
+		index->class_start[i] += index->class_start[i - 1];
+	}
+
+	return SEPOL_OK;
+
+exit:
+	__cil_neverallow_index_destroy(index);
+	return rc;
+}
+
+/* Set a bit in map for every type or attribute that contains one of types */
+static int __cil_neverallow_expand_types(policydb_t *pdb, ebitmap_t *types, ebitmap_t *map)
+{
+	int rc;
+	ebitmap_node_t *tnode;
+	unsigned int i;
+
+	ebitmap_for_each_bit(types, tnode, i) {
+		if (!ebitmap_node_get_bit(tnode, i)) continue;
+		rc = ebitmap_union(map, &pdb->type_attr_map[i]);
+		if (rc != SEPOL_OK) {
+			return SEPOL_ENOMEM;
+		}
+	}
+
+	return SEPOL_OK;
+}
+
+/* Check the allow rules of the class whose source is source against one
+ * class and permissions of a neverallow */
+static int __cil_neverallow_match_source(policydb_t *pdb, struct cil_neverallow_index *index, avrule_t *avrule, class_perm_node_t *cp, uint32_t source, ebitmap_t *targets)
+{
+	int rc;
+	struct cil_neverallow_entry *entry;
+	uint32_t low = index->class_start[cp->tclass - 1];
+	uint32_t high = index->class_start[cp->tclass];
+	uint32_t mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (index->entries[mid].source < source) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	high = index->class_start[cp->tclass];
+	for (; low < high && index->entries[low].source == source; low++) {
+		entry = &index->entries[low];
+		if (!(entry->data & cp->data)) {
+			continue;
+		}
+
+		if (avrule->flags == RULE_SELF) {
+			/* The source and target of the rule must share a type
+			 * that is in the source of the neverallow */
+			ebitmap_t match;
+			if (entry->source == entry->target) {
+				return CIL_TRUE;
+			}
+			rc = ebitmap_and(&match, &pdb->attr_type_map[entry->source - 1], &pdb->attr_type_map[entry->target - 1]);
+			if (rc != SEPOL_OK) {
+				ebitmap_destroy(&match);
+				return SEPOL_ENOMEM;
+			}
+			rc = ebitmap_match_any(&avrule->stypes.types, &match);
+			ebitmap_destroy(&match);
+		} else {
+			rc = ebitmap_get_bit(targets, entry->target - 1);
+		}
+		if (rc) {
+			return CIL_TRUE;
+		}
+	}
+
+	return CIL_FALSE;
+}
+
+/* Returns CIL_TRUE if an allow rule of the policy violates the neverallow,
+ * CIL_FALSE if none does, or an error */
+static int __cil_check_neverallow(const struct cil_db *db, policydb_t *pdb, struct cil_neverallow_index *index, struct cil_tree_node *node)
+{
+	int rc = SEPOL_ERR;
+	avrule_t *avrule = NULL;
+	class_perm_node_t *cp;
+	ebitmap_t sources, targets;
+	ebitmap_node_t *snode, *cnode;
+	MAPTYPE map;
+	uint32_t source;
+
+	ebitmap_init(&sources);
+	ebitmap_init(&targets);
+
+	rc = __cil_rule_to_expanded_sepol_avrule(db, pdb, node, &avrule);
+	if (rc != SEPOL_OK) {
+		cil_log(CIL_ERR, "Failed to create expanded sepol avrules to check neverallow rules\n");
+		goto exit;
+	}
+
+	rc = __cil_neverallow_expand_types(pdb, &avrule->stypes.types, &sources);
+	if (rc != SEPOL_OK) goto exit;
+
+	if (avrule->flags != RULE_SELF) {
+		rc = __cil_neverallow_expand_types(pdb, &avrule->ttypes.types, &targets);
+		if (rc != SEPOL_OK) goto exit;
+	}
+
+	rc = CIL_FALSE;
+	for (cp = avrule->perms; cp != NULL && rc == CIL_FALSE; cp = cp->next) {
+		/* Only the sources that have allow rules for the class and
+		 * that contain a source type of the neverallow can match */
+		snode = sources.node;
+		cnode = index->class_sources[cp->tclass - 1].node;
+		while (snode != NULL && cnode != NULL && rc == CIL_FALSE) {
+			if (snode->startbit < cnode->startbit) {
+				snode = snode->next;
+				continue;
+			}
+			if (cnode->startbit < snode->startbit) {
+				cnode = cnode->next;
+				continue;
+			}
+			map = snode->map & cnode->map;
+			while (map && rc == CIL_FALSE) {
+				source = snode->startbit + __builtin_ctzll(map) + 1;
+				map &= map - 1;
+				rc = __cil_neverallow_match_source(pdb, index, avrule, cp, source, &targets);
+			}
+			snode = snode->next;
+			cnode = cnode->next;
+		}
+	}
+
+exit:
+	ebitmap_destroy(&sources);
+	ebitmap_destroy(&targets);
+	__cil_destroy_sepol_avrules(avrule);
+	return rc;
+}
+
+static void *__cil_check_neverallows_thread(void *arg)
+{
+	struct cil_neverallow_checks *checks = arg;
+	uint32_t i;
+
+	while (1) {
+		i = __atomic_fetch_add(&checks->next, 1, __ATOMIC_RELAXED);
+		if (i >= checks->count) {
+			break;
+		}
+		checks->results[i] = __cil_check_neverallow(checks->db, checks->pdb, checks->index, checks->nodes[i]);
+	}
+
+	return NULL;
+}
+
+/* The allow rules are indexed once, and the neverallows are then checked
+ * against the index independently of each other, on as many threads as
+ * there are CPUs. Failures are reported afterwards in the order of the
+ * neverallows. */
 static int cil_check_neverallows(const struct cil_db *db, policydb_t *pdb, struct cil_list *neverallows)
 {
 	int rc = SEPOL_OK;
+	struct cil_neverallow_index index;
+	struct cil_neverallow_checks checks;
 	struct cil_list_item *i1;
+	pthread_t *threads = NULL;
+	long num_threads;
+	long num_started = 0;
+	long t;
+	uint32_t i;
 
+	checks.count = 0;
 	cil_list_for_each(i1, neverallows) {
-		struct cil_tree_node *node = i1->data;
-		avrule_t *avrule;
-		rc = __cil_rule_to_expanded_sepol_avrule(db, pdb, node, &avrule);
-		if (rc != SEPOL_OK) {
-			cil_log(CIL_ERR, "Failed to create expanded sepol avrules to check neverallow rules\n");
-			goto exit;
+		checks.count++;
+	}
+	if (checks.count == 0) {
+		return SEPOL_OK;
+	}
+
+	rc = __cil_neverallow_index_init(pdb, &index);
+	if (rc != SEPOL_OK) {
+		cil_log(CIL_ERR, "Failed to index allow rules to check neverallow rules\n");
+		return rc;
+	}
+
+	checks.db = db;
+	checks.pdb = pdb;
+	checks.index = &index;
+	checks.nodes = cil_malloc(sizeof(*checks.nodes) * checks.count);
+	checks.results = cil_malloc(sizeof(*checks.results) * checks.count);
+	checks.next = 0;
+	i = 0;
+	cil_list_for_each(i1, neverallows) {
+		checks.nodes[i++] = i1->data;
+	}
+
+	num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads > CIL_BINARY_MAX_THREADS) {
+		num_threads = CIL_BINARY_MAX_THREADS;
+	}
+	if (num_threads > checks.count / CIL_BINARY_MIN_NEVERALLOWS_PER_THREAD) {
+		num_threads = checks.count / CIL_BINARY_MIN_NEVERALLOWS_PER_THREAD;
+	}
+
+	/* The calling thread checks neverallows too, so the checks finish
+	 * even if no thread could be started */
+	if (num_threads > 1) {
+		threads = cil_malloc(sizeof(*threads) * (num_threads - 1));
+		for (t = 0; t < num_threads - 1; t++) {
+			if (pthread_create(&threads[num_started], NULL, __cil_check_neverallows_thread, &checks) == 0) {
+				num_started++;
+			}
 		}
+	}
+	__cil_check_neverallows_thread(&checks);
+	for (t = 0; t < num_started; t++) {
+		pthread_join(threads[t], NULL);
+	}
 
-		rc = check_assertion(pdb, avrule);
+	rc = SEPOL_OK;
+	for (i = 0; i < checks.count; i++) {
+		struct cil_tree_node *node = checks.nodes[i];
+
+		if (checks.results[i] < 0) {
+			rc = checks.results[i];
+			cil_log(CIL_ERR, "Error occurred while checking neverallow rules\n");
+			goto exit;
+		}
 
-		if (rc == CIL_TRUE) {
+		if (checks.results[i] == CIL_TRUE) {
 			struct cil_list_item *i2;
 			struct cil_list *matching;
 			struct cil_avrule *cil_rule = node->data;
@@ -3882,7 +4210,6 @@ static int cil_check_neverallows(const struct cil_db *db, policydb_t *pdb, struc
 			if (rc) {
 				cil_log(CIL_ERR, "Error occurred while checking neverallow rules\n");
 				cil_list_destroy(&matching, CIL_FALSE);
-				__cil_destroy_sepol_avrules(avrule);
 				goto exit;
 			}
 
@@ -3895,11 +4222,13 @@ static int cil_check_neverallows(const struct cil_db *db, policydb_t *pdb, struc
 			cil_log(CIL_ERR,"\n");
 			cil_list_destroy(&matching, CIL_FALSE);
 		}
-		__cil_destroy_sepol_avrules(avrule);
-		avrule = NULL;
 	}
 
 exit:
+	free(threads);
+	free(checks.nodes);
+	free(checks.results);
+	__cil_neverallow_index_destroy(&index);
 	return rc;
 }
 
@@ -3955,78 +4284,78 @@ exit:
 	return rc;
 }
 
-static int cil_check_type_bounds(const struct cil_db *db, policydb_t *pdb, void *type_value_to_cil, struct cil_class *class_value_to_cil[], struct cil_perm **perm_value_to_cil[])
+struct cil_type_bounds_args {
+	const struct cil_db *db;
+	policydb_t *pdb;
+	void **type_value_to_cil;
+	struct cil_class **class_value_to_cil;
+	struct cil_perm ***perm_value_to_cil;
+};
+
+static int __cil_type_bounds_report(uint32_t child, uint32_t parent, avtab_ptr_t bad, void *args)
 {
 	int rc = SEPOL_OK;
-	int i;
-
-	for (i = 0; i < db->num_types; i++) {
-		type_datum_t *child;
-		type_datum_t *parent;
-		avtab_ptr_t bad = NULL;
-		int numbad = 0;
-		struct cil_type *t = db->val_to_type[i];
-
-		if (!t->bounds) continue;
-
-		rc = __cil_get_sepol_type_datum(pdb, DATUM(t), &child);
-		if (rc != SEPOL_OK) goto exit;
-
-		rc = __cil_get_sepol_type_datum(pdb, DATUM(t->bounds), &parent);
-		if (rc != SEPOL_OK) goto exit;
-
-		rc = bounds_check_type(NULL, pdb, child->s.value, parent->s.value, &bad, &numbad);
-		if (rc != SEPOL_OK) goto exit;
-
-		if (bad) {
-			avtab_ptr_t cur;
-			struct cil_avrule target;
-
-			target.rule_kind = CIL_AVRULE_ALLOWED;
-			target.src_str = NULL;
-			target.tgt_str = NULL;
-
-			cil_log(CIL_ERR, "Child type %s exceeds bounds of parent %s\n",
-				t->datum.fqn, t->bounds->datum.fqn);
-			for (cur = bad; cur; cur = cur->next) {
-				struct cil_list_item *i2;
-				struct cil_list *matching;
-				struct cil_tree_node *n;
-
-				rc = cil_avrule_from_sepol(pdb, cur, &target, type_value_to_cil, class_value_to_cil, perm_value_to_cil);
-				if (rc != SEPOL_OK) {
-					cil_log(CIL_ERR, "Failed to convert sepol avrule to CIL\n");
-					goto exit;
-				}
-				__cil_print_rule("  ", "allow", &target);
-				cil_list_init(&matching, CIL_NODE);
-				rc = cil_find_matching_avrule_in_ast(db->ast->root, CIL_AVRULE, &target, matching, CIL_FALSE);
-				if (rc) {
-					cil_log(CIL_ERR, "Error occurred while checking type bounds\n");
-					cil_list_destroy(&matching, CIL_FALSE);
-					cil_list_destroy(&target.classperms, CIL_TRUE);
-					bounds_destroy_bad(bad);
-					goto exit;
-				}
+	struct cil_type_bounds_args *a = args;
+	struct cil_type *t = a->type_value_to_cil[child];
+	struct cil_type *p = a->type_value_to_cil[parent];
+	avtab_ptr_t cur;
+	struct cil_avrule target;
+
+	target.rule_kind = CIL_AVRULE_ALLOWED;
+	target.src_str = NULL;
+	target.tgt_str = NULL;
+
+	cil_log(CIL_ERR, "Child type %s exceeds bounds of parent %s\n",
+		t->datum.fqn, p->datum.fqn);
+	for (cur = bad; cur; cur = cur->next) {
+		struct cil_list_item *i2;
+		struct cil_list *matching;
+		struct cil_tree_node *n;
+
+		rc = cil_avrule_from_sepol(a->pdb, cur, &target, a->type_value_to_cil, a->class_value_to_cil, a->perm_value_to_cil);
+		if (rc != SEPOL_OK) {
+			cil_log(CIL_ERR, "Failed to convert sepol avrule to CIL\n");
+			goto exit;
+		}
+		__cil_print_rule("  ", "allow", &target);
+		cil_list_init(&matching, CIL_NODE);
+		rc = cil_find_matching_avrule_in_ast(a->db->ast->root, CIL_AVRULE, &target, matching, CIL_FALSE);
+		if (rc) {
+			cil_log(CIL_ERR, "Error occurred while checking type bounds\n");
+			cil_list_destroy(&matching, CIL_FALSE);
+			cil_list_destroy(&target.classperms, CIL_TRUE);
+			goto exit;
+		}
 
-				cil_list_for_each(i2, matching) {
-					__cil_print_parents("    ", (struct cil_tree_node *)i2->data);
-				}
-				i2 = matching->tail;
-				n = i2->data;
-				__cil_print_rule("      ", "allow", n->data);
-				cil_log(CIL_ERR,"\n");
-				cil_list_destroy(&matching, CIL_FALSE);
-				cil_list_destroy(&target.classperms, CIL_TRUE);
-			}
-			bounds_destroy_bad(bad);
+		cil_list_for_each(i2, matching) {
+			__cil_print_parents("    ", (struct cil_tree_node *)i2->data);
 		}
+		i2 = matching->tail;
+		n = i2->data;
+		__cil_print_rule("      ", "allow", n->data);
+		cil_log(CIL_ERR,"\n");
+		cil_list_destroy(&matching, CIL_FALSE);
+		cil_list_destroy(&target.classperms, CIL_TRUE);
 	}
 
 exit:
 	return rc;
 }
 
+static int cil_check_type_bounds(const struct cil_db *db, policydb_t *pdb, void *type_value_to_cil[], struct cil_class *class_value_to_cil[], struct cil_perm **perm_value_to_cil[])
+{
+	struct cil_type_bounds_args args;
+	int numbad = 0;
+
+	args.db = db;
+	args.pdb = pdb;
+	args.type_value_to_cil = type_value_to_cil;
+	args.class_value_to_cil = class_value_to_cil;
+	args.perm_value_to_cil = perm_value_to_cil;
+
+	return bounds_check_types_map(NULL, pdb, __cil_type_bounds_report, &args, &numbad);
+}
+
 // assumes policydb is already allocated and initialized properly with things
 // like policy type set to kernel and version set appropriately
 int cil_binary_create_allocated_pdb(const struct cil_db *db, sepol_policydb_t *policydb)
@@ -4144,9 +4473,12 @@ int cil_binary_create_allocated_pdb(const struct cil_db *db, sepol_policydb_t *p
 
 	if (db->disable_neverallow != CIL_TRUE) {
 		cil_log(CIL_INFO, "Checking Neverallows\n");
+		cil_profile_phase_begin(db->profile, "neverallow");
 		rc = cil_check_neverallows(db, pdb, neverallows);
+		cil_profile_phase_end(db->profile);
 		if (rc != SEPOL_OK) goto exit;
 
+		cil_profile_phase_begin(db->profile, "bounds");
 		cil_log(CIL_INFO, "Checking User Bounds\n");
 		bounds_check_users(NULL, pdb);
 
@@ -4155,6 +4487,7 @@ int cil_binary_create_allocated_pdb(const struct cil_db *db, sepol_policydb_t *p
 
 		cil_log(CIL_INFO, "Checking Type Bounds\n");
 		rc = cil_check_type_bounds(db, pdb, type_value_to_cil, class_value_to_cil, perm_value_to_cil);
+		cil_profile_phase_end(db->profile);
 		if (rc != SEPOL_OK) goto exit;
 
 	}
@@ -490,7 +490,7 @@ void cil_destroy_perm(struct cil_perm *perm)
 	free(perm);
 }
 
-int cil_gen_perm_nodes(__attribute__((unused)) struct cil_db *db, struct cil_tree_node *current_perm, struct cil_tree_node *ast_node, enum cil_flavor flavor, unsigned int *num_perms)
+int cil_gen_perm_nodes(struct cil_db *db, struct cil_tree_node *current_perm, struct cil_tree_node *ast_node, enum cil_flavor flavor, unsigned int *num_perms)
 {
 	int rc = SEPOL_ERR;
 	struct cil_tree_node *new_ast = NULL;
@@ -501,7 +501,7 @@ int cil_gen_perm_nodes(__attribute__((unused)) struct cil_db *db, struct cil_tre
 			rc = SEPOL_ERR;
 			goto exit;
 		}
-		cil_tree_node_init(&new_ast);
+		cil_tree_node_init_db(db, &new_ast);
 		new_ast->parent = ast_node;
 		new_ast->line = current_perm->line;
 		new_ast->path = current_perm->path;
@@ -4904,23 +4904,23 @@ void cil_destroy_args(struct cil_args *args)
 			break;
 		case CIL_CATSET:
 			cil_destroy_catset((struct cil_catset *)args->arg);
-			free(node);
+			cil_tree_node_free(node);
 			break;
 		case CIL_LEVEL:
 			cil_destroy_level((struct cil_level *)args->arg);
-			free(node);
+			cil_tree_node_free(node);
 			break;
 		case CIL_LEVELRANGE:
 			cil_destroy_levelrange((struct cil_levelrange *)args->arg);
-			free(node);
+			cil_tree_node_free(node);
 			break;
 		case CIL_IPADDR:
 			cil_destroy_ipaddr((struct cil_ipaddr *)args->arg);
-			free(node);
+			cil_tree_node_free(node);
 			break;
 		case CIL_CLASSPERMISSION:
 			cil_destroy_classpermission((struct cil_classpermission *)args->arg);
-			free(node);
+			cil_tree_node_free(node);
 			break;
 		default:
 			cil_log(CIL_ERR, "Destroying arg with the unexpected flavor=%d\n",args->flavor);
@@ -5656,7 +5656,7 @@ int __cil_build_ast_node_helper(struct cil_tree_node *parse_current, uint32_t *f
 		}
 	}
 
-	cil_tree_node_init(&ast_node);
+	cil_tree_node_init_db(db, &ast_node);
 
 	ast_node->parent = ast_current;
 	ast_node->line = parse_current->line;
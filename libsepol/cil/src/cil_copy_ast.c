@@ -1871,7 +1871,7 @@ int __cil_copy_node_helper(struct cil_tree_node *orig, __attribute__((unused)) u
 
 	rc = (*copy_func)(db, orig->data, &data, symtab);
 	if (rc == SEPOL_OK) {
-		cil_tree_node_init(&new);
+		cil_tree_node_init_db(db, &new);
 
 		new->parent = parent;
 		new->line = orig->line;
@@ -293,6 +293,11 @@ struct cil_db {
 	int mls;
 	int target_platform;
 	int policy_version;
+	char *parse_cache_dir;
+	char **parse_cache_used;
+	uint32_t parse_cache_num_used;
+	struct cil_profile *profile;
+	struct cil_pool node_pool;
 };
 
 struct cil_root {
@@ -46,8 +46,11 @@ struct token {
 	uint32_t line;
 };
 
-int cil_lexer_setup(char *buffer, uint32_t size);
-void cil_lexer_destroy(void);
-int cil_lexer_next(struct token *tok);
+/* Opaque per-buffer scanner state, so that several buffers can be lexed concurrently */
+typedef void *cil_lexer_t;
+
+int cil_lexer_setup(cil_lexer_t *lexer, char *buffer, uint32_t size);
+void cil_lexer_destroy(cil_lexer_t lexer);
+int cil_lexer_next(cil_lexer_t lexer, struct token *tok);
 
 #endif /* CIL_LEXER_H_ */
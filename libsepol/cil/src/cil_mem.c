@@ -32,6 +32,16 @@
 #include <string.h>
 
 #include "cil_log.h"
+#include "cil_mem.h"
+
+#define CIL_POOL_CHUNK_SIZE (64 * 1024)
+
+/* Chunks are aligned to their size, so the chunk, and from it the pool,
+ * an object belongs to can be found from the object's address. */
+struct cil_pool_chunk {
+	struct cil_pool_chunk *next;
+	struct cil_pool *pool;
+};
 
 __attribute__((noreturn)) void cil_default_mem_error_handler(void)
 {
@@ -41,6 +51,16 @@ __attribute__((noreturn)) void cil_default_mem_error_handler(void)
 
 void (*cil_mem_error_handler)(void) = &cil_default_mem_error_handler;
 
+int cil_mem_count_allocs = 0;
+uint64_t cil_mem_allocs = 0;
+
+static inline void cil_mem_count(void)
+{
+	if (__atomic_load_n(&cil_mem_count_allocs, __ATOMIC_RELAXED)) {
+		__atomic_fetch_add(&cil_mem_allocs, 1, __ATOMIC_RELAXED);
+	}
+}
+
 void cil_set_mem_error_handler(void (*handler)(void))
 {
 	cil_mem_error_handler = handler;
@@ -56,6 +76,8 @@ void *cil_malloc(size_t size)
 		(*cil_mem_error_handler)();
 	}
 
+	cil_mem_count();
+
 	return mem;
 }
 
@@ -66,6 +88,8 @@ void *cil_calloc(size_t num_elements, size_t element_size)
 		(*cil_mem_error_handler)();
 	}
 
+	cil_mem_count();
+
 	return mem;
 }
 
@@ -79,6 +103,8 @@ void *cil_realloc(void *ptr, size_t size)
 		(*cil_mem_error_handler)();
 	}
 
+	cil_mem_count();
+
 	return mem;
 }
 
@@ -96,5 +122,82 @@ char *cil_strdup(const char *str)
 		(*cil_mem_error_handler)();
 	}
 
+	cil_mem_count();
+
+	return mem;
+}
+
+static void cil_pool_grow(struct cil_pool *pool)
+{
+	struct cil_pool_chunk *chunk;
+	void *chunk_mem = NULL;
+	char *mem;
+	char *end;
+
+	if (posix_memalign(&chunk_mem, CIL_POOL_CHUNK_SIZE, CIL_POOL_CHUNK_SIZE) != 0) {
+		(*cil_mem_error_handler)();
+	}
+
+	chunk = chunk_mem;
+	mem = (char *)(chunk + 1);
+	end = (char *)chunk + CIL_POOL_CHUNK_SIZE - pool->size;
+
+	chunk->next = pool->chunks;
+	chunk->pool = pool;
+	pool->chunks = chunk;
+
+	for (; mem <= end; mem += pool->size) {
+		*(void **)mem = pool->free_list;
+		pool->free_list = mem;
+	}
+}
+
+void *cil_pool_alloc(struct cil_pool *pool)
+{
+	void *mem;
+
+	if (pool->free_list == NULL) {
+		cil_pool_grow(pool);
+	}
+
+	mem = pool->free_list;
+	pool->free_list = *(void **)mem;
+
+	cil_mem_count();
+
 	return mem;
 }
+
+void cil_pool_free(struct cil_pool *pool, void *mem)
+{
+	if (mem == NULL) {
+		return;
+	}
+
+	*(void **)mem = pool->free_list;
+	pool->free_list = mem;
+}
+
+struct cil_pool *cil_pool_of(void *mem)
+{
+	uintptr_t addr = (uintptr_t)mem & ~(uintptr_t)(CIL_POOL_CHUNK_SIZE - 1);
+
+	return ((struct cil_pool_chunk *)addr)->pool;
+}
+
+/* Free every chunk of the pool; objects still allocated from it
+ * become invalid. */
+void cil_pool_release(struct cil_pool *pool)
+{
+	struct cil_pool_chunk *chunk = pool->chunks;
+	struct cil_pool_chunk *next;
+
+	while (chunk != NULL) {
+		next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	pool->chunks = NULL;
+	pool->free_list = NULL;
+}
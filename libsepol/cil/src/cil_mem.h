@@ -30,6 +30,8 @@
 #ifndef CIL_MEM_H_
 #define CIL_MEM_H_
 
+#include <stdint.h>
+
 /* Wrapped malloc that catches errors and calls the error callback */
 void *cil_malloc(size_t size);
 void *cil_calloc(size_t num_elements, size_t element_size);
@@ -37,5 +39,30 @@ void *cil_realloc(void *ptr, size_t size);
 char *cil_strdup(const char *str);
 void (*cil_mem_error_handler)(void);
 
+/* Number of allocations made through the functions here, counted only
+ * while cil_mem_count_allocs, the number of dbs being profiled, is not
+ * zero (see cil_profile.c).  The count is for the whole process, so it
+ * includes allocations made for other dbs at the same time. */
+extern int cil_mem_count_allocs;
+extern uint64_t cil_mem_allocs;
+
+/* Fixed size object pool.  Objects are carved out of large chunks and
+ * returned to a free list, and the chunks are only handed back to the
+ * system by cil_pool_release().  A pool has no lock; it must only be
+ * used by one thread at a time. */
+struct cil_pool {
+	size_t size;
+	void *free_list;
+	struct cil_pool_chunk *chunks;
+};
+
+#define CIL_POOL_OBJ_SIZE(size) ((((size) + sizeof(void *) - 1) / sizeof(void *)) * sizeof(void *))
+#define CIL_POOL_INIT(type) { CIL_POOL_OBJ_SIZE(sizeof(type)), NULL, NULL }
+
+void *cil_pool_alloc(struct cil_pool *pool);
+void cil_pool_free(struct cil_pool *pool, void *mem);
+struct cil_pool *cil_pool_of(void *mem);
+void cil_pool_release(struct cil_pool *pool);
+
 #endif /* CIL_MEM_H_ */
 
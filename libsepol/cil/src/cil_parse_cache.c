@@ -0,0 +1,447 @@
+/*
+ * On-disk cache of CIL parse trees, keyed by the contents of the source.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sepol/errcodes.h>
+#include <sepol/policydb/hashtab.h>
+
+#include "cil_internal.h"
+#include "cil_log.h"
+#include "cil_mem.h"
+#include "cil_tree.h"
+#include "cil_strpool.h"
+#include "cil_parse_cache.h"
+
+/*
+ * A cache file keeps a copy of the source it was made from, so that neither
+ * a hash collision nor a stale file can be taken for a match, followed by
+ * the parse tree as a table of its distinct strings and one record per node
+ * in preorder:
+ *
+ *	uint32_t magic, version
+ *	uint64_t source size
+ *	source
+ *	uint32_t number of strings, then for each: uint32_t length, bytes, NUL
+ *	uint32_t number of records, then for each: uint32_t line, uint32_t code
+ *
+ * CIL_PARSE_CACHE_OPEN starts a list and CIL_PARSE_CACHE_CLOSE ends it; any
+ * other code is a symbol, naming the string at (code - CIL_PARSE_CACHE_SYMBOL).
+ * Values are in host byte order; a cache is only for the machine that made it.
+ */
+#define CIL_PARSE_CACHE_MAGIC 0xf97c11c0
+#define CIL_PARSE_CACHE_VERSION 1
+
+#define CIL_PARSE_CACHE_OPEN 0
+#define CIL_PARSE_CACHE_CLOSE 1
+#define CIL_PARSE_CACHE_SYMBOL 2
+
+#define CIL_PARSE_CACHE_SUFFIX ".cilp"
+
+struct cil_parse_cache_writer {
+	FILE *fp;
+	hashtab_t index;
+	char **strings;
+	uint32_t num_strings;
+	uint32_t strings_size;
+	uint32_t num_records;
+	int err;
+};
+
+struct cil_parse_cache_reader {
+	char *buf;
+	size_t pos;
+	size_t len;
+};
+
+void cil_parse_cache_name(char *data, size_t size, char *cache_name)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	snprintf(cache_name, CIL_PARSE_CACHE_NAME_LEN + 1, "%016" PRIx64 CIL_PARSE_CACHE_SUFFIX, hash);
+}
+
+static char *__cil_parse_cache_path(const char *dir, const char *cache_name)
+{
+	char *path = cil_malloc(strlen(dir) + strlen(cache_name) + 2);
+
+	sprintf(path, "%s/%s", dir, cache_name);
+
+	return path;
+}
+
+/* Parse tree strings are pooled, so they are indexed by address */
+static unsigned int __cil_parse_cache_hash(hashtab_t h, const hashtab_key_t key)
+{
+	uint64_t val = (uint64_t)(uintptr_t)key * 0x9e3779b97f4a7c15ULL;
+
+	return (unsigned int)(val >> 32) & (h->size - 1);
+}
+
+static int __cil_parse_cache_compare(hashtab_t h __attribute__ ((unused)), const hashtab_key_t key1, const hashtab_key_t key2)
+{
+	return (key1 > key2) - (key1 < key2);
+}
+
+static void __cil_parse_cache_index(struct cil_parse_cache_writer *writer, struct cil_tree_node *parent)
+{
+	struct cil_tree_node *node;
+
+	for (node = parent->cl_head; node != NULL; node = node->next) {
+		writer->num_records++;
+		if (node->data == NULL) {
+			__cil_parse_cache_index(writer, node);
+			writer->num_records++;
+			continue;
+		}
+		if (hashtab_search(writer->index, node->data) != NULL) {
+			continue;
+		}
+		if (writer->num_strings == writer->strings_size) {
+			writer->strings_size = writer->strings_size ? writer->strings_size * 2 : 1024;
+			writer->strings = cil_realloc(writer->strings, writer->strings_size * sizeof(*writer->strings));
+		}
+		writer->strings[writer->num_strings++] = node->data;
+		if (hashtab_insert(writer->index, node->data, (hashtab_datum_t)(uintptr_t)writer->num_strings) != SEPOL_OK) {
+			writer->err = SEPOL_ERR;
+		}
+	}
+}
+
+static void __cil_parse_cache_put(struct cil_parse_cache_writer *writer, const void *data, size_t len)
+{
+	if (len != 0 && fwrite(data, len, 1, writer->fp) != 1) {
+		writer->err = SEPOL_ERR;
+	}
+}
+
+static void __cil_parse_cache_put32(struct cil_parse_cache_writer *writer, uint32_t val)
+{
+	__cil_parse_cache_put(writer, &val, sizeof(val));
+}
+
+static void __cil_parse_cache_put_records(struct cil_parse_cache_writer *writer, struct cil_tree_node *parent)
+{
+	struct cil_tree_node *node;
+	uintptr_t index;
+
+	for (node = parent->cl_head; node != NULL; node = node->next) {
+		__cil_parse_cache_put32(writer, node->line);
+		if (node->data == NULL) {
+			__cil_parse_cache_put32(writer, CIL_PARSE_CACHE_OPEN);
+			__cil_parse_cache_put_records(writer, node);
+			__cil_parse_cache_put32(writer, 0);
+			__cil_parse_cache_put32(writer, CIL_PARSE_CACHE_CLOSE);
+		} else {
+			index = (uintptr_t)hashtab_search(writer->index, node->data);
+			__cil_parse_cache_put32(writer, CIL_PARSE_CACHE_SYMBOL + index - 1);
+		}
+	}
+}
+
+int cil_parse_cache_store(const char *dir, const char *cache_name, char *data, size_t size, struct cil_tree *tree)
+{
+	struct cil_parse_cache_writer writer;
+	char *path = __cil_parse_cache_path(dir, cache_name);
+	char *tmp = cil_malloc(strlen(path) + 8);
+	uint64_t source_size = size;
+	uint32_t i, len;
+	int fd;
+	int rc = SEPOL_ERR;
+
+	memset(&writer, 0, sizeof(writer));
+
+	sprintf(tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		cil_log(CIL_INFO, "Failed to create parse cache file in %s\n", dir);
+		goto exit;
+	}
+	writer.fp = fdopen(fd, "w");
+	if (writer.fp == NULL) {
+		close(fd);
+		goto exit;
+	}
+	__fsetlocking(writer.fp, FSETLOCKING_BYCALLER);
+
+	writer.index = hashtab_create(__cil_parse_cache_hash, __cil_parse_cache_compare, 1 << 16);
+	if (writer.index == NULL) {
+		goto exit;
+	}
+	__cil_parse_cache_index(&writer, tree->root);
+
+	__cil_parse_cache_put32(&writer, CIL_PARSE_CACHE_MAGIC);
+	__cil_parse_cache_put32(&writer, CIL_PARSE_CACHE_VERSION);
+	__cil_parse_cache_put(&writer, &source_size, sizeof(source_size));
+	__cil_parse_cache_put(&writer, data, size);
+
+	__cil_parse_cache_put32(&writer, writer.num_strings);
+	for (i = 0; i < writer.num_strings; i++) {
+		len = strlen(writer.strings[i]);
+		__cil_parse_cache_put32(&writer, len);
+		__cil_parse_cache_put(&writer, writer.strings[i], len + 1);
+	}
+
+	__cil_parse_cache_put32(&writer, writer.num_records);
+	__cil_parse_cache_put_records(&writer, tree->root);
+
+	rc = fclose(writer.fp);
+	writer.fp = NULL;
+	if (rc != 0 || writer.err != SEPOL_OK) {
+		rc = SEPOL_ERR;
+		goto exit;
+	}
+
+	if (rename(tmp, path) != 0) {
+		rc = SEPOL_ERR;
+		goto exit;
+	}
+
+	rc = SEPOL_OK;
+
+exit:
+	if (writer.fp != NULL) {
+		fclose(writer.fp);
+	}
+	if (rc != SEPOL_OK && fd >= 0) {
+		unlink(tmp);
+	}
+	hashtab_destroy(writer.index);
+	free(writer.strings);
+	free(tmp);
+	free(path);
+	return rc;
+}
+
+static int __cil_parse_cache_get(struct cil_parse_cache_reader *reader, void *out, size_t len)
+{
+	if (reader->len - reader->pos < len) {
+		return SEPOL_ERR;
+	}
+
+	memcpy(out, reader->buf + reader->pos, len);
+	reader->pos += len;
+
+	return SEPOL_OK;
+}
+
+static char *__cil_parse_cache_read_file(const char *path, size_t *len)
+{
+	FILE *fp;
+	struct stat sb;
+	char *buf = NULL;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		return NULL;
+	}
+
+	if (fstat(fileno(fp), &sb) != 0 || sb.st_size == 0) {
+		goto exit;
+	}
+
+	buf = cil_malloc(sb.st_size);
+	if (fread(buf, sb.st_size, 1, fp) != 1) {
+		free(buf);
+		buf = NULL;
+		goto exit;
+	}
+	*len = sb.st_size;
+
+exit:
+	fclose(fp);
+	return buf;
+}
+
+static void __cil_parse_cache_append(struct cil_tree_node *parent, struct cil_tree_node *node)
+{
+	node->parent = parent;
+	if (parent->cl_head == NULL) {
+		parent->cl_head = node;
+	} else {
+		parent->cl_tail->next = node;
+	}
+	parent->cl_tail = node;
+}
+
+int cil_parse_cache_load(const char *dir, const char *cache_name, char *path, char *data, size_t size, struct cil_tree *tree)
+{
+	struct cil_parse_cache_reader reader;
+	struct cil_tree_node *current = tree->root;
+	struct cil_tree_node *node;
+	char *file = __cil_parse_cache_path(dir, cache_name);
+	char **strings = NULL;
+	char *pool_path;
+	uint64_t source_size;
+	uint32_t magic, version, num_strings, num_records, len, line, code, i;
+	uint32_t depth = 0;
+	int rc = SEPOL_ENOENT;
+
+	reader.pos = 0;
+	reader.buf = __cil_parse_cache_read_file(file, &reader.len);
+	if (reader.buf == NULL) {
+		goto exit;
+	}
+
+	if (__cil_parse_cache_get(&reader, &magic, sizeof(magic)) != SEPOL_OK ||
+	    __cil_parse_cache_get(&reader, &version, sizeof(version)) != SEPOL_OK ||
+	    __cil_parse_cache_get(&reader, &source_size, sizeof(source_size)) != SEPOL_OK) {
+		goto exit;
+	}
+	if (magic != CIL_PARSE_CACHE_MAGIC || version != CIL_PARSE_CACHE_VERSION ||
+	    source_size != size || reader.len - reader.pos < size ||
+	    memcmp(reader.buf + reader.pos, data, size) != 0) {
+		goto exit;
+	}
+	reader.pos += size;
+
+	rc = SEPOL_ERR;
+
+	if (__cil_parse_cache_get(&reader, &num_strings, sizeof(num_strings)) != SEPOL_OK ||
+	    num_strings > (reader.len - reader.pos) / (sizeof(len) + 1)) {
+		goto exit;
+	}
+	strings = cil_malloc(sizeof(*strings) * (num_strings + 1));
+	for (i = 0; i < num_strings; i++) {
+		if (__cil_parse_cache_get(&reader, &len, sizeof(len)) != SEPOL_OK ||
+		    reader.len - reader.pos <= len || reader.buf[reader.pos + len] != '\0') {
+			goto exit;
+		}
+		strings[i] = cil_strpool_add(reader.buf + reader.pos);
+		reader.pos += len + 1;
+	}
+
+	if (__cil_parse_cache_get(&reader, &num_records, sizeof(num_records)) != SEPOL_OK ||
+	    reader.len - reader.pos != (size_t)num_records * 2 * sizeof(uint32_t)) {
+		goto exit;
+	}
+
+	pool_path = cil_strpool_add(path);
+	for (i = 0; i < num_records; i++) {
+		if (__cil_parse_cache_get(&reader, &line, sizeof(line)) != SEPOL_OK ||
+		    __cil_parse_cache_get(&reader, &code, sizeof(code)) != SEPOL_OK) {
+			goto exit;
+		}
+		if (code == CIL_PARSE_CACHE_CLOSE) {
+			if (depth == 0) {
+				goto exit;
+			}
+			current = current->parent;
+			depth--;
+			continue;
+		}
+		if (code != CIL_PARSE_CACHE_OPEN && (depth == 0 || code - CIL_PARSE_CACHE_SYMBOL >= num_strings)) {
+			goto exit;
+		}
+		cil_tree_node_init(&node);
+		node->flavor = CIL_NODE;
+		node->line = line;
+		node->path = pool_path;
+		__cil_parse_cache_append(current, node);
+		if (code == CIL_PARSE_CACHE_OPEN) {
+			current = node;
+			depth++;
+		} else {
+			node->data = strings[code - CIL_PARSE_CACHE_SYMBOL];
+		}
+	}
+	if (depth != 0) {
+		goto exit;
+	}
+
+	rc = SEPOL_OK;
+
+exit:
+	if (rc == SEPOL_ERR) {
+		cil_log(CIL_INFO, "Ignoring invalid parse cache file %s\n", file);
+		cil_tree_children_destroy(tree->root);
+	}
+	free(strings);
+	free(reader.buf);
+	free(file);
+	return rc;
+}
+
+static int __cil_parse_cache_name_compare(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Matches cache files and the temporary files they are written to */
+static int __cil_parse_cache_is_cache_file(const char *name)
+{
+	size_t len = strlen(name);
+	int i;
+
+	if (len != CIL_PARSE_CACHE_NAME_LEN && len != CIL_PARSE_CACHE_NAME_LEN + 7) {
+		return CIL_FALSE;
+	}
+	for (i = 0; i < 16; i++) {
+		if (!isxdigit((unsigned char)name[i])) {
+			return CIL_FALSE;
+		}
+	}
+
+	return strncmp(name + 16, CIL_PARSE_CACHE_SUFFIX, strlen(CIL_PARSE_CACHE_SUFFIX)) == 0;
+}
+
+int cil_parse_cache_prune(struct cil_db *db)
+{
+	DIR *dir;
+	struct dirent *entry;
+	char *name;
+
+	dir = opendir(db->parse_cache_dir);
+	if (dir == NULL) {
+		cil_log(CIL_WARN, "Failed to open parse cache directory %s\n", db->parse_cache_dir);
+		return SEPOL_ERR;
+	}
+
+	qsort(db->parse_cache_used, db->parse_cache_num_used, sizeof(*db->parse_cache_used), __cil_parse_cache_name_compare);
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (!__cil_parse_cache_is_cache_file(entry->d_name)) {
+			continue;
+		}
+		name = entry->d_name;
+		if (bsearch(&name, db->parse_cache_used, db->parse_cache_num_used, sizeof(*db->parse_cache_used), __cil_parse_cache_name_compare) != NULL) {
+			continue;
+		}
+		if (unlinkat(dirfd(dir), entry->d_name, 0) != 0) {
+			cil_log(CIL_WARN, "Failed to remove parse cache file %s/%s\n", db->parse_cache_dir, entry->d_name);
+		}
+	}
+
+	closedir(dir);
+
+	return SEPOL_OK;
+}
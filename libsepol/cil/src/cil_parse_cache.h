@@ -0,0 +1,35 @@
+/*
+ * On-disk cache of CIL parse trees, keyed by the contents of the source.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef CIL_PARSE_CACHE_H_
+#define CIL_PARSE_CACHE_H_
+
+#include <stdint.h>
+
+#include "cil_internal.h"
+#include "cil_tree.h"
+
+/* Cache files are named by a hash of the source: 16 hex digits + ".cilp" */
+#define CIL_PARSE_CACHE_NAME_LEN 21
+
+void cil_parse_cache_name(char *data, size_t size, char *cache_name);
+int cil_parse_cache_load(const char *dir, const char *cache_name, char *path, char *data, size_t size, struct cil_tree *tree);
+int cil_parse_cache_store(const char *dir, const char *cache_name, char *data, size_t size, struct cil_tree *tree);
+int cil_parse_cache_prune(struct cil_db *db);
+
+#endif /* CIL_PARSE_CACHE_H_ */
@@ -44,6 +44,7 @@ int cil_parser(char *_path, char *buffer, uint32_t size, struct cil_tree **parse
 {
 
 	int paren_count = 0;
+	int rc = SEPOL_ERR;
 
 	struct cil_tree *tree = NULL;
 	struct cil_tree_node *node = NULL;
@@ -52,14 +53,18 @@ int cil_parser(char *_path, char *buffer, uint32_t size, struct cil_tree **parse
 	char *path = cil_strpool_add(_path);
 
 	struct token tok;
+	cil_lexer_t lexer = NULL;
 
-	cil_lexer_setup(buffer, size);
+	rc = cil_lexer_setup(&lexer, buffer, size);
+	if (rc != SEPOL_OK) {
+		return rc;
+	}
 
 	tree = *parse_tree;
 	current = tree->root;	
 
 	do {
-		cil_lexer_next(&tok);
+		cil_lexer_next(lexer, &tok);
 		switch (tok.type) {
 		case OPAREN:
 			paren_count++;
@@ -80,7 +85,8 @@ int cil_parser(char *_path, char *buffer, uint32_t size, struct cil_tree **parse
 			paren_count--;
 			if (paren_count < 0) {
 				cil_log(CIL_ERR, "Close parenthesis without matching open at line %d of %s\n", tok.line, path);
-				return SEPOL_ERR;
+				rc = SEPOL_ERR;
+				goto exit;
 			}
 			current = current->parent;
 			break;
@@ -88,7 +94,8 @@ int cil_parser(char *_path, char *buffer, uint32_t size, struct cil_tree **parse
 		case QSTRING:
 			if (paren_count == 0) {
 				cil_log(CIL_ERR, "Symbol not inside parenthesis at line %d of %s\n", tok.line, path);
-				return SEPOL_ERR;
+				rc = SEPOL_ERR;
+				goto exit;
 			}
 			cil_tree_node_init(&item);
 			item->parent = current;
@@ -111,7 +118,8 @@ int cil_parser(char *_path, char *buffer, uint32_t size, struct cil_tree **parse
 		case END_OF_FILE:
 			if (paren_count > 0) {
 				cil_log(CIL_ERR, "Open parenthesis without matching close at line %d of %s\n", tok.line, path);
-				return SEPOL_ERR;
+				rc = SEPOL_ERR;
+				goto exit;
 			}
 			break;
 		case COMMENT:
@@ -119,17 +127,22 @@ int cil_parser(char *_path, char *buffer, uint32_t size, struct cil_tree **parse
 			break;
 		case UNKNOWN:
 			cil_log(CIL_ERR, "Invalid token '%s' at line %d of %s\n", tok.value, tok.line, path);
-			return SEPOL_ERR;
+			rc = SEPOL_ERR;
+			goto exit;
 		default:
 			cil_log(CIL_ERR, "Unknown token type '%d' at line %d of %s\n", tok.type, tok.line, path);
-			return SEPOL_ERR;
+			rc = SEPOL_ERR;
+			goto exit;
 		}
 	}
 	while (tok.type != END_OF_FILE);
 
-	cil_lexer_destroy();
-
 	*parse_tree = tree;
 
-	return SEPOL_OK;
+	rc = SEPOL_OK;
+
+exit:
+	cil_lexer_destroy(lexer);
+
+	return rc;
 }
@@ -46,6 +46,7 @@
 #include "cil_policy.h"
 #include "cil_verify.h"
 #include "cil_symtab.h"
+#include "cil_profile.h"
 
 static int __cil_expr_to_bitmap(struct cil_list *expr, ebitmap_t *out, int max, struct cil_db *db);
 static int __cil_expr_list_to_bitmap(struct cil_list *expr_list, ebitmap_t *out, int max, struct cil_db *db);
@@ -110,21 +111,10 @@ void cil_post_fc_fill_data(struct fc_data *fc, char *path)
 	}
 }
 
-int cil_post_filecon_compare(const void *a, const void *b)
+static int __cil_post_fc_data_compare(struct fc_data *a_data, enum cil_filecon_types a_type, struct fc_data *b_data, enum cil_filecon_types b_type)
 {
 	int rc = 0;
-	struct cil_filecon *a_filecon = *(struct cil_filecon**)a;
-	struct cil_filecon *b_filecon = *(struct cil_filecon**)b;
-	struct fc_data *a_data = cil_malloc(sizeof(*a_data));
-	struct fc_data *b_data = cil_malloc(sizeof(*b_data));
-	char *a_path = cil_malloc(strlen(a_filecon->path_str) + 1);
-	a_path[0] = '\0';
-	char *b_path = cil_malloc(strlen(b_filecon->path_str) + 1);
-	b_path[0] = '\0';
-	strcat(a_path, a_filecon->path_str);
-	strcat(b_path, b_filecon->path_str);
-	cil_post_fc_fill_data(a_data, a_path);
-	cil_post_fc_fill_data(b_data, b_path);
+
 	if (a_data->meta && !b_data->meta) {
 		rc = -1;
 	} else if (b_data->meta && !a_data->meta) {
@@ -137,20 +127,76 @@ int cil_post_filecon_compare(const void *a, const void *b)
 		rc = -1;
 	} else if (b_data->str_len < a_data->str_len) {
 		rc = 1;
-	} else if (a_filecon->type < b_filecon->type) {
+	} else if (a_type < b_type) {
 		rc = -1;
-	} else if (b_filecon->type < a_filecon->type) {
+	} else if (b_type < a_type) {
 		rc = 1;
 	}
 
-	free(a_path);
-	free(b_path);
-	free(a_data);
-	free(b_data);
+	return rc;
+}
+
+int cil_post_filecon_compare(const void *a, const void *b)
+{
+	struct cil_filecon *a_filecon = *(struct cil_filecon**)a;
+	struct cil_filecon *b_filecon = *(struct cil_filecon**)b;
+	struct fc_data a_data;
+	struct fc_data b_data;
+
+	cil_post_fc_fill_data(&a_data, a_filecon->path_str);
+	cil_post_fc_fill_data(&b_data, b_filecon->path_str);
+
+	return __cil_post_fc_data_compare(&a_data, a_filecon->type, &b_data, b_filecon->type);
+}
+
+struct cil_post_fc_key {
+	struct fc_data data;
+	struct cil_filecon *filecon;
+	uint32_t index;
+};
+
+static int __cil_post_fc_key_compare(const void *a, const void *b)
+{
+	struct cil_post_fc_key *a_key = (struct cil_post_fc_key *)a;
+	struct cil_post_fc_key *b_key = (struct cil_post_fc_key *)b;
+	int rc;
+
+	rc = __cil_post_fc_data_compare(&a_key->data, a_key->filecon->type, &b_key->data, b_key->filecon->type);
+	if (rc == 0) {
+		rc = (a_key->index > b_key->index) - (a_key->index < b_key->index);
+	}
 
 	return rc;
 }
 
+/* Filecons are ordered by cil_post_filecon_compare(), whose keys take a scan
+ * of the path to compute. They are computed once per filecon here instead of
+ * twice per comparison; filecons with equal keys keep their policy order. */
+static void __cil_post_filecon_sort(struct cil_sort *sort)
+{
+	struct cil_post_fc_key *keys;
+	uint32_t i;
+
+	if (sort->count < 2) {
+		return;
+	}
+
+	keys = cil_malloc(sizeof(*keys) * sort->count);
+	for (i = 0; i < sort->count; i++) {
+		keys[i].filecon = sort->array[i];
+		keys[i].index = i;
+		cil_post_fc_fill_data(&keys[i].data, keys[i].filecon->path_str);
+	}
+
+	qsort(keys, sort->count, sizeof(*keys), __cil_post_fc_key_compare);
+
+	for (i = 0; i < sort->count; i++) {
+		sort->array[i] = keys[i].filecon;
+	}
+
+	free(keys);
+}
+
 int cil_post_portcon_compare(const void *a, const void *b)
 {
 	int rc = SEPOL_ERR;
@@ -1591,53 +1637,67 @@ static int cil_post_db(struct cil_db *db)
 {
 	int rc = SEPOL_ERR;
 
+	cil_profile_phase_begin(db->profile, "post:count");
 	rc = cil_tree_walk(db->ast->root, __cil_post_db_count_helper, NULL, NULL, db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failure during cil databse count helper\n");
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:arrays");
 	rc = cil_tree_walk(db->ast->root, __cil_post_db_array_helper, NULL, NULL, db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failure during cil database array helper\n");
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:attributes");
 	rc = cil_tree_walk(db->ast->root, __cil_post_db_attr_helper, NULL, NULL, db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to create attribute bitmaps\n");
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:roletypes");
 	rc = cil_tree_walk(db->ast->root, __cil_post_db_roletype_helper, NULL, NULL, db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed during roletype association\n");
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:classperms");
 	rc = cil_tree_walk(db->ast->root, __cil_post_db_classperms_helper, NULL, NULL, db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to evaluate class mapping permissions expressions\n");
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:categories");
 	rc = cil_tree_walk(db->ast->root, __cil_post_db_cat_helper, NULL, NULL, db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_INFO, "Failed to evaluate category expressions\n");
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:sort");
 	qsort(db->netifcon->array, db->netifcon->count, sizeof(db->netifcon->array), cil_post_netifcon_compare);
 	qsort(db->genfscon->array, db->genfscon->count, sizeof(db->genfscon->array), cil_post_genfscon_compare);
 	qsort(db->portcon->array, db->portcon->count, sizeof(db->portcon->array), cil_post_portcon_compare);
 	qsort(db->nodecon->array, db->nodecon->count, sizeof(db->nodecon->array), cil_post_nodecon_compare);
 	qsort(db->fsuse->array, db->fsuse->count, sizeof(db->fsuse->array), cil_post_fsuse_compare);
-	qsort(db->filecon->array, db->filecon->count, sizeof(db->filecon->array), cil_post_filecon_compare);
+	__cil_post_filecon_sort(db->filecon);
 	qsort(db->pirqcon->array, db->pirqcon->count, sizeof(db->pirqcon->array), cil_post_pirqcon_compare);
 	qsort(db->iomemcon->array, db->iomemcon->count, sizeof(db->iomemcon->array), cil_post_iomemcon_compare);
 	qsort(db->ioportcon->array, db->ioportcon->count, sizeof(db->ioportcon->array), cil_post_ioportcon_compare);
 	qsort(db->pcidevicecon->array, db->pcidevicecon->count, sizeof(db->pcidevicecon->array), cil_post_pcidevicecon_compare);
 	qsort(db->devicetreecon->array, db->devicetreecon->count, sizeof(db->devicetreecon->array), cil_post_devicetreecon_compare);
+	cil_profile_phase_end(db->profile);
 
 exit:
 	return rc;
@@ -1726,7 +1786,9 @@ int cil_post_process(struct cil_db *db)
 {
 	int rc = SEPOL_ERR;
 
+	cil_profile_phase_begin(db->profile, "post:pre-verify");
 	rc = cil_pre_verify(db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_ERR, "Failed to verify cil database\n");
 		goto exit;
@@ -1738,7 +1800,9 @@ int cil_post_process(struct cil_db *db)
 		goto exit;
 	}
 
+	cil_profile_phase_begin(db->profile, "post:verify");
 	rc = cil_post_verify(db);
+	cil_profile_phase_end(db->profile);
 	if (rc != SEPOL_OK) {
 		cil_log(CIL_ERR, "Failed to verify cil database\n");
 		goto exit;
@@ -0,0 +1,214 @@
+/*
+ * Per-phase timing and memory profile of a CIL compilation.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sepol/errcodes.h>
+
+#include "cil_internal.h"
+#include "cil_log.h"
+#include "cil_mem.h"
+#include "cil_profile.h"
+
+/*
+ * A phase is recorded when it begins, so phases are listed in the order in
+ * which they began and a phase is followed by the phases nested in it. While
+ * a phase is open its counters hold their values at its start, and they are
+ * replaced by the differences when it ends.
+ */
+
+static uint64_t __cil_profile_usec(clockid_t clock)
+{
+	struct timespec ts;
+
+	if (clock_gettime(clock, &ts) != 0) {
+		return 0;
+	}
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long __cil_profile_peak_rss(void)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+	return usage.ru_maxrss;
+}
+
+void cil_profile_init(struct cil_profile **profile)
+{
+	struct cil_profile *new = cil_malloc(sizeof(*new));
+
+	new->phases = NULL;
+	new->count = 0;
+	new->size = 0;
+	new->depth = 0;
+
+	__atomic_fetch_add(&cil_mem_count_allocs, 1, __ATOMIC_RELAXED);
+
+	*profile = new;
+}
+
+void cil_profile_destroy(struct cil_profile **profile)
+{
+	uint32_t i;
+
+	if (*profile == NULL) {
+		return;
+	}
+
+	for (i = 0; i < (*profile)->count; i++) {
+		free((*profile)->phases[i].name);
+	}
+	free((*profile)->phases);
+	free(*profile);
+	*profile = NULL;
+
+	__atomic_fetch_sub(&cil_mem_count_allocs, 1, __ATOMIC_RELAXED);
+}
+
+void cil_profile_phase_begin(struct cil_profile *profile, const char *name)
+{
+	struct cil_profile_phase *phase;
+
+	if (profile == NULL) {
+		return;
+	}
+
+	if (profile->depth == CIL_PROFILE_MAX_DEPTH) {
+		cil_log(CIL_WARN, "Profile phases nested too deeply, not recording %s\n", name);
+		return;
+	}
+
+	if (profile->count == profile->size) {
+		profile->size = profile->size ? profile->size * 2 : 32;
+		profile->phases = cil_realloc(profile->phases, sizeof(*profile->phases) * profile->size);
+	}
+
+	phase = &profile->phases[profile->count];
+	phase->name = cil_strdup(name);
+	phase->depth = profile->depth;
+	phase->allocs = cil_mem_allocs;
+	phase->peak_rss_kb = 0;
+	phase->cpu_usec = __cil_profile_usec(CLOCK_PROCESS_CPUTIME_ID);
+	phase->wall_usec = __cil_profile_usec(CLOCK_MONOTONIC);
+
+	profile->open[profile->depth++] = profile->count++;
+}
+
+void cil_profile_phase_end(struct cil_profile *profile)
+{
+	struct cil_profile_phase *phase;
+
+	if (profile == NULL || profile->depth == 0) {
+		return;
+	}
+
+	phase = &profile->phases[profile->open[--profile->depth]];
+	phase->wall_usec = __cil_profile_usec(CLOCK_MONOTONIC) - phase->wall_usec;
+	phase->cpu_usec = __cil_profile_usec(CLOCK_PROCESS_CPUTIME_ID) - phase->cpu_usec;
+	phase->allocs = cil_mem_allocs - phase->allocs;
+	phase->peak_rss_kb = __cil_profile_peak_rss();
+}
+
+static size_t __cil_profile_escape(char *buf, const char *str)
+{
+	size_t len = 0;
+
+	for (; *str != '\0'; str++) {
+		if (*str == '"' || *str == '\\') {
+			if (buf) {
+				buf[len] = '\\';
+				buf[len + 1] = *str;
+			}
+			len += 2;
+		} else if ((unsigned char)*str < 0x20) {
+			if (buf) {
+				sprintf(buf + len, "\\u%04x", (unsigned char)*str);
+			}
+			len += 6;
+		} else {
+			if (buf) {
+				buf[len] = *str;
+			}
+			len++;
+		}
+	}
+
+	return len;
+}
+
+static size_t __cil_profile_phase_to_json(char *buf, struct cil_profile_phase *phase, int last)
+{
+	size_t len;
+
+	len = sprintf(buf, "    {\"name\": \"");
+	len += __cil_profile_escape(buf + len, phase->name);
+	len += sprintf(buf + len, "\", \"depth\": %u, \"wall_usec\": %llu, \"cpu_usec\": %llu, \"allocations\": %llu, \"peak_rss_kb\": %ld}%s\n",
+		phase->depth, (unsigned long long)phase->wall_usec, (unsigned long long)phase->cpu_usec,
+		(unsigned long long)phase->allocs, phase->peak_rss_kb, last ? "" : ",");
+
+	return len;
+}
+
+/* Phases that are still open are ended first */
+int cil_profile_report(struct cil_profile *profile, char **out, size_t *size)
+{
+	static const char head[] = "{\n  \"phases\": [\n";
+	static const char tail[] = "  ]\n}\n";
+	/* Everything in a phase's line but its name */
+	const size_t line_max = 256;
+	char *str_tmp;
+	size_t str_len;
+	uint32_t i;
+
+	if (profile == NULL) {
+		return SEPOL_ERR;
+	}
+
+	while (profile->depth > 0) {
+		cil_profile_phase_end(profile);
+	}
+
+	str_len = strlen(head) + strlen(tail);
+	for (i = 0; i < profile->count; i++) {
+		str_len += line_max + __cil_profile_escape(NULL, profile->phases[i].name);
+	}
+
+	str_tmp = cil_malloc(str_len + 1);
+	*out = str_tmp;
+
+	str_tmp += sprintf(str_tmp, "%s", head);
+	for (i = 0; i < profile->count; i++) {
+		str_tmp += __cil_profile_phase_to_json(str_tmp, &profile->phases[i], i + 1 == profile->count);
+	}
+	str_tmp += sprintf(str_tmp, "%s", tail);
+
+	*size = str_tmp - *out;
+
+	return SEPOL_OK;
+}
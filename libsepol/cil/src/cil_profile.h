@@ -0,0 +1,50 @@
+/*
+ * Per-phase timing and memory profile of a CIL compilation.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef CIL_PROFILE_H_
+#define CIL_PROFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CIL_PROFILE_MAX_DEPTH 8
+
+struct cil_profile_phase {
+	char *name;
+	uint32_t depth;
+	uint64_t wall_usec;
+	uint64_t cpu_usec;
+	uint64_t allocs;
+	long peak_rss_kb;
+};
+
+struct cil_profile {
+	struct cil_profile_phase *phases;
+	uint32_t count;
+	uint32_t size;
+	uint32_t depth;
+	uint32_t open[CIL_PROFILE_MAX_DEPTH];
+};
+
+void cil_profile_init(struct cil_profile **profile);
+void cil_profile_destroy(struct cil_profile **profile);
+void cil_profile_phase_begin(struct cil_profile *profile, const char *name);
+void cil_profile_phase_end(struct cil_profile *profile);
+int cil_profile_report(struct cil_profile *profile, char **out, size_t *size);
+
+#endif /* CIL_PROFILE_H_ */
@@ -44,13 +44,37 @@
 #include "cil_reset_ast.h"
 #include "cil_copy_ast.h"
 #include "cil_verify.h"
+#include "cil_profile.h"
 #include "cil_strpool.h"
 #include "cil_symtab.h"
 
+/* Cache of successful name lookups, keyed by (scope node, symtab, name).
+ * Names are pooled strings, so they are compared by address.  The cache
+ * is direct-mapped and of fixed size, so that it stays small enough to be
+ * cheaper to probe than the symtab walk it replaces; a collision simply
+ * replaces the older entry.  Flushing bumps the generation, and entries
+ * from an older generation count as empty. */
+struct cil_resolve_memo_entry {
+	struct cil_tree_node *scope;
+	char *name;
+	struct cil_symtab_datum *datum;
+	uint32_t sym_index;
+	uint32_t generation;
+};
+
+struct cil_resolve_memo {
+	struct cil_resolve_memo_entry *entries;
+	uint32_t generation;
+	unsigned long hits;
+	unsigned long misses;
+};
+
 struct cil_args_resolve {
 	struct cil_db *db;
 	enum cil_pass pass;
 	uint32_t *changed;
+	uint32_t recount_used;
+	struct cil_resolve_memo memo;
 	char *last_resolved_name;
 	struct cil_tree_node *callstack;
 	struct cil_tree_node *optstack;
@@ -64,6 +88,75 @@ struct cil_args_resolve {
 	struct cil_list *in_list;
 };
 
+#define CIL_RESOLVE_MEMO_SIZE (1 << 16)
+
+static void __cil_resolve_memo_init(struct cil_resolve_memo *memo)
+{
+	memo->entries = NULL;
+	memo->generation = 1;
+	memo->hits = 0;
+	memo->misses = 0;
+}
+
+static void __cil_resolve_memo_destroy(struct cil_resolve_memo *memo)
+{
+	free(memo->entries);
+	memo->entries = NULL;
+}
+
+/* Must be called whenever declarations or scopes may go away or change */
+static void __cil_resolve_memo_flush(struct cil_resolve_memo *memo)
+{
+	memo->generation++;
+	if (memo->generation == 0) {
+		if (memo->entries != NULL) {
+			memset(memo->entries, 0, CIL_RESOLVE_MEMO_SIZE * sizeof(*memo->entries));
+		}
+		memo->generation = 1;
+	}
+}
+
+static struct cil_resolve_memo_entry *__cil_resolve_memo_slot(struct cil_resolve_memo *memo, struct cil_tree_node *scope, enum cil_sym_index sym_index, char *name)
+{
+	uint64_t val = (uint64_t)(uintptr_t)scope * 0x9e3779b97f4a7c15ULL;
+
+	if (memo->entries == NULL) {
+		memo->entries = cil_calloc(CIL_RESOLVE_MEMO_SIZE, sizeof(*memo->entries));
+	}
+
+	val ^= (uint64_t)(uintptr_t)name + sym_index;
+	val ^= val >> 33;
+	val *= 0xff51afd7ed558ccdULL;
+	val ^= val >> 33;
+
+	return &memo->entries[(val >> 16) & (CIL_RESOLVE_MEMO_SIZE - 1)];
+}
+
+static struct cil_symtab_datum *__cil_resolve_memo_lookup(struct cil_resolve_memo *memo, struct cil_tree_node *scope, enum cil_sym_index sym_index, char *name)
+{
+	struct cil_resolve_memo_entry *entry = __cil_resolve_memo_slot(memo, scope, sym_index, name);
+
+	if (entry->generation == memo->generation && entry->scope == scope &&
+	    entry->name == name && entry->sym_index == sym_index) {
+		memo->hits++;
+		return entry->datum;
+	}
+
+	memo->misses++;
+	return NULL;
+}
+
+static void __cil_resolve_memo_insert(struct cil_resolve_memo *memo, struct cil_tree_node *scope, enum cil_sym_index sym_index, char *name, struct cil_symtab_datum *datum)
+{
+	struct cil_resolve_memo_entry *entry = __cil_resolve_memo_slot(memo, scope, sym_index, name);
+
+	entry->scope = scope;
+	entry->name = name;
+	entry->datum = datum;
+	entry->sym_index = sym_index;
+	entry->generation = memo->generation;
+}
+
 static struct cil_name * __cil_insert_name(struct cil_db *db, hashtab_key_t key, struct cil_tree_node *ast_node)
 {
 	/* Currently only used for typetransition file names.
@@ -2477,7 +2570,7 @@ int cil_resolve_call1(struct cil_tree_node *current, void *extra_args)
 						cil_destroy_catset(catset);
 						goto exit;
 					}
-					cil_tree_node_init(&cat_node);
+					cil_tree_node_init_db(db, &cat_node);
 					cat_node->flavor = CIL_CATSET;
 					cat_node->data = catset;
 					cil_list_append(((struct cil_symtab_datum*)catset)->nodes,
@@ -2501,7 +2594,7 @@ int cil_resolve_call1(struct cil_tree_node *current, void *extra_args)
 						cil_destroy_level(level);
 						goto exit;
 					}
-					cil_tree_node_init(&lvl_node);
+					cil_tree_node_init_db(db, &lvl_node);
 					lvl_node->flavor = CIL_LEVEL;
 					lvl_node->data = level;
 					cil_list_append(((struct cil_symtab_datum*)level)->nodes, 
@@ -2525,7 +2618,7 @@ int cil_resolve_call1(struct cil_tree_node *current, void *extra_args)
 						cil_destroy_levelrange(range);
 						goto exit;
 					}
-					cil_tree_node_init(&range_node);
+					cil_tree_node_init_db(db, &range_node);
 					range_node->flavor = CIL_LEVELRANGE;
 					range_node->data = range;
 					cil_list_append(((struct cil_symtab_datum*)range)->nodes, 
@@ -2549,7 +2642,7 @@ int cil_resolve_call1(struct cil_tree_node *current, void *extra_args)
 						cil_destroy_ipaddr(ipaddr);
 						goto exit;
 					}
-					cil_tree_node_init(&addr_node);
+					cil_tree_node_init_db(db, &addr_node);
 					addr_node->flavor = CIL_IPADDR;
 					addr_node->data = ipaddr;
 					cil_list_append(((struct cil_symtab_datum*)ipaddr)->nodes,
@@ -2579,7 +2672,7 @@ int cil_resolve_call1(struct cil_tree_node *current, void *extra_args)
 						cil_destroy_classpermission(cp);
 						goto exit;
 					}
-					cil_tree_node_init(&cp_node);
+					cil_tree_node_init_db(db, &cp_node);
 					cp_node->flavor = CIL_CLASSPERMISSION;
 					cp_node->data = cp;
 					cil_list_append(cp->datum.nodes, CIL_LIST_ITEM, cp_node);
@@ -3343,7 +3436,7 @@ int __cil_resolve_ast_first_child_helper(struct cil_tree_node *current, void *ex
 
 	if (parent->flavor == CIL_CALL || parent->flavor == CIL_OPTIONAL || parent->flavor == CIL_BLOCK) {
 		/* push this node onto a stack */
-		cil_tree_node_init(&new);
+		cil_tree_node_init_db(args->db, &new);
 
 		new->data = parent->data;
 		new->flavor = parent->flavor;
@@ -3391,6 +3484,196 @@ exit:
 
 }
 
+/* An optional made up only of statements that refer to declarations
+ * made elsewhere provides nothing that other statements can resolve to,
+ * so disabling it does not require the AST to be reset and re-resolved.
+ */
+static int __cil_optional_is_local_helper(struct cil_tree_node *node, uint32_t *finished, void *extra_args)
+{
+	int *local = extra_args;
+
+	switch (node->flavor) {
+	case CIL_OPTIONAL:
+	case CIL_CALL:
+	case CIL_BOOLEANIF:
+	case CIL_CONDBLOCK:
+	case CIL_AVRULE:
+	case CIL_TYPE_RULE:
+	case CIL_NAMETYPETRANSITION:
+	case CIL_RANGETRANSITION:
+	case CIL_ROLETRANSITION:
+	case CIL_ROLEALLOW:
+	case CIL_ROLETYPE:
+	case CIL_TYPEPERMISSIVE:
+	case CIL_TYPEATTRIBUTESET:
+		break;
+	default:
+		*local = CIL_FALSE;
+		*finished = CIL_TREE_SKIP_ALL;
+		break;
+	}
+
+	return SEPOL_OK;
+}
+
+static int __cil_optional_is_local(struct cil_tree_node *optional)
+{
+	int local = CIL_TRUE;
+
+	cil_tree_walk(optional, __cil_optional_is_local_helper, NULL, NULL, &local);
+
+	return local;
+}
+
+/* Remove the expressions a typeattributeset within a disabled optional
+ * added to its attribute */
+static int __cil_optional_unlink_helper(struct cil_tree_node *node, __attribute__((unused)) uint32_t *finished, void *extra_args)
+{
+	struct cil_typeattributeset *attrtypes;
+	struct cil_symtab_datum *attr_datum = NULL;
+	struct cil_typeattribute *attr;
+	int rc;
+
+	if (node->flavor != CIL_TYPEATTRIBUTESET) {
+		return SEPOL_OK;
+	}
+
+	attrtypes = node->data;
+	if (attrtypes->datum_expr == NULL) {
+		return SEPOL_OK;
+	}
+
+	rc = cil_resolve_name(node, attrtypes->attr_str, CIL_SYM_TYPES, extra_args, &attr_datum);
+	if (rc != SEPOL_OK || FLAVOR(attr_datum) != CIL_TYPEATTRIBUTE) {
+		return SEPOL_OK;
+	}
+
+	attr = (struct cil_typeattribute *)attr_datum;
+	if (attr->expr_list != NULL) {
+		cil_list_remove(attr->expr_list, CIL_LIST, attrtypes->datum_expr, CIL_FALSE);
+	}
+
+	return SEPOL_OK;
+}
+
+static int __cil_reset_used_helper(struct cil_tree_node *node, __attribute__((unused)) uint32_t *finished, __attribute__((unused)) void *extra_args)
+{
+	if (node->flavor == CIL_TYPEATTRIBUTE) {
+		((struct cil_typeattribute *)node->data)->used = CIL_FALSE;
+	}
+
+	return SEPOL_OK;
+}
+
+static void __cil_recount_used_expr(struct cil_list *expr)
+{
+	struct cil_list_item *curr;
+
+	if (expr == NULL) {
+		return;
+	}
+
+	cil_list_for_each(curr, expr) {
+		if (curr->flavor == CIL_DATUM) {
+			cil_type_used(curr->data);
+		} else if (curr->flavor == CIL_LIST) {
+			__cil_recount_used_expr(curr->data);
+		}
+	}
+}
+
+static int __cil_recount_used_helper(struct cil_tree_node *node, uint32_t *finished, __attribute__((unused)) void *extra_args)
+{
+	switch (node->flavor) {
+	case CIL_MACRO:
+		*finished = CIL_TREE_SKIP_HEAD;
+		break;
+	case CIL_BLOCK:
+		if (((struct cil_block *)node->data)->is_abstract == CIL_TRUE) {
+			*finished = CIL_TREE_SKIP_HEAD;
+		}
+		break;
+	case CIL_AVRULE: {
+		struct cil_avrule *rule = node->data;
+		if (rule->rule_kind != CIL_AVRULE_NEVERALLOW) {
+			if (rule->src != NULL) {
+				cil_type_used(rule->src);
+			}
+			if (rule->tgt != NULL && rule->tgt_str != CIL_KEY_SELF) {
+				cil_type_used(rule->tgt);
+			}
+		}
+		break;
+	}
+	case CIL_TYPE_RULE: {
+		struct cil_type_rule *rule = node->data;
+		if (rule->src != NULL) {
+			cil_type_used(rule->src);
+		}
+		if (rule->tgt != NULL) {
+			cil_type_used(rule->tgt);
+		}
+		break;
+	}
+	case CIL_NAMETYPETRANSITION: {
+		struct cil_nametypetransition *nametypetrans = node->data;
+		if (nametypetrans->src != NULL) {
+			cil_type_used(nametypetrans->src);
+		}
+		if (nametypetrans->tgt != NULL) {
+			cil_type_used(nametypetrans->tgt);
+		}
+		break;
+	}
+	case CIL_RANGETRANSITION: {
+		struct cil_rangetransition *rangetrans = node->data;
+		if (rangetrans->src != NULL) {
+			cil_type_used(rangetrans->src);
+		}
+		if (rangetrans->exec != NULL) {
+			cil_type_used(rangetrans->exec);
+		}
+		break;
+	}
+	case CIL_ROLETYPE: {
+		struct cil_roletype *roletype = node->data;
+		if (roletype->type != NULL) {
+			cil_type_used((struct cil_symtab_datum *)roletype->type);
+		}
+		break;
+	}
+	case CIL_ROLETRANSITION: {
+		struct cil_roletransition *roletrans = node->data;
+		if (roletrans->tgt != NULL) {
+			cil_type_used(roletrans->tgt);
+		}
+		break;
+	}
+	case CIL_CONSTRAIN:
+	case CIL_MLSCONSTRAIN:
+		__cil_recount_used_expr(((struct cil_constrain *)node->data)->datum_expr);
+		break;
+	case CIL_VALIDATETRANS:
+	case CIL_MLSVALIDATETRANS:
+		__cil_recount_used_expr(((struct cil_validatetrans *)node->data)->datum_expr);
+		break;
+	default:
+		break;
+	}
+
+	return SEPOL_OK;
+}
+
+/* Statements in optionals removed without a reset may have marked
+ * attributes as used, so recompute the flag from what is left. Every
+ * statement whose resolution calls cil_type_used() must be handled by
+ * __cil_recount_used_helper(). */
+static void __cil_recount_used(struct cil_tree_node *current)
+{
+	cil_tree_walk(current, __cil_reset_used_helper, NULL, NULL, NULL);
+	cil_tree_walk(current, __cil_recount_used_helper, NULL, NULL, NULL);
+}
+
 int __cil_resolve_ast_last_child_helper(struct cil_tree_node *current, void *extra_args)
 {
 	int rc = SEPOL_ERR;
@@ -3411,14 +3694,20 @@ int __cil_resolve_ast_last_child_helper(struct cil_tree_node *current, void *ext
 		if (callstack->cl_head) {
 			callstack->cl_head->parent = NULL;
 		}
-		free(callstack);
+		cil_tree_node_free(callstack);
 	} else if (parent->flavor == CIL_MACRO) {
 		args->macro = NULL;
 	} else if (parent->flavor == CIL_OPTIONAL) {
 		struct cil_tree_node *optstack;
 
 		if (((struct cil_optional *)parent->data)->enabled == CIL_FALSE) {
-			*(args->changed) = CIL_TRUE;
+			if (__cil_optional_is_local(parent)) {
+				cil_tree_walk(parent, __cil_optional_unlink_helper, NULL, NULL, args);
+				args->recount_used = CIL_TRUE;
+			} else {
+				*(args->changed) = CIL_TRUE;
+			}
+			__cil_resolve_memo_flush(&args->memo);
 			cil_tree_children_destroy(parent);
 		}
 
@@ -3428,7 +3717,7 @@ int __cil_resolve_ast_last_child_helper(struct cil_tree_node *current, void *ext
 		if (optstack->cl_head) {
 			optstack->cl_head->parent = NULL;
 		}
-		free(optstack);
+		cil_tree_node_free(optstack);
 	} else if (parent->flavor == CIL_BOOLEANIF) {
 		args->boolif = NULL;
 	} else if (parent->flavor == CIL_BLOCK) {
@@ -3438,7 +3727,7 @@ int __cil_resolve_ast_last_child_helper(struct cil_tree_node *current, void *ext
 		if (blockstack->cl_head) {
 			blockstack->cl_head->parent = NULL;
 		}
-		free(blockstack);
+		cil_tree_node_free(blockstack);
 	}
 
 	return SEPOL_OK;
@@ -3447,12 +3736,32 @@ exit:
 	return rc;
 }
 
+static const char *cil_resolve_pass_names[CIL_PASS_NUM] = {
+	[CIL_PASS_TIF] = "resolve:tif",
+	[CIL_PASS_IN] = "resolve:in",
+	[CIL_PASS_BLKIN_LINK] = "resolve:blkin_link",
+	[CIL_PASS_BLKIN_COPY] = "resolve:blkin_copy",
+	[CIL_PASS_BLKABS] = "resolve:blkabs",
+	[CIL_PASS_MACRO] = "resolve:macro",
+	[CIL_PASS_CALL1] = "resolve:call1",
+	[CIL_PASS_CALL2] = "resolve:call2",
+	[CIL_PASS_ALIAS1] = "resolve:alias1",
+	[CIL_PASS_ALIAS2] = "resolve:alias2",
+	[CIL_PASS_MISC1] = "resolve:misc1",
+	[CIL_PASS_MLS] = "resolve:mls",
+	[CIL_PASS_MISC2] = "resolve:misc2",
+	[CIL_PASS_MISC3] = "resolve:misc3",
+};
+
 int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 {
 	int rc = SEPOL_ERR;
 	struct cil_args_resolve extra_args;
 	enum cil_pass pass = CIL_PASS_TIF;
 	uint32_t changed = 0;
+	int in_pass_phase = CIL_FALSE;
+
+	__cil_resolve_memo_init(&extra_args.memo);
 
 	if (db == NULL || current == NULL) {
 		goto exit;
@@ -3461,6 +3770,7 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 	extra_args.db = db;
 	extra_args.pass = pass;
 	extra_args.changed = &changed;
+	extra_args.recount_used = CIL_FALSE;
 	extra_args.last_resolved_name = NULL;
 	extra_args.callstack = NULL;
 	extra_args.optstack = NULL;
@@ -3480,6 +3790,8 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 	cil_list_init(&extra_args.in_list, CIL_IN);
 	for (pass = CIL_PASS_TIF; pass < CIL_PASS_NUM; pass++) {
 		extra_args.pass = pass;
+		cil_profile_phase_begin(db->profile, cil_resolve_pass_names[pass]);
+		in_pass_phase = CIL_TRUE;
 		rc = cil_tree_walk(current, __cil_resolve_ast_node_helper, __cil_resolve_ast_first_child_helper, __cil_resolve_ast_last_child_helper, &extra_args);
 		if (rc != SEPOL_OK) {
 			cil_log(CIL_INFO, "Pass %i of resolution failed\n", pass);
@@ -3522,6 +3834,9 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 			}
 		}
 
+		cil_profile_phase_end(db->profile);
+		in_pass_phase = CIL_FALSE;
+
 		if (changed && (pass > CIL_PASS_CALL1)) {
 			/* Need to re-resolve because an optional was disabled that contained
 			 * one or more declarations. We only need to reset to the call1 pass 
@@ -3545,7 +3860,10 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 
 			pass = CIL_PASS_CALL1;
 
+			__cil_resolve_memo_flush(&extra_args.memo);
+			cil_profile_phase_begin(db->profile, "reset");
 			rc = cil_reset_ast(current);
+			cil_profile_phase_end(db->profile);
 			if (rc != SEPOL_OK) {
 				cil_log(CIL_ERR, "Failed to reset declarations\n");
 				goto exit;
@@ -3557,30 +3875,40 @@ int cil_resolve_ast(struct cil_db *db, struct cil_tree_node *current)
 		while (extra_args.callstack != NULL) {
 			struct cil_tree_node *curr = extra_args.callstack;
 			struct cil_tree_node *next = curr->cl_head;
-			free(curr);
+			cil_tree_node_free(curr);
 			extra_args.callstack = next;
 		}
 		while (extra_args.optstack != NULL) {
 			struct cil_tree_node *curr = extra_args.optstack;
 			struct cil_tree_node *next = curr->cl_head;
-			free(curr);
+			cil_tree_node_free(curr);
 			extra_args.optstack = next;
 		}
 		while (extra_args.blockstack!= NULL) {
 			struct cil_tree_node *curr = extra_args.blockstack;
 			struct cil_tree_node *next = curr->cl_head;
-			free(curr);
+			cil_tree_node_free(curr);
 			extra_args.blockstack= next;
 		}
 	}
 
+	if (extra_args.recount_used) {
+		__cil_recount_used(current);
+	}
+
 	rc = __cil_verify_initsids(db->sidorder);
 	if (rc != SEPOL_OK) {
 		goto exit;
 	}
 
+	cil_log(CIL_INFO, "Name resolution cache: %lu hits, %lu misses\n", extra_args.memo.hits, extra_args.memo.misses);
+
 	rc = SEPOL_OK;
 exit:
+	if (in_pass_phase) {
+		cil_profile_phase_end(db->profile);
+	}
+	__cil_resolve_memo_destroy(&extra_args.memo);
 	return rc;
 }
 
@@ -3670,6 +3998,17 @@ int cil_resolve_name(struct cil_tree_node *ast_node, char *name, enum cil_sym_in
 
 	*datum = NULL;
 
+	/* Once aliases are resolved no declarations, scopes or call arguments
+	 * change, short of an optional being disabled, which flushes the memo.
+	 * The memo holds the datum after alias substitution. */
+	if (args->pass >= CIL_PASS_MISC1) {
+		*datum = __cil_resolve_memo_lookup(&args->memo, ast_node->parent, sym_index, name);
+		if (*datum != NULL) {
+			args->last_resolved_name = name;
+			return SEPOL_OK;
+		}
+	}
+
 	if (strchr(name,'.') == NULL) {
 		/* No '.' in name */
 		rc = __cil_resolve_name_helper(db, ast_node->parent, name, sym_index, datum);
@@ -3750,6 +4089,10 @@ exit:
 				*datum = alias->actual;
 			}
 		}
+
+		if (args->pass >= CIL_PASS_MISC1) {
+			__cil_resolve_memo_insert(&args->memo, ast_node->parent, sym_index, name, *datum);
+		}
 	}
 
 	args->last_resolved_name = name;
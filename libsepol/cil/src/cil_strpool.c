@@ -29,76 +29,191 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <pthread.h>
+#include <sepol/policydb/hashtab.h>
 #include "cil_mem.h"
 #include "cil_strpool.h"
 
 #include "cil_log.h"
-#define CIL_STRPOOL_TABLE_SIZE 1 << 15
+
+/*
+ * The pool is split into shards, chosen by the top bits of a string's
+ * hash, each with its own lock and open-addressed table.  Slots are only
+ * ever filled in, and a table that is outgrown is kept until the pool is
+ * destroyed, so a lookup can walk whichever table it sees without taking
+ * the lock; only a miss takes the shard lock to check again and insert.
+ * Entries are never moved or freed before cil_strpool_destroy(), so the
+ * returned strings stay valid.
+ */
+#define CIL_STRPOOL_SHARD_BITS 5
+#define CIL_STRPOOL_SHARDS (1 << CIL_STRPOOL_SHARD_BITS)
+#define CIL_STRPOOL_TABLE_SIZE (1 << 10)
 
 struct cil_strpool_entry {
-	char *str;
+	uint32_t hash;
+	char str[];
+};
+
+struct cil_strpool_table {
+	uint32_t mask;
+	struct cil_strpool_table *retired;
+	struct cil_strpool_entry *slots[];
 };
 
-static hashtab_t cil_strpool_tab = NULL;
+struct cil_strpool_shard {
+	pthread_mutex_t lock;
+	struct cil_strpool_table *table;
+	uint32_t count;
+	unsigned long misses;
+	unsigned int resizes;
+} __attribute__((aligned(64)));
+
+static struct cil_strpool_shard cil_strpool_shards[CIL_STRPOOL_SHARDS];
+
+static struct cil_strpool_table *cil_strpool_table_create(uint32_t size)
+{
+	struct cil_strpool_table *table;
+
+	table = cil_malloc(sizeof(*table) + size * sizeof(table->slots[0]));
+	table->mask = size - 1;
+	table->retired = NULL;
+	memset(table->slots, 0, size * sizeof(table->slots[0]));
+
+	return table;
+}
+
+static struct cil_strpool_entry *cil_strpool_lookup(struct cil_strpool_table *table, uint32_t hash, const char *str)
+{
+	struct cil_strpool_entry *entry;
+	uint32_t i = hash & table->mask;
+
+	for (;;) {
+		entry = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+		if (entry == NULL) {
+			return NULL;
+		}
+		if (entry->hash == hash && strcmp(entry->str, str) == 0) {
+			return entry;
+		}
+		i = (i + 1) & table->mask;
+	}
+}
 
-static unsigned int cil_strpool_hash(hashtab_t h, hashtab_key_t key)
+static void cil_strpool_place(struct cil_strpool_table *table, struct cil_strpool_entry *entry)
 {
-	char *p, *keyp;
-	size_t size;
-	unsigned int val;
-
-	val = 0;
-	keyp = (char*)key;
-	size = strlen(keyp);
-	for (p = keyp; ((size_t) (p - keyp)) < size; p++)
-		val =
-		    (val << 4 | (val >> (8 * sizeof(unsigned int) - 4))) ^ (*p);
-	return val & (h->size - 1);
+	uint32_t i = entry->hash & table->mask;
+
+	while (table->slots[i] != NULL) {
+		i = (i + 1) & table->mask;
+	}
+
+	__atomic_store_n(&table->slots[i], entry, __ATOMIC_RELEASE);
 }
 
-static int cil_strpool_compare(hashtab_t h __attribute__ ((unused)), hashtab_key_t key1, hashtab_key_t key2)
+/* Called with the shard lock held */
+static void cil_strpool_grow(struct cil_strpool_shard *shard)
 {
-	char *keyp1 = (char*)key1;
-	char *keyp2 = (char*)key2;
-	return strcmp(keyp1, keyp2);
+	struct cil_strpool_table *old = shard->table;
+	struct cil_strpool_table *new;
+	uint32_t i;
+
+	new = cil_strpool_table_create((old->mask + 1) * 2);
+	for (i = 0; i <= old->mask; i++) {
+		if (old->slots[i] != NULL) {
+			cil_strpool_place(new, old->slots[i]);
+		}
+	}
+	new->retired = old;
+
+	__atomic_store_n(&shard->table, new, __ATOMIC_RELEASE);
+	shard->resizes++;
 }
 
 char *cil_strpool_add(const char *str)
 {
-	struct cil_strpool_entry *strpool_ref = NULL;
-
-	strpool_ref = hashtab_search(cil_strpool_tab, (hashtab_key_t)str);
-	if (strpool_ref == NULL) {
-		strpool_ref = cil_malloc(sizeof(*strpool_ref));
-		strpool_ref->str = cil_strdup(str);
-		int rc = hashtab_insert(cil_strpool_tab, (hashtab_key_t)strpool_ref->str, strpool_ref);
-		if (rc != SEPOL_OK) {
-			(*cil_mem_error_handler)();
+	uint32_t hash = hashtab_hash_string_full(str);
+	struct cil_strpool_shard *shard = &cil_strpool_shards[hash >> (32 - CIL_STRPOOL_SHARD_BITS)];
+	struct cil_strpool_entry *entry;
+	size_t len;
+
+	entry = cil_strpool_lookup(__atomic_load_n(&shard->table, __ATOMIC_ACQUIRE), hash, str);
+	if (entry != NULL) {
+		return entry->str;
+	}
+
+	pthread_mutex_lock(&shard->lock);
+	shard->misses++;
+	entry = cil_strpool_lookup(shard->table, hash, str);
+	if (entry == NULL) {
+		if ((shard->count + 1) * 2 > shard->table->mask + 1) {
+			cil_strpool_grow(shard);
 		}
+		len = strlen(str);
+		entry = cil_malloc(sizeof(*entry) + len + 1);
+		entry->hash = hash;
+		memcpy(entry->str, str, len + 1);
+		cil_strpool_place(shard->table, entry);
+		shard->count++;
 	}
+	pthread_mutex_unlock(&shard->lock);
 
-	return strpool_ref->str;
+	return entry->str;
 }
 
-static int cil_strpool_entry_destroy(hashtab_key_t k __attribute__ ((unused)), hashtab_datum_t d, void *args __attribute__ ((unused)))
+void cil_strpool_stats(void)
 {
-	struct cil_strpool_entry *strpool_ref = (struct cil_strpool_entry*)d;
-	free(strpool_ref->str);
-	free(strpool_ref);
-	return SEPOL_OK;
+	struct cil_strpool_shard *shard;
+	unsigned long count = 0, misses = 0, resizes = 0;
+	int i;
+
+	for (i = 0; i < CIL_STRPOOL_SHARDS; i++) {
+		shard = &cil_strpool_shards[i];
+		pthread_mutex_lock(&shard->lock);
+		count += shard->count;
+		misses += shard->misses;
+		resizes += shard->resizes;
+		pthread_mutex_unlock(&shard->lock);
+	}
+
+	cil_log(CIL_INFO, "strpool: %lu strings, %lu locked lookups, %lu resizes\n", count, misses, resizes);
 }
 
 void cil_strpool_init(void)
 {
-	cil_strpool_tab = hashtab_create(cil_strpool_hash, cil_strpool_compare, CIL_STRPOOL_TABLE_SIZE);
-	if (cil_strpool_tab == NULL) {
-		(*cil_mem_error_handler)();
+	struct cil_strpool_shard *shard;
+	int i;
+
+	for (i = 0; i < CIL_STRPOOL_SHARDS; i++) {
+		shard = &cil_strpool_shards[i];
+		pthread_mutex_init(&shard->lock, NULL);
+		shard->table = cil_strpool_table_create(CIL_STRPOOL_TABLE_SIZE);
+		shard->count = 0;
+		shard->misses = 0;
+		shard->resizes = 0;
 	}
 }
 
 void cil_strpool_destroy(void)
 {
-	hashtab_map(cil_strpool_tab, cil_strpool_entry_destroy, NULL);
-	hashtab_destroy(cil_strpool_tab);
+	struct cil_strpool_shard *shard;
+	struct cil_strpool_table *table, *retired;
+	uint32_t j;
+	int i;
+
+	for (i = 0; i < CIL_STRPOOL_SHARDS; i++) {
+		shard = &cil_strpool_shards[i];
+		table = shard->table;
+		for (j = 0; j <= table->mask; j++) {
+			free(table->slots[j]);
+		}
+		while (table != NULL) {
+			retired = table->retired;
+			free(table);
+			table = retired;
+		}
+		shard->table = NULL;
+		pthread_mutex_destroy(&shard->lock);
+	}
 }
@@ -30,9 +30,8 @@
 #ifndef CIL_STRPOOL_H_
 #define CIL_STRPOOL_H_
 
-#include <sepol/policydb/hashtab.h>
-
 char *cil_strpool_add(const char *str);
+void cil_strpool_stats(void);
 void cil_strpool_init(void);
 void cil_strpool_destroy(void);
 #endif /* CIL_STRPOOL_H_ */
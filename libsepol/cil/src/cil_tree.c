@@ -119,9 +119,8 @@ void cil_tree_children_destroy(struct cil_tree_node *node)
 	}
 }
 
-void cil_tree_node_init(struct cil_tree_node **node)
+static void cil_tree_node_setup(struct cil_tree_node *new_node)
 {
-	struct cil_tree_node *new_node = cil_malloc(sizeof(*new_node));
 	new_node->cl_head = NULL;
 	new_node->cl_tail = NULL;
 	new_node->parent = NULL;
@@ -130,6 +129,35 @@ void cil_tree_node_init(struct cil_tree_node **node)
 	new_node->flavor = CIL_ROOT;
 	new_node->line = 0;	
 	new_node->path = NULL;
+	new_node->pooled = 0;
+}
+
+void cil_tree_node_init(struct cil_tree_node **node)
+{
+	struct cil_tree_node *new_node = cil_malloc(sizeof(*new_node));
+
+	cil_tree_node_setup(new_node);
+
+	*node = new_node;
+}
+
+/* AST nodes come from the node pool of their db, which is released with
+ * the db.  Parse tree nodes, which are freed bit by bit while the AST is
+ * built and far outnumber it, are left to malloc so their memory can be
+ * reused for anything.  The pooled bit records which of the two a node
+ * came from. */
+void cil_tree_node_init_db(struct cil_db *db, struct cil_tree_node **node)
+{
+	struct cil_tree_node *new_node;
+
+	if (db == NULL) {
+		cil_tree_node_init(node);
+		return;
+	}
+
+	new_node = cil_pool_alloc(&db->node_pool);
+	cil_tree_node_setup(new_node);
+	new_node->pooled = 1;
 
 	*node = new_node;
 }
@@ -151,10 +179,20 @@ void cil_tree_node_destroy(struct cil_tree_node **node)
 	} else {
 		cil_destroy_data(&(*node)->data, (*node)->flavor);
 	}
-	free(*node);
+	cil_tree_node_free(*node);
 	*node = NULL;
 }
 
+/* Free a node without touching its data */
+void cil_tree_node_free(struct cil_tree_node *node)
+{
+	if (node != NULL && node->pooled) {
+		cil_pool_free(cil_pool_of(node), node);
+	} else {
+		free(node);
+	}
+}
+
 /* Perform depth-first walk of the tree
    Parameters:
    start_node:          root node to start walking from
@@ -35,6 +35,8 @@
 #include "cil_flavor.h"
 #include "cil_list.h"
 
+struct cil_db;
+
 struct cil_tree {
 	struct cil_tree_node *root;
 };
@@ -45,7 +47,8 @@ struct cil_tree_node {
 	struct cil_tree_node *cl_tail;		//Tail of child_list
 	struct cil_tree_node *next;		//Each element in the list points to the next element
 	enum cil_flavor flavor;
-	uint32_t line;
+	uint32_t line : 31;
+	uint32_t pooled : 1;			//Allocated from its db's node pool
 	char *path;
 	void *data;
 };
@@ -56,7 +59,9 @@ void cil_tree_subtree_destroy(struct cil_tree_node *node);
 void cil_tree_children_destroy(struct cil_tree_node *node);
 
 void cil_tree_node_init(struct cil_tree_node **node);
+void cil_tree_node_init_db(struct cil_db *db, struct cil_tree_node **node);
 void cil_tree_node_destroy(struct cil_tree_node **node);
+void cil_tree_node_free(struct cil_tree_node *node);
 
 void cil_tree_print(struct cil_tree_node *tree, uint32_t depth);
 
@@ -44,6 +44,7 @@
 #include "test_cil_list.h"
 #include "test_cil_symtab.h"
 #include "test_cil_parser.h"
+#include "test_cil_parse_cache.h"
 #include "test_cil_lexer.h"
 #include "test_cil_build_ast.h"
 #include "test_cil_resolve_ast.h"
@@ -1783,6 +1784,13 @@ CuSuite* CilTreeGetSuite(void) {
 	SUITE_ADD_TEST(suite, test_cil_parser);
 
 
+	/* test_cil_parse_cache.c */
+	SUITE_ADD_TEST(suite, test_cil_parse_cache_hit);
+	SUITE_ADD_TEST(suite, test_cil_parse_cache_stale_source);
+	SUITE_ADD_TEST(suite, test_cil_parse_cache_corrupt);
+	SUITE_ADD_TEST(suite, test_cil_parse_cache_prune);
+
+
 	/* test_cil_fqn.c */
 	SUITE_ADD_TEST(suite, test_cil_qualify_name);
 	SUITE_ADD_TEST(suite, test_cil_qualify_name_cil_flavor);
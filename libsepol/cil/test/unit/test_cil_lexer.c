@@ -42,9 +42,12 @@ void test_cil_lexer_setup(CuTest *tc) {
    memset(buffer+str_size, 0, 2);
    strncpy(buffer, test_str, str_size);
 
-   int rc = cil_lexer_setup(buffer, str_size + 2);
+   cil_lexer_t lexer;
+   int rc = cil_lexer_setup(&lexer, buffer, str_size + 2);
    CuAssertIntEquals(tc, SEPOL_OK, rc);
 
+   cil_lexer_destroy(lexer);
+
    free(buffer);
 }
 
@@ -56,45 +59,47 @@ void test_cil_lexer_next(CuTest *tc) {
    memset(buffer+str_size, 0, 2);
    strcpy(buffer, test_str);
 
-   cil_lexer_setup(buffer, str_size + 2);
+   cil_lexer_t lexer;
+   cil_lexer_setup(&lexer, buffer, str_size + 2);
 
    struct token test_tok;
 
-   int rc = cil_lexer_next(&test_tok);
+   int rc = cil_lexer_next(lexer, &test_tok);
    CuAssertIntEquals(tc, SEPOL_OK, rc);
 
    CuAssertIntEquals(tc, OPAREN, test_tok.type);
    CuAssertStrEquals(tc, "(", test_tok.value);
    CuAssertIntEquals(tc, 1, test_tok.line);
 
-   rc = cil_lexer_next(&test_tok);
+   rc = cil_lexer_next(lexer, &test_tok);
    CuAssertIntEquals(tc, SEPOL_OK, rc);
    
    CuAssertIntEquals(tc, SYMBOL, test_tok.type);
    CuAssertStrEquals(tc, "test", test_tok.value);
    CuAssertIntEquals(tc, 1, test_tok.line);
  
-   rc = cil_lexer_next(&test_tok);
+   rc = cil_lexer_next(lexer, &test_tok);
    CuAssertIntEquals(tc, SEPOL_OK, rc);
    
    CuAssertIntEquals(tc, QSTRING, test_tok.type);
    CuAssertStrEquals(tc, "\"qstring\"", test_tok.value);
    CuAssertIntEquals(tc, 1, test_tok.line);
  
-   rc = cil_lexer_next(&test_tok);
+   rc = cil_lexer_next(lexer, &test_tok);
    CuAssertIntEquals(tc, SEPOL_OK, rc);
    
    CuAssertIntEquals(tc, CPAREN, test_tok.type);
    CuAssertStrEquals(tc, ")", test_tok.value);
    CuAssertIntEquals(tc, 1, test_tok.line);
 
-   rc = cil_lexer_next(&test_tok);
+   rc = cil_lexer_next(lexer, &test_tok);
    CuAssertIntEquals(tc, SEPOL_OK, rc);
   
    CuAssertIntEquals(tc, COMMENT, test_tok.type);
    CuAssertStrEquals(tc, ";comment", test_tok.value);
    CuAssertIntEquals(tc, 1, test_tok.line);
 
+   cil_lexer_destroy(lexer);
    free(buffer);
 }
 
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2011 Tresys Technology, LLC. All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *    1. Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ * 
+ *    2. Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY TRESYS TECHNOLOGY, LLC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL TRESYS TECHNOLOGY, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ * The views and conclusions contained in the software and documentation are those
+ * of the authors and should not be interpreted as representing official policies,
+ * either expressed or implied, of Tresys Technology, LLC.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <sepol/policydb/policydb.h>
+
+#include "CuTest.h"
+#include "CilTest.h"
+#include "test_cil_parse_cache.h"
+
+#include "../../src/cil_internal.h"
+#include "../../src/cil_parser.h"
+#include "../../src/cil_parse_cache.h"
+#include "../../src/cil_tree.h"
+
+static char source_a[] = "(type t1)\n(allow t1 self (file (read write)))\n";
+static char source_b[] = "(type t2)\n(allow t2 self (file (read)))\n";
+
+static char *make_cache_dir(void)
+{
+	char *dir = strdup("/tmp/cil_parse_cache.XXXXXX");
+
+	if (mkdtemp(dir) == NULL) {
+		free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+static void remove_cache_dir(char *dir)
+{
+	DIR *d = opendir(dir);
+	struct dirent *entry;
+
+	while (d != NULL && (entry = readdir(d)) != NULL) {
+		if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+			unlinkat(dirfd(d), entry->d_name, 0);
+		}
+	}
+	if (d != NULL) {
+		closedir(d);
+	}
+	rmdir(dir);
+	free(dir);
+}
+
+static int cache_file_exists(const char *dir, const char *name)
+{
+	char path[PATH_MAX];
+	struct stat sb;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	return stat(path, &sb) == 0;
+}
+
+static int parse_source(const char *source, struct cil_tree **tree)
+{
+	size_t size = strlen(source);
+	char *buffer = malloc(size + 2);
+	int rc;
+
+	memcpy(buffer, source, size);
+	memset(buffer + size, 0, 2);
+	rc = cil_parser("test.cil", buffer, size + 2, tree);
+	free(buffer);
+
+	return rc;
+}
+
+static int trees_equal(struct cil_tree_node *a, struct cil_tree_node *b)
+{
+	for (; a != NULL && b != NULL; a = a->next, b = b->next) {
+		if (a->flavor != b->flavor || a->line != b->line || a->data != b->data) {
+			return CIL_FALSE;
+		}
+		if (!trees_equal(a->cl_head, b->cl_head)) {
+			return CIL_FALSE;
+		}
+	}
+
+	return a == NULL && b == NULL;
+}
+
+void test_cil_parse_cache_hit(CuTest *tc) {
+	struct cil_db *db;
+	struct cil_tree *parsed;
+	struct cil_tree *loaded;
+	char name[CIL_PARSE_CACHE_NAME_LEN + 1];
+	char *dir = make_cache_dir();
+	size_t size = strlen(source_a);
+	int rc;
+
+	CuAssertPtrNotNull(tc, dir);
+	cil_db_init(&db);
+	cil_tree_init(&parsed);
+	cil_tree_init(&loaded);
+
+	rc = parse_source(source_a, &parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	cil_parse_cache_name(source_a, size, name);
+	rc = cil_parse_cache_store(dir, name, source_a, size, parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	rc = cil_parse_cache_load(dir, name, "test.cil", source_a, size, loaded);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+	CuAssertPtrNotNull(tc, loaded->root->cl_head);
+	CuAssertIntEquals(tc, CIL_TRUE, trees_equal(parsed->root->cl_head, loaded->root->cl_head));
+
+	cil_tree_destroy(&parsed);
+	cil_tree_destroy(&loaded);
+	cil_db_destroy(&db);
+	remove_cache_dir(dir);
+}
+
+void test_cil_parse_cache_stale_source(CuTest *tc) {
+	struct cil_db *db;
+	struct cil_tree *parsed;
+	struct cil_tree *loaded;
+	char name[CIL_PARSE_CACHE_NAME_LEN + 1];
+	char *dir = make_cache_dir();
+	int rc;
+
+	CuAssertPtrNotNull(tc, dir);
+	cil_db_init(&db);
+	cil_tree_init(&parsed);
+	cil_tree_init(&loaded);
+
+	rc = parse_source(source_a, &parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	/* The file is looked up by name, but only used if it was made from
+	 * the same source */
+	cil_parse_cache_name(source_a, strlen(source_a), name);
+	rc = cil_parse_cache_store(dir, name, source_a, strlen(source_a), parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	rc = cil_parse_cache_load(dir, name, "test.cil", source_b, strlen(source_b), loaded);
+	CuAssertIntEquals(tc, SEPOL_ENOENT, rc);
+	CuAssertPtrEquals(tc, NULL, loaded->root->cl_head);
+
+	cil_tree_destroy(&parsed);
+	cil_tree_destroy(&loaded);
+	cil_db_destroy(&db);
+	remove_cache_dir(dir);
+}
+
+void test_cil_parse_cache_corrupt(CuTest *tc) {
+	struct cil_db *db;
+	struct cil_tree *parsed;
+	struct cil_tree *loaded;
+	char name[CIL_PARSE_CACHE_NAME_LEN + 1];
+	char path[PATH_MAX];
+	char *dir = make_cache_dir();
+	size_t size = strlen(source_a);
+	struct stat sb;
+	int rc;
+
+	CuAssertPtrNotNull(tc, dir);
+	cil_db_init(&db);
+	cil_tree_init(&parsed);
+	cil_tree_init(&loaded);
+
+	rc = parse_source(source_a, &parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	cil_parse_cache_name(source_a, size, name);
+	rc = cil_parse_cache_store(dir, name, source_a, size, parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	/* Cut the last node record in half */
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	CuAssertIntEquals(tc, 0, stat(path, &sb));
+	CuAssertIntEquals(tc, 0, truncate(path, sb.st_size - 4));
+
+	rc = cil_parse_cache_load(dir, name, "test.cil", source_a, size, loaded);
+	CuAssertIntEquals(tc, SEPOL_ERR, rc);
+	CuAssertPtrEquals(tc, NULL, loaded->root->cl_head);
+
+	cil_tree_destroy(&parsed);
+	cil_tree_destroy(&loaded);
+	cil_db_destroy(&db);
+	remove_cache_dir(dir);
+}
+
+void test_cil_parse_cache_prune(CuTest *tc) {
+	struct cil_db *db;
+	struct cil_tree *parsed;
+	char name_a[CIL_PARSE_CACHE_NAME_LEN + 1];
+	char name_b[CIL_PARSE_CACHE_NAME_LEN + 1];
+	char other[PATH_MAX];
+	char *dir = make_cache_dir();
+	FILE *fp;
+	int rc;
+
+	CuAssertPtrNotNull(tc, dir);
+	cil_db_init(&db);
+	cil_tree_init(&parsed);
+
+	/* A cache file left behind by a source that is no longer added */
+	rc = parse_source(source_b, &parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+	cil_parse_cache_name(source_b, strlen(source_b), name_b);
+	rc = cil_parse_cache_store(dir, name_b, source_b, strlen(source_b), parsed);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+
+	snprintf(other, sizeof(other), "%s/other", dir);
+	fp = fopen(other, "w");
+	CuAssertPtrNotNull(tc, fp);
+	fclose(fp);
+
+	cil_set_parse_cache_dir(db, dir);
+	rc = cil_add_file(db, "test.cil", source_a, strlen(source_a));
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+	cil_parse_cache_name(source_a, strlen(source_a), name_a);
+	CuAssertIntEquals(tc, CIL_TRUE, cache_file_exists(dir, name_a));
+
+	rc = cil_prune_parse_cache(db);
+	CuAssertIntEquals(tc, SEPOL_OK, rc);
+	CuAssertIntEquals(tc, CIL_TRUE, cache_file_exists(dir, name_a));
+	CuAssertIntEquals(tc, CIL_FALSE, cache_file_exists(dir, name_b));
+	CuAssertIntEquals(tc, CIL_TRUE, cache_file_exists(dir, "other"));
+
+	cil_tree_destroy(&parsed);
+	cil_db_destroy(&db);
+	remove_cache_dir(dir);
+}
@@ -48,7 +48,7 @@ void test_cil_tree_node_init(CuTest *tc) {
    CuAssertIntEquals(tc, 0, test_node->flavor);
    CuAssertIntEquals(tc, 0, test_node->line);
 
-   free(test_node);
+   cil_tree_node_free(test_node);
 }
 
 void test_cil_tree_init(CuTest *tc) {
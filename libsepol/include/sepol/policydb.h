@@ -144,5 +144,15 @@ extern int sepol_policydb_mls_enabled(const sepol_policydb_t * p);
  */
 extern int sepol_policydb_compat_net(const sepol_policydb_t * p);
 
+/*
+ * Compare two kernel policies by name rather than by symbol value and
+ * write one "<+|->\t<kind>\t<item>" line per difference to fp, sorted
+ * by kind and then by item.  Returns the number of differences, or -1
+ * on error, including when either policy is not a kernel policy.
+ */
+extern int sepol_policydb_diff(sepol_handle_t * handle,
+			       const sepol_policydb_t * oldp,
+			       const sepol_policydb_t * newp, FILE * fp);
+
 __END_DECLS
 #endif
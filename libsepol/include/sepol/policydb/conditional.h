@@ -111,6 +111,7 @@ extern cond_node_t *cond_node_search(policydb_t * p, cond_node_t * list,
 				     cond_node_t * cn);
 
 extern int evaluate_conds(policydb_t * p);
+extern int evaluate_conds_bool(policydb_t * p, uint32_t bool_val);
 
 extern avtab_datum_t *cond_av_list_search(avtab_key_t * key,
 					  cond_av_list_t * cond_list);
@@ -44,6 +44,9 @@ typedef hashtab_val_t *hashtab_t;
 
 /*
    Creates a new hash table with the specified characteristics.
+   `size' is the initial number of slots; the table doubles in size
+   as entries are inserted, so hash_value must derive the slot from
+   the current h->size.
 
    Returns NULL if insufficent space is available or
    the new hash table otherwise.
@@ -134,7 +137,23 @@ extern void hashtab_map_remove_on_error(hashtab_t h,
 							 void *args),
 					void *args);
 
+/*
+   Prints the number of entries, the slots used, the longest chain
+   and the average number of entries examined by a successful search.
+ */
 extern void hashtab_hash_eval(hashtab_t h, char *tag);
 
+/*
+   A hash_value function for NUL-terminated string keys, for tables
+   whose size is a power of two.
+ */
+extern unsigned int hashtab_hash_string(hashtab_t h, const hashtab_key_t key);
+
+/*
+   The full 32-bit value that hashtab_hash_string() reduces to a slot,
+   for callers that keep their own tables.
+ */
+extern unsigned int hashtab_hash_string_full(const char *key);
+
 __END_DECLS
 #endif
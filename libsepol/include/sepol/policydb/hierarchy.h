@@ -41,6 +41,15 @@ extern int bounds_check_users(sepol_handle_t *handle, policydb_t *p);
 extern int bounds_check_roles(sepol_handle_t *handle, policydb_t *p);
 extern int bounds_check_types(sepol_handle_t *handle, policydb_t *p);
 
+/* Check every bounded type, expanding the rules of each parent only once
+ * for all of its children. apply is called with the offending rules of
+ * each child that exceeds its bounds; the list is freed when it returns.
+ */
+extern int bounds_check_types_map(sepol_handle_t *handle, policydb_t *p,
+				  int (*apply) (uint32_t child, uint32_t parent,
+						avtab_ptr_t bad, void *args),
+				  void *args, int *numbad);
+
 extern int hierarchy_check_constraints(sepol_handle_t * handle, policydb_t * p);
 
 __END_DECLS
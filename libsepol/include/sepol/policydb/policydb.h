@@ -680,6 +680,26 @@ extern void policy_file_init(policy_file_t * x);
 
 extern int policydb_read(policydb_t * p, struct policy_file *fp,
 			 unsigned int verbose);
+
+/* Sections of a kernel policy image, in the order they are stored. */
+#define POLICYDB_SECTION_SYMTABS	0x0001	/* always loaded */
+#define POLICYDB_SECTION_AVTAB		0x0002
+#define POLICYDB_SECTION_CONDS		0x0004
+#define POLICYDB_SECTION_ROLE_TRANS	0x0008	/* role_transition and role allow */
+#define POLICYDB_SECTION_FILENAME_TRANS	0x0010
+#define POLICYDB_SECTION_OCONTEXTS	0x0020
+#define POLICYDB_SECTION_GENFS		0x0040
+#define POLICYDB_SECTION_RANGE_TRANS	0x0080
+#define POLICYDB_SECTION_TYPE_ATTR_MAP	0x0100
+#define POLICYDB_SECTION_ALL		0x01ff
+
+/* Read only the requested sections of a kernel policy.  Reading stops
+ * after the last requested section.  Sections stored before a requested
+ * one still have to be parsed; the avtab and conditional rules are freed
+ * again if they were not requested, other sections are kept.  Module
+ * policies are always read in full. */
+extern int policydb_read_sections(policydb_t * p, struct policy_file *fp,
+				  unsigned int verbose, unsigned int sections);
 extern int avrule_read_list(policydb_t * p, avrule_t ** avrules,
 			    struct policy_file *fp);
 
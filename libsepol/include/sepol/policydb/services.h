@@ -15,10 +15,73 @@
 #include <sepol/policydb/flask_types.h>
 #include <sepol/policydb/policydb.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <sys/cdefs.h>
 
 __BEGIN_DECLS
 
+/*
+ * A security server instance.  Each instance owns its policydb,
+ * sidtab and evaluation state, so different instances may be used
+ * from different threads at the same time.  A single instance must
+ * not be used by more than one thread at a time.  The service
+ * functions below that take no instance use a default one private
+ * to libsepol.
+ */
+typedef struct sepol_secserver sepol_secserver_t;
+
+/* Create a security server for the binary policy read from `fp'. */
+extern int sepol_secserver_create(sepol_secserver_t ** srv, FILE * fp);
+
+extern void sepol_secserver_destroy(sepol_secserver_t * srv);
+
+/* Instance versions of the service functions of the same names. */
+extern int sepol_secserver_compute_av(sepol_secserver_t * srv,
+				      sepol_security_id_t ssid,
+				      sepol_security_id_t tsid,
+				      sepol_security_class_t tclass,
+				      sepol_access_vector_t requested,
+				      struct sepol_av_decision *avd);
+
+extern int sepol_secserver_compute_av_reason(sepol_secserver_t * srv,
+					     sepol_security_id_t ssid,
+					     sepol_security_id_t tsid,
+					     sepol_security_class_t tclass,
+					     sepol_access_vector_t requested,
+					     struct sepol_av_decision *avd,
+					     unsigned int *reason);
+
+extern int sepol_secserver_transition_sid(sepol_secserver_t * srv,
+					  sepol_security_id_t ssid,
+					  sepol_security_id_t tsid,
+					  sepol_security_class_t tclass,
+					  sepol_security_id_t * out_sid);
+
+extern int sepol_secserver_sid_to_context(sepol_secserver_t * srv,
+					  sepol_security_id_t sid,
+					  sepol_security_context_t * scontext,
+					  size_t * scontext_len);
+
+extern int sepol_secserver_context_to_sid(sepol_secserver_t * srv,
+					  const sepol_security_context_t
+					  scontext, size_t scontext_len,
+					  sepol_security_id_t * out_sid);
+
+/*
+ * Precompute the access vectors of every (source type, target type,
+ * class) triple, so that later access computations take a single
+ * lookup instead of walking the attributes of both types.  Boolean
+ * changes are still honoured; the table is discarded when the policy
+ * is replaced.  This trades memory for speed and is only worthwhile
+ * for callers issuing many queries: on a policy with 21000 types the
+ * table takes about a second to build, as long as some 180000 walked
+ * queries.  A tool such as audit2why, which recomputes each denial
+ * once per boolean, should therefore call it only when it is about to
+ * analyse a large audit log, not at every startup.
+ */
+extern int sepol_secserver_precompute_av(sepol_secserver_t * srv);
+extern int sepol_precompute_av(void);
+
 /* Set the policydb and sidtab structures to be used by
    the service functions.  If not set, then these default
    to private structures within libsepol that can only be
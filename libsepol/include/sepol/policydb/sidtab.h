@@ -19,6 +19,7 @@ typedef struct sidtab_node {
 	sepol_security_id_t sid;	/* security identifier */
 	context_struct_t context;	/* security context structure */
 	struct sidtab_node *next;
+	struct sidtab_node *context_next;	/* next in context index */
 } sidtab_node_t;
 
 typedef struct sidtab_node *sidtab_ptr_t;
@@ -29,8 +30,13 @@ typedef struct sidtab_node *sidtab_ptr_t;
 
 #define SIDTAB_SIZE SIDTAB_HASH_BUCKETS
 
+/* initial size of the context index, grown as entries are added */
+#define SIDTAB_CONTEXT_SIZE SIDTAB_HASH_BUCKETS
+
 typedef struct {
 	sidtab_ptr_t *htable;
+	sidtab_ptr_t *ctable;	/* nodes indexed by context contents */
+	unsigned int ctable_size;	/* power of two */
 	unsigned int nel;	/* number of elements */
 	unsigned int next_sid;	/* next SID to allocate */
 	unsigned char shutdown;
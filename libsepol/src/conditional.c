@@ -202,17 +202,19 @@ cond_node_t *cond_node_search(policydb_t * p, cond_node_t * list,
 }
 
 /*
- * cond_evaluate_expr evaluates a conditional expr
- * in reverse polish notation. It returns true (1), false (0),
- * or undefined (-1). Undefined occurs when the expression
- * exceeds the stack depth of COND_EXPR_MAXDEPTH.
+ * Evaluate an expression.  If bool_ids is NULL the current state of
+ * each bool in the policy is used, otherwise the value of a bool is
+ * taken from the bit in test matching its position in bool_ids.
  */
-int cond_evaluate_expr(policydb_t * p, cond_expr_t * expr)
+static int cond_evaluate_expr_bools(policydb_t * p, cond_expr_t * expr,
+				    uint32_t * bool_ids, unsigned int nbools,
+				    uint32_t test)
 {
 
 	cond_expr_t *cur;
 	int s[COND_EXPR_MAXDEPTH];
 	int sp = -1;
+	unsigned int i;
 
 	s[0] = -1;
 
@@ -222,7 +224,17 @@ int cond_evaluate_expr(policydb_t * p, cond_expr_t * expr)
 			if (sp == (COND_EXPR_MAXDEPTH - 1))
 				return -1;
 			sp++;
-			s[sp] = p->bool_val_to_struct[cur->bool - 1]->state;
+			if (!bool_ids) {
+				s[sp] =
+				    p->bool_val_to_struct[cur->bool - 1]->state;
+				break;
+			}
+			for (i = 0; i < nbools; i++)
+				if (bool_ids[i] == cur->bool)
+					break;
+			if (i == nbools)
+				return -1;
+			s[sp] = (test & (0x1U << i)) ? 1 : 0;
 			break;
 		case COND_NOT:
 			if (sp < 0)
@@ -266,6 +278,17 @@ int cond_evaluate_expr(policydb_t * p, cond_expr_t * expr)
 	return s[0];
 }
 
+/*
+ * cond_evaluate_expr evaluates a conditional expr
+ * in reverse polish notation. It returns true (1), false (0),
+ * or undefined (-1). Undefined occurs when the expression
+ * exceeds the stack depth of COND_EXPR_MAXDEPTH.
+ */
+int cond_evaluate_expr(policydb_t * p, cond_expr_t * expr)
+{
+	return cond_evaluate_expr_bools(p, expr, NULL, 0, 0);
+}
+
 cond_expr_t *cond_copy_expr(cond_expr_t * expr)
 {
 	cond_expr_t *cur, *head, *tail, *new_expr;
@@ -308,9 +331,20 @@ cond_expr_t *cond_copy_expr(cond_expr_t * expr)
 static int evaluate_cond_node(policydb_t * p, cond_node_t * node)
 {
 	int new_state;
+	unsigned int i;
+	uint32_t test = 0x0;
 	cond_av_list_t *cur;
 
-	new_state = cond_evaluate_expr(p, node->expr);
+	if (node->nbools > 0 && node->nbools <= COND_MAX_BOOLS) {
+		/* look the result up in the precomputed truth table */
+		for (i = 0; i < node->nbools; i++) {
+			if (p->bool_val_to_struct[node->bool_ids[i] - 1]->state)
+				test |= 0x1U << i;
+		}
+		new_state = (node->expr_pre_comp & (0x1U << test)) ? 1 : 0;
+	} else {
+		new_state = cond_evaluate_expr(p, node->expr);
+	}
 	if (new_state != node->cur_state) {
 		node->cur_state = new_state;
 		if (new_state == -1)
@@ -337,24 +371,64 @@ static int evaluate_cond_node(policydb_t * p, cond_node_t * node)
 	return 0;
 }
 
-/* precompute and simplify an expression if possible.  If left with !expression, change 
- * to expression and switch t and f. precompute expression for expressions with limited
- * number of bools.
+/* find the bools used by an expression and, for expressions with
+ * no more than COND_MAX_BOOLS of them, precompute its truth table.
  */
-int cond_normalize_expr(policydb_t * p, cond_node_t * cn)
+static int cond_precompute_expr(policydb_t * p, cond_node_t * cn)
 {
-	cond_expr_t *ne, *e;
-	cond_av_list_t *tmp;
-	unsigned int i, j, orig_value[COND_MAX_BOOLS];
+	cond_expr_t *e;
 	int k;
 	uint32_t test = 0x0;
-	avrule_t *tmp2;
 
 	cn->nbools = 0;
 
 	memset(cn->bool_ids, 0, sizeof(cn->bool_ids));
 	cn->expr_pre_comp = 0x0;
 
+	/* find all the bools in the expression */
+	for (e = cn->expr; e != NULL; e = e->next) {
+		switch (e->expr_type) {
+		case COND_BOOL:
+			/* see if we've already seen this bool */
+			if (!bool_present(e->bool, cn->bool_ids, cn->nbools)) {
+				/* count em all but only record up to COND_MAX_BOOLS */
+				if (cn->nbools < COND_MAX_BOOLS)
+					cn->bool_ids[cn->nbools++] = e->bool;
+				else
+					cn->nbools++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* only precompute for exprs with <= COND_MAX_BOOLS */
+	if (cn->nbools <= COND_MAX_BOOLS) {
+		/* loop through all possible combinations of values for bools in expression */
+		for (test = 0x0; test < (0x1U << cn->nbools); test++) {
+			k = cond_evaluate_expr_bools(p, cn->expr, cn->bool_ids,
+						     cn->nbools, test);
+			if (k == -1)
+				return -1;
+			/* set the bit if expression evaluates true */
+			if (k)
+				cn->expr_pre_comp |= 0x1U << test;
+		}
+	}
+	return 0;
+}
+
+/* precompute and simplify an expression if possible.  If left with !expression, change 
+ * to expression and switch t and f. precompute expression for expressions with limited
+ * number of bools.
+ */
+int cond_normalize_expr(policydb_t * p, cond_node_t * cn)
+{
+	cond_expr_t *ne, *e;
+	cond_av_list_t *tmp;
+	avrule_t *tmp2;
+
 	/* take care of !expr case */
 	ne = NULL;
 	e = cn->expr;
@@ -384,68 +458,55 @@ int cond_normalize_expr(policydb_t * p, cond_node_t * cn)
 		free(e);
 	}
 
-	/* find all the bools in the expression */
-	for (e = cn->expr; e != NULL; e = e->next) {
-		switch (e->expr_type) {
-		case COND_BOOL:
-			i = 0;
-			/* see if we've already seen this bool */
-			if (!bool_present(e->bool, cn->bool_ids, cn->nbools)) {
-				/* count em all but only record up to COND_MAX_BOOLS */
-				if (cn->nbools < COND_MAX_BOOLS)
-					cn->bool_ids[cn->nbools++] = e->bool;
-				else
-					cn->nbools++;
-			}
-			break;
-		default:
-			break;
-		}
+	if (cond_precompute_expr(p, cn) < 0) {
+		printf
+		    ("While testing expression, expression result "
+		     "was undefined - this should never happen.\n");
+		return -1;
 	}
+	return 0;
+}
 
-	/* only precompute for exprs with <= COND_AX_BOOLS */
-	if (cn->nbools <= COND_MAX_BOOLS) {
-		/* save the default values for the bools so we can play with them */
-		for (i = 0; i < cn->nbools; i++) {
-			orig_value[i] =
-			    p->bool_val_to_struct[cn->bool_ids[i] - 1]->state;
-		}
+int evaluate_conds(policydb_t * p)
+{
+	int ret;
+	cond_node_t *cur;
 
-		/* loop through all possible combinations of values for bools in expression */
-		for (test = 0x0; test < (0x1U << cn->nbools); test++) {
-			/* temporarily set the value for all the bools in the
-			 * expression using the corr.  bit in test */
-			for (j = 0; j < cn->nbools; j++) {
-				p->bool_val_to_struct[cn->bool_ids[j] -
-						      1]->state =
-				    (test & (0x1 << j)) ? 1 : 0;
-			}
-			k = cond_evaluate_expr(p, cn->expr);
-			if (k == -1) {
-				printf
-				    ("While testing expression, expression result "
-				     "was undefined - this should never happen.\n");
-				return -1;
-			}
-			/* set the bit if expression evaluates true */
-			if (k)
-				cn->expr_pre_comp |= 0x1 << test;
-		}
+	for (cur = p->cond_list; cur != NULL; cur = cur->next) {
+		ret = evaluate_cond_node(p, cur);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* does the expression of a node depend on the given bool? */
+static int cond_node_uses_bool(cond_node_t * node, uint32_t bool_val)
+{
+	cond_expr_t *e;
+
+	if (node->nbools > 0 && node->nbools <= COND_MAX_BOOLS)
+		return bool_present(bool_val, node->bool_ids, node->nbools);
 
-		/* restore bool default values */
-		for (i = 0; i < cn->nbools; i++)
-			p->bool_val_to_struct[cn->bool_ids[i] - 1]->state =
-			    orig_value[i];
+	for (e = node->expr; e != NULL; e = e->next) {
+		if (e->expr_type == COND_BOOL && e->bool == bool_val)
+			return 1;
 	}
 	return 0;
 }
 
-int evaluate_conds(policydb_t * p)
+/*
+ * Re-evaluate only the conditionals that depend on a single bool,
+ * e.g. after that one bool has changed value.
+ */
+int evaluate_conds_bool(policydb_t * p, uint32_t bool_val)
 {
 	int ret;
 	cond_node_t *cur;
 
 	for (cur = p->cond_list; cur != NULL; cur = cur->next) {
+		if (!cond_node_uses_bool(cur, bool_val))
+			continue;
 		ret = evaluate_cond_node(p, cur);
 		if (ret)
 			return ret;
@@ -807,6 +868,10 @@ static int cond_read_node(policydb_t * p, cond_node_t * node, void *fp)
 		last = expr;
 	}
 
+	/* a malformed expression is left to evaluate as undefined */
+	if (cond_precompute_expr(p, node) != 0)
+		node->nbools = 0;
+
 	if (p->policy_type == POLICY_KERN) {
 		if (cond_read_av_list(p, fp, &node->true_list, NULL) != 0)
 			goto err;
@@ -127,10 +127,11 @@ int ebitmap_andnot(ebitmap_t *dst, ebitmap_t *e1, ebitmap_t *e2, unsigned int ma
 
 unsigned int ebitmap_cardinality(ebitmap_t *e1)
 {
-	unsigned int i, count = 0;
-	for (i=ebitmap_startbit(e1); i < ebitmap_length(e1); i++)
-		if (ebitmap_get_bit(e1, i))
-			count++;
+	ebitmap_node_t *n;
+	unsigned int count = 0;
+
+	for (n = e1->node; n; n = n->next)
+		count += __builtin_popcountll(n->map);
 	return count;
 }
 
@@ -267,6 +268,78 @@ int ebitmap_get_bit(const ebitmap_t * e, unsigned int bit)
 	return 0;
 }
 
+unsigned int ebitmap_highest_set_bit(const ebitmap_t * e)
+{
+	ebitmap_node_t *n = e->node;
+
+	if (!n)
+		return 0;
+
+	while (n->next)
+		n = n->next;
+
+	return n->startbit + (MAPSIZE - 1) - __builtin_clzll(n->map);
+}
+
+/*
+ * Set every bit from minbit to maxbit inclusive.  This fills whole
+ * nodes at once instead of walking the node list for each bit.
+ */
+int ebitmap_set_range(ebitmap_t * e, unsigned int minbit, unsigned int maxbit)
+{
+	ebitmap_node_t *n, *prev, *new;
+	uint32_t startbit, endbit = maxbit & ~(MAPSIZE - 1);
+	MAPTYPE mask;
+
+	if (minbit > maxbit)
+		return -EINVAL;
+
+	if (endbit + MAPSIZE == 0) {
+		ERR(NULL, "bitmap overflow, bit 0x%x", maxbit);
+		return -EINVAL;
+	}
+
+	prev = 0;
+	n = e->node;
+	for (startbit = minbit & ~(MAPSIZE - 1); startbit <= endbit;
+	     startbit += MAPSIZE) {
+		mask = ~(MAPTYPE) 0;
+		if (minbit > startbit)
+			mask <<= minbit - startbit;
+		if (maxbit - startbit < MAPSIZE - 1)
+			mask &= ~(MAPTYPE) 0 >> (MAPSIZE - 1 - (maxbit - startbit));
+
+		while (n && n->startbit < startbit) {
+			prev = n;
+			n = n->next;
+		}
+
+		if (n && n->startbit == startbit) {
+			n->map |= mask;
+		} else {
+			new = (ebitmap_node_t *) malloc(sizeof(ebitmap_node_t));
+			if (!new)
+				return -ENOMEM;
+			memset(new, 0, sizeof(ebitmap_node_t));
+			new->startbit = startbit;
+			new->map = mask;
+			new->next = n;
+			if (prev)
+				prev->next = new;
+			else
+				e->node = new;
+			n = new;
+		}
+
+		if (!n->next)
+			e->highbit = startbit + MAPSIZE;
+		prev = n;
+		n = n->next;
+	}
+
+	return 0;
+}
+
 int ebitmap_set_bit(ebitmap_t * e, unsigned int bit, int value)
 {
 	ebitmap_node_t *n, *prev, *new;
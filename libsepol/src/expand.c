@@ -37,6 +37,24 @@
 #include "debug.h"
 #include "private.h"
 
+/* Expanded type sets are cached while expanding avrules, keyed on the
+ * type set as it appears in the base policy and the alwaysexpand flag.
+ * The keys use base policy values, so the cache is only valid for the
+ * typemap it was filled with. */
+#define TYPE_SET_CACHE_SIZE 1024
+
+typedef struct type_set_cache_key {
+	type_set_t set;
+	unsigned char alwaysexpand;
+} type_set_cache_key_t;
+
+typedef struct type_set_cache {
+	hashtab_t table;
+	uint32_t *typemap;
+	unsigned int hits;
+	unsigned int misses;
+} type_set_cache_t;
+
 typedef struct expand_state {
 	int verbose;
 	uint32_t *typemap;
@@ -47,6 +65,7 @@ typedef struct expand_state {
 	policydb_t *out;
 	sepol_handle_t *handle;
 	int expand_neverallow;
+	type_set_cache_t type_set_cache;
 } expand_state_t;
 
 static void expand_state_init(expand_state_t * state)
@@ -912,6 +931,12 @@ int mls_semantic_level_expand(mls_semantic_level_t * sl, mls_level_t * l,
 			    p->p_cat_val_to_name[cat->high - 1]);
 			return -1;
 		}
+		if (ebitmap_set_range(&l->cat, cat->low - 1, cat->high - 1)) {
+			ERR(h, "Out of memory!");
+			return -1;
+		}
+		if (ebitmap_contains(&levdatum->level->cat, &l->cat))
+			continue;
 		for (i = cat->low - 1; i < cat->high; i++) {
 			if (!ebitmap_get_bit(&levdatum->level->cat, i)) {
 				ERR(h, "Category %s can not be associated with "
@@ -920,10 +945,6 @@ int mls_semantic_level_expand(mls_semantic_level_t * sl, mls_level_t * l,
 				    p->p_sens_val_to_name[l->sens - 1]);
 				return -1;
 			}
-			if (ebitmap_set_bit(&l->cat, i, 1)) {
-				ERR(h, "Out of memory!");
-				return -1;
-			}
 		}
 	}
 
@@ -1929,59 +1950,185 @@ static int expand_rule_helper(sepol_handle_t * handle,
 	return EXPAND_RULE_SUCCESS;
 }
 
+static unsigned int type_set_cache_ebitmap_hash(const ebitmap_t * e,
+						unsigned int hash)
+{
+	const ebitmap_node_t *n;
+
+	for (n = e->node; n; n = n->next) {
+		hash = (hash << 5) - hash + n->startbit;
+		hash = (hash << 5) - hash + (unsigned int)(n->map ^ (n->map >> 32));
+	}
+
+	return hash;
+}
+
+static unsigned int type_set_cache_hash(hashtab_t h, hashtab_key_t key)
+{
+	type_set_cache_key_t *k = (type_set_cache_key_t *)key;
+	unsigned int hash;
+
+	hash = k->alwaysexpand + (k->set.flags << 1);
+	hash = type_set_cache_ebitmap_hash(&k->set.types, hash);
+	hash = type_set_cache_ebitmap_hash(&k->set.negset, hash);
+
+	return hash & (h->size - 1);
+}
+
+static int type_set_cache_compare(hashtab_t h
+				  __attribute__ ((unused)), hashtab_key_t key1,
+				  hashtab_key_t key2)
+{
+	type_set_cache_key_t *a = (type_set_cache_key_t *)key1;
+	type_set_cache_key_t *b = (type_set_cache_key_t *)key2;
+
+	return a->alwaysexpand != b->alwaysexpand ||
+	    a->set.flags != b->set.flags ||
+	    !ebitmap_cmp(&a->set.types, &b->set.types) ||
+	    !ebitmap_cmp(&a->set.negset, &b->set.negset);
+}
+
+static int type_set_cache_destroy_entry(hashtab_key_t key,
+					hashtab_datum_t datum,
+					void *args __attribute__ ((unused)))
+{
+	type_set_cache_key_t *k = (type_set_cache_key_t *)key;
+	ebitmap_t *types = (ebitmap_t *)datum;
+
+	type_set_destroy(&k->set);
+	free(k);
+	ebitmap_destroy(types);
+	free(types);
+
+	return 0;
+}
+
+static int type_set_cache_init(type_set_cache_t * cache, uint32_t * typemap)
+{
+	cache->table = hashtab_create(type_set_cache_hash,
+				      type_set_cache_compare,
+				      TYPE_SET_CACHE_SIZE);
+	if (!cache->table)
+		return -1;
+	cache->typemap = typemap;
+
+	return 0;
+}
+
+static void type_set_cache_destroy(type_set_cache_t * cache)
+{
+	if (!cache->table)
+		return;
+
+	hashtab_map(cache->table, type_set_cache_destroy_entry, NULL);
+	hashtab_destroy(cache->table);
+	cache->table = NULL;
+	cache->typemap = NULL;
+}
+
+/* Expand a type set of the base policy into the out policy, reusing the
+ * result of an earlier expansion of an identical type set.  The returned
+ * ebitmap is owned by the cache and must not be modified or destroyed. */
+static int type_set_cache_expand(expand_state_t * state, type_set_t * set,
+				 unsigned char alwaysexpand, ebitmap_t ** types)
+{
+	type_set_cache_t *cache = &state->type_set_cache;
+	type_set_cache_key_t lookup, *key = NULL;
+	ebitmap_t *datum = NULL;
+
+	if (cache->typemap != state->typemap) {
+		type_set_cache_destroy(cache);
+		if (type_set_cache_init(cache, state->typemap))
+			goto oom;
+	}
+
+	lookup.set = *set;
+	lookup.alwaysexpand = alwaysexpand;
+	datum = (ebitmap_t *)hashtab_search(cache->table, (hashtab_key_t)&lookup);
+	if (datum) {
+		cache->hits++;
+		*types = datum;
+		return 0;
+	}
+	cache->misses++;
+
+	key = malloc(sizeof(*key));
+	datum = malloc(sizeof(*datum));
+	if (!key || !datum)
+		goto oom;
+	ebitmap_init(datum);
+	if (type_set_cpy(&key->set, set)) {
+		type_set_destroy(&key->set);
+		goto oom;
+	}
+	key->alwaysexpand = alwaysexpand;
+
+	if (expand_convert_type_set(state->out, state->typemap, set, datum,
+				    alwaysexpand)) {
+		type_set_destroy(&key->set);
+		goto oom;
+	}
+
+	if (hashtab_insert(cache->table, (hashtab_key_t)key, datum)) {
+		type_set_destroy(&key->set);
+		ebitmap_destroy(datum);
+		goto oom;
+	}
+
+	*types = datum;
+	return 0;
+
+      oom:
+	free(key);
+	free(datum);
+	ERR(state->handle, "Out of memory!");
+	return -1;
+}
+
 /*
  * Expand a rule into a given avtab - checking for conflicting type
  * rules in the destination policy.  Return EXPAND_RULE_SUCCESS on 
  * success, EXPAND_RULE_CONFLICT if the rule conflicts with something
  * (and hence was not added), or EXPAND_RULE_ERROR on error.
  */
-static int convert_and_expand_rule(sepol_handle_t * handle,
-				   policydb_t * dest_pol, uint32_t * typemap,
+static int convert_and_expand_rule(expand_state_t * state,
 				   avrule_t * source_rule, avtab_t * dest_avtab,
 				   cond_av_list_t ** cond,
 				   cond_av_list_t ** other, int enabled,
 				   int do_neverallow)
 {
-	int retval;
-	ebitmap_t stypes, ttypes;
+	ebitmap_t *stypes, *ttypes;
 	unsigned char alwaysexpand;
 
 	if (!do_neverallow && source_rule->specified & AVRULE_NEVERALLOW)
 		return EXPAND_RULE_SUCCESS;
 
-	ebitmap_init(&stypes);
-	ebitmap_init(&ttypes);
-
 	/* Force expansion for type rules and for self rules. */
 	alwaysexpand = ((source_rule->specified & AVRULE_TYPE) ||
 			(source_rule->flags & RULE_SELF));
 
-	if (expand_convert_type_set
-	    (dest_pol, typemap, &source_rule->stypes, &stypes, alwaysexpand))
+	if (type_set_cache_expand(state, &source_rule->stypes, alwaysexpand,
+				  &stypes))
 		return EXPAND_RULE_ERROR;
-	if (expand_convert_type_set
-	    (dest_pol, typemap, &source_rule->ttypes, &ttypes, alwaysexpand))
+	if (type_set_cache_expand(state, &source_rule->ttypes, alwaysexpand,
+				  &ttypes))
 		return EXPAND_RULE_ERROR;
 
-	retval = expand_rule_helper(handle, dest_pol, typemap,
-				    source_rule, dest_avtab,
-				    cond, other, enabled, &stypes, &ttypes);
-	ebitmap_destroy(&stypes);
-	ebitmap_destroy(&ttypes);
-	return retval;
+	return expand_rule_helper(state->handle, state->out, state->typemap,
+				  source_rule, dest_avtab,
+				  cond, other, enabled, stypes, ttypes);
 }
 
-static int cond_avrule_list_copy(policydb_t * dest_pol, avrule_t * source_rules,
+static int cond_avrule_list_copy(avrule_t * source_rules,
 				 avtab_t * dest_avtab, cond_av_list_t ** list,
-				 cond_av_list_t ** other, uint32_t * typemap,
+				 cond_av_list_t ** other,
 				 int enabled, expand_state_t * state)
 {
 	avrule_t *cur;
 
 	cur = source_rules;
 	while (cur) {
-		if (convert_and_expand_rule(state->handle, dest_pol,
-					    typemap, cur, dest_avtab,
+		if (convert_and_expand_rule(state, cur, dest_avtab,
 					    list, other, enabled,
 					    0) != EXPAND_RULE_SUCCESS) {
 			return -1;
@@ -2067,13 +2214,13 @@ static int cond_node_copy(expand_state_t * state, cond_node_t * cn)
 	free(tmp);
 
 	if (cond_avrule_list_copy
-	    (state->out, cn->avtrue_list, &state->out->te_cond_avtab,
-	     &new_cond->true_list, &new_cond->false_list, state->typemap,
+	    (cn->avtrue_list, &state->out->te_cond_avtab,
+	     &new_cond->true_list, &new_cond->false_list,
 	     new_cond->cur_state, state))
 		return -1;
 	if (cond_avrule_list_copy
-	    (state->out, cn->avfalse_list, &state->out->te_cond_avtab,
-	     &new_cond->false_list, &new_cond->true_list, state->typemap,
+	    (cn->avfalse_list, &state->out->te_cond_avtab,
+	     &new_cond->false_list, &new_cond->true_list,
 	     !new_cond->cur_state, state))
 		return -1;
 
@@ -2698,6 +2845,11 @@ static int copy_and_expand_avrule_block(expand_state_t * state)
  		return -1;
  	}
 
+	if (type_set_cache_init(&state->type_set_cache, state->typemap)) {
+		ERR(state->handle, "Out of Memory!");
+		return -1;
+	}
+
 	while (curblock) {
 		avrule_decl_t *decl = curblock->enabled;
 		avrule_t *cur_avrule;
@@ -2735,9 +2887,8 @@ static int copy_and_expand_avrule_block(expand_state_t * state)
 					state->out->unsupported_format = 1;
 				}
 				if (convert_and_expand_rule
-				    (state->handle, state->out, state->typemap,
-				     cur_avrule, &state->out->te_avtab, NULL,
-				     NULL, 0,
+				    (state, cur_avrule, &state->out->te_avtab,
+				     NULL, NULL, 0,
 				     state->expand_neverallow) !=
 				    EXPAND_RULE_SUCCESS) {
 					goto cleanup;
@@ -2766,6 +2917,10 @@ static int copy_and_expand_avrule_block(expand_state_t * state)
 	retval = 0;
 
       cleanup:
+	if (state->verbose)
+		INFO(state->handle, "type set cache: %u hits, %u misses",
+		     state->type_set_cache.hits, state->type_set_cache.misses);
+	type_set_cache_destroy(&state->type_set_cache);
 	return retval;
 }
 
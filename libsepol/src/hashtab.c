@@ -30,8 +30,15 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <sepol/policydb/hashtab.h>
 
+/*
+ * Tables grow by doubling once they hold more than
+ * HASHTAB_MAX_LOAD entries per slot on average.
+ */
+#define HASHTAB_MAX_LOAD 1
+
 hashtab_t hashtab_create(unsigned int (*hash_value) (hashtab_t h,
 						     const hashtab_key_t key),
 			 int (*keycmp) (hashtab_t h,
@@ -63,6 +70,82 @@ hashtab_t hashtab_create(unsigned int (*hash_value) (hashtab_t h,
 	return p;
 }
 
+/*
+ * Double the number of slots if the table is too heavily loaded.
+ * Every hash_value function computes its result from h->size, so
+ * the nodes are simply rehashed into the new slots, keeping each
+ * chain sorted by keycmp.  On allocation failure the table is left
+ * as it was, which is still correct, only slower.
+ */
+static void hashtab_check_resize(hashtab_t h)
+{
+	unsigned int i, old_size, hvalue;
+	hashtab_ptr_t *old_htable, cur, next, prev, pos;
+
+	if (h->size == 0 || h->nel <= h->size * HASHTAB_MAX_LOAD ||
+	    h->size > UINT_MAX / 2)
+		return;
+
+	old_htable = h->htable;
+	old_size = h->size;
+
+	h->htable = calloc(old_size * 2, sizeof(hashtab_ptr_t));
+	if (h->htable == NULL) {
+		h->htable = old_htable;
+		return;
+	}
+	h->size = old_size * 2;
+
+	for (i = 0; i < old_size; i++) {
+		for (cur = old_htable[i]; cur != NULL; cur = next) {
+			next = cur->next;
+			hvalue = h->hash_value(h, cur->key);
+			prev = NULL;
+			pos = h->htable[hvalue];
+			while (pos && h->keycmp(h, cur->key, pos->key) > 0) {
+				prev = pos;
+				pos = pos->next;
+			}
+			cur->next = pos;
+			if (prev)
+				prev->next = cur;
+			else
+				h->htable[hvalue] = cur;
+		}
+	}
+
+	free(old_htable);
+}
+
+/*
+ * String hash for symbol names: FNV-1a over the bytes followed by
+ * a final avalanche step so that the low bits used to pick a slot
+ * depend on every character of the key.
+ */
+unsigned int hashtab_hash_string_full(const char *key)
+{
+	const unsigned char *p;
+	uint32_t val = 2166136261U;
+
+	for (p = (const unsigned char *)key; *p; p++) {
+		val ^= *p;
+		val *= 16777619U;
+	}
+
+	val ^= val >> 16;
+	val *= 0x85ebca6bU;
+	val ^= val >> 13;
+	val *= 0xc2b2ae35U;
+	val ^= val >> 16;
+
+	return val;
+}
+
+unsigned int hashtab_hash_string(hashtab_t h, const hashtab_key_t key)
+{
+	return hashtab_hash_string_full(key) & (h->size - 1);
+}
+
 int hashtab_insert(hashtab_t h, hashtab_key_t key, hashtab_datum_t datum)
 {
 	int hvalue;
@@ -97,6 +180,7 @@ int hashtab_insert(hashtab_t h, hashtab_key_t key, hashtab_datum_t datum)
 	}
 
 	h->nel++;
+	hashtab_check_resize(h);
 	return SEPOL_OK;
 }
 
@@ -170,6 +254,8 @@ int hashtab_replace(hashtab_t h, hashtab_key_t key, hashtab_datum_t datum,
 			newnode->next = h->htable[hvalue];
 			h->htable[hvalue] = newnode;
 		}
+		h->nel++;
+		hashtab_check_resize(h);
 	}
 
 	return SEPOL_OK;
@@ -288,10 +374,12 @@ void hashtab_hash_eval(hashtab_t h, char *tag)
 {
 	unsigned int i;
 	int chain_len, slots_used, max_chain_len;
+	uint64_t chain2_sum;
 	hashtab_ptr_t cur;
 
 	slots_used = 0;
 	max_chain_len = 0;
+	chain2_sum = 0;
 	for (i = 0; i < h->size; i++) {
 		cur = h->htable[i];
 		if (cur) {
@@ -304,10 +392,17 @@ void hashtab_hash_eval(hashtab_t h, char *tag)
 
 			if (chain_len > max_chain_len)
 				max_chain_len = chain_len;
+			chain2_sum += (uint64_t) chain_len * chain_len;
 		}
 	}
 
+	/*
+	 * The average number of entries examined by a successful search
+	 * is the sum of the squared chain lengths over the entries.
+	 */
 	printf
-	    ("%s:  %d entries and %d/%d buckets used, longest chain length %d\n",
-	     tag, h->nel, slots_used, h->size, max_chain_len);
+	    ("%s:  %d entries and %d/%d buckets used, longest chain length %d, "
+	     "average search length %.2f\n",
+	     tag, h->nel, slots_used, h->size, max_chain_len,
+	     h->nel ? (double)chain2_sum / h->nel : 0.0);
 }
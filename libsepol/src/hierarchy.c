@@ -39,6 +39,130 @@
 
 #define BOUNDS_AVTAB_SIZE 1024
 
+/* Which side of a rule bounds_expand_rule() and bounds_check_rule() look at */
+#define BOUNDS_SOURCE 1
+#define BOUNDS_TARGET 2
+
+/* The unconditional allow rules bucketed by source and by target value,
+ * and for each type the values (itself and its attributes) that contain
+ * it. The rules that can involve type t are then those listed under the
+ * values in attrs[attr_start[t]] .. attrs[attr_start[t + 1] - 1], so a
+ * parent or child only visits its own rules instead of the whole avtab.
+ */
+struct bounds_index {
+	uint32_t *src_start;
+	avtab_ptr_t *src_rules;
+	uint32_t *tgt_start;
+	avtab_ptr_t *tgt_rules;
+	uint32_t *attr_start;
+	uint32_t *attrs;
+};
+
+static void bounds_destroy_index(struct bounds_index *idx)
+{
+	free(idx->src_start);
+	free(idx->src_rules);
+	free(idx->tgt_start);
+	free(idx->tgt_rules);
+	free(idx->attr_start);
+	free(idx->attrs);
+	memset(idx, 0, sizeof(*idx));
+}
+
+/* Bucket the allow rules of avtab by their source or target value.
+ * The rules for value v end up in rules[start[v]] .. rules[start[v + 1] - 1].
+ */
+static int bounds_index_rules(avtab_t *avtab, uint32_t nprim, int side,
+			      uint32_t **start, avtab_ptr_t **rules)
+{
+	avtab_ptr_t n;
+	uint32_t i, v, total = 0;
+
+	*start = calloc(nprim + 2, sizeof(uint32_t));
+	if (!*start)
+		return SEPOL_ENOMEM;
+
+	for (i = 0; i < avtab->nslot; i++) {
+		for (n = avtab->htable[i]; n; n = n->next) {
+			if (!(n->key.specified & AVTAB_ALLOWED))
+				continue;
+			v = (side == BOUNDS_SOURCE) ?
+				n->key.source_type : n->key.target_type;
+			(*start)[v]++;
+			total++;
+		}
+	}
+	for (v = 1; v <= nprim; v++)
+		(*start)[v] += (*start)[v - 1];
+	(*start)[nprim + 1] = total;
+
+	*rules = malloc((total ? total : 1) * sizeof(avtab_ptr_t));
+	if (!*rules)
+		return SEPOL_ENOMEM;
+
+	for (i = 0; i < avtab->nslot; i++) {
+		for (n = avtab->htable[i]; n; n = n->next) {
+			if (!(n->key.specified & AVTAB_ALLOWED))
+				continue;
+			v = (side == BOUNDS_SOURCE) ?
+				n->key.source_type : n->key.target_type;
+			(*rules)[--(*start)[v]] = n;
+		}
+	}
+
+	return 0;
+}
+
+static int bounds_build_index(sepol_handle_t *handle, policydb_t *p,
+			      struct bounds_index *idx)
+{
+	uint32_t nprim = p->p_types.nprim;
+	uint32_t v, t, total = 0;
+	ebitmap_node_t *tnode;
+	unsigned int i;
+	int rc;
+
+	memset(idx, 0, sizeof(*idx));
+
+	rc = bounds_index_rules(&p->te_avtab, nprim, BOUNDS_SOURCE,
+				&idx->src_start, &idx->src_rules);
+	if (rc) goto oom;
+	rc = bounds_index_rules(&p->te_avtab, nprim, BOUNDS_TARGET,
+				&idx->tgt_start, &idx->tgt_rules);
+	if (rc) goto oom;
+
+	idx->attr_start = calloc(nprim + 2, sizeof(uint32_t));
+	if (!idx->attr_start) goto oom;
+	for (v = 1; v <= nprim; v++) {
+		ebitmap_for_each_bit(&p->attr_type_map[v - 1], tnode, i) {
+			if (!ebitmap_node_get_bit(tnode, i))
+				continue;
+			idx->attr_start[i + 1]++;
+			total++;
+		}
+	}
+	for (t = 1; t <= nprim; t++)
+		idx->attr_start[t] += idx->attr_start[t - 1];
+	idx->attr_start[nprim + 1] = total;
+
+	idx->attrs = malloc((total ? total : 1) * sizeof(uint32_t));
+	if (!idx->attrs) goto oom;
+	for (v = 1; v <= nprim; v++) {
+		ebitmap_for_each_bit(&p->attr_type_map[v - 1], tnode, i) {
+			if (!ebitmap_node_get_bit(tnode, i))
+				continue;
+			idx->attrs[--idx->attr_start[i + 1]] = v;
+		}
+	}
+
+	return 0;
+
+oom:
+	ERR(handle, "Insufficient memory");
+	bounds_destroy_index(idx);
+	return SEPOL_ENOMEM;
+}
+
 static int bounds_insert_helper(sepol_handle_t *handle, avtab_t *avtab,
 				avtab_key_t *avtab_key, avtab_datum_t *datum)
 {
@@ -97,7 +221,7 @@ exit:
 static int bounds_expand_rule(sepol_handle_t *handle, policydb_t *p,
 			      avtab_t *avtab, avtab_t *global, avtab_t *other,
 			      uint32_t parent, uint32_t src, uint32_t tgt,
-			      uint32_t class, uint32_t data)
+			      uint32_t class, uint32_t data, int sides)
 {
 	int rc = 0;
 	avtab_key_t avtab_key;
@@ -109,7 +233,8 @@ static int bounds_expand_rule(sepol_handle_t *handle, policydb_t *p,
 	avtab_key.target_class = class;
 	datum.data = data;
 
-	if (ebitmap_get_bit(&p->attr_type_map[src - 1], parent - 1)) {
+	if ((sides & BOUNDS_SOURCE) &&
+	    ebitmap_get_bit(&p->attr_type_map[src - 1], parent - 1)) {
 		avtab_key.source_type = parent;
 		ebitmap_for_each_bit(&p->attr_type_map[tgt - 1], tnode, i) {
 			if (!ebitmap_node_get_bit(tnode, i))
@@ -121,7 +246,8 @@ static int bounds_expand_rule(sepol_handle_t *handle, policydb_t *p,
 		}
 	}
 
-	if (ebitmap_get_bit(&p->attr_type_map[tgt - 1], parent - 1)) {
+	if ((sides & BOUNDS_TARGET) &&
+	    ebitmap_get_bit(&p->attr_type_map[tgt - 1], parent - 1)) {
 		avtab_key.target_type = parent;
 		ebitmap_for_each_bit(&p->attr_type_map[src - 1], tnode, i) {
 			if (!ebitmap_node_get_bit(tnode, i))
@@ -148,7 +274,8 @@ static int bounds_expand_cond_rules(sepol_handle_t *handle, policydb_t *p,
 		avtab_ptr_t n = cur->node;
 		rc = bounds_expand_rule(handle, p, avtab, global, other, parent,
 					n->key.source_type, n->key.target_type,
-					n->key.target_class, n->datum.data);
+					n->key.target_class, n->datum.data,
+					BOUNDS_SOURCE | BOUNDS_TARGET);
 		if (rc) goto exit;
 	}
 
@@ -156,24 +283,38 @@ exit:
 	return rc;
 }
 
-struct bounds_expand_args {
-	sepol_handle_t *handle;
-	policydb_t *p;
-	avtab_t *avtab;
-	uint32_t parent;
-};
-
-static int bounds_expand_rule_callback(avtab_key_t *k, avtab_datum_t *d,
-				       void *args)
+static int bounds_expand_indexed_rules(sepol_handle_t *handle, policydb_t *p,
+				       struct bounds_index *idx,
+				       avtab_t *avtab, uint32_t parent)
 {
-	struct bounds_expand_args *a = (struct bounds_expand_args *)args;
-
-	if (!(k->specified & AVTAB_ALLOWED))
-		return 0;
+	int rc = 0;
+	uint32_t a, r, v;
+	avtab_ptr_t n;
+
+	for (a = idx->attr_start[parent]; a < idx->attr_start[parent + 1]; a++) {
+		v = idx->attrs[a];
+		for (r = idx->src_start[v]; r < idx->src_start[v + 1]; r++) {
+			n = idx->src_rules[r];
+			rc = bounds_expand_rule(handle, p, avtab, NULL, NULL,
+						parent, n->key.source_type,
+						n->key.target_type,
+						n->key.target_class,
+						n->datum.data, BOUNDS_SOURCE);
+			if (rc) goto exit;
+		}
+		for (r = idx->tgt_start[v]; r < idx->tgt_start[v + 1]; r++) {
+			n = idx->tgt_rules[r];
+			rc = bounds_expand_rule(handle, p, avtab, NULL, NULL,
+						parent, n->key.source_type,
+						n->key.target_type,
+						n->key.target_class,
+						n->datum.data, BOUNDS_TARGET);
+			if (rc) goto exit;
+		}
+	}
 
-	return bounds_expand_rule(a->handle, a->p, a->avtab, NULL, NULL,
-				  a->parent, k->source_type, k->target_type,
-				  k->target_class, d->data);
+exit:
+	return rc;
 }
 
 struct bounds_cond_info {
@@ -197,26 +338,22 @@ static void bounds_destroy_cond_info(struct bounds_cond_info *cur)
 }
 
 static int bounds_expand_parent_rules(sepol_handle_t *handle, policydb_t *p,
+				      struct bounds_index *idx,
 				      avtab_t *global_avtab,
 				      struct bounds_cond_info **cond_info,
 				      uint32_t parent)
 {
 	int rc = 0;
-	struct bounds_expand_args args;
 	cond_list_t *cur;
 
+	*cond_info = NULL;
 	avtab_init(global_avtab);
 	rc = avtab_alloc(global_avtab, BOUNDS_AVTAB_SIZE);
 	if (rc) goto oom;
 
-	args.handle = handle;
-	args.p = p;
-	args.avtab = global_avtab;
-	args.parent = parent;
-	rc = avtab_map(&p->te_avtab, bounds_expand_rule_callback, &args);
+	rc = bounds_expand_indexed_rules(handle, p, idx, global_avtab, parent);
 	if (rc) goto exit;
 
-	*cond_info = NULL;
 	for (cur = p->cond_list; cur; cur = cur->next) {
 		struct bounds_cond_info *ci;
 		ci = malloc(sizeof(struct bounds_cond_info));
@@ -296,7 +433,7 @@ static int bounds_check_rule(sepol_handle_t *handle, policydb_t *p,
 			     avtab_t *global_avtab, avtab_t *cur_avtab,
 			     uint32_t child, uint32_t parent, uint32_t src,
 			     uint32_t tgt, uint32_t class, uint32_t data,
-			     avtab_ptr_t *bad, int *numbad)
+			     int sides, avtab_ptr_t *bad, int *numbad)
 {
 	int rc = 0;
 	avtab_key_t avtab_key;
@@ -308,7 +445,8 @@ static int bounds_check_rule(sepol_handle_t *handle, policydb_t *p,
 	avtab_key.specified = AVTAB_ALLOWED;
 	avtab_key.target_class = class;
 
-	if (ebitmap_get_bit(&p->attr_type_map[src - 1], child - 1)) {
+	if ((sides & BOUNDS_SOURCE) &&
+	    ebitmap_get_bit(&p->attr_type_map[src - 1], child - 1)) {
 		avtab_key.source_type = parent;
 		ebitmap_for_each_bit(&p->attr_type_map[tgt - 1], tnode, i) {
 			if (!ebitmap_node_get_bit(tnode, i))
@@ -329,7 +467,8 @@ static int bounds_check_rule(sepol_handle_t *handle, policydb_t *p,
 			if (rc) goto exit;
 		}
 	}
-	if (ebitmap_get_bit(&p->attr_type_map[tgt - 1], child - 1)) {
+	if ((sides & BOUNDS_TARGET) &&
+	    ebitmap_get_bit(&p->attr_type_map[tgt - 1], child - 1)) {
 		avtab_key.target_type = parent;
 		ebitmap_for_each_bit(&p->attr_type_map[src - 1], tnode, i) {
 			if (!ebitmap_node_get_bit(tnode, i))
@@ -377,7 +516,8 @@ static int bounds_check_cond_rules(sepol_handle_t *handle, policydb_t *p,
 		rc = bounds_check_rule(handle, p, global_avtab, cond_avtab,
 				       child, parent, key->source_type,
 				       key->target_type, key->target_class,
-				       datum->data, bad, numbad);
+				       datum->data, BOUNDS_SOURCE | BOUNDS_TARGET,
+				       bad, numbad);
 		if (rc) goto exit;
 	}
 
@@ -385,47 +525,58 @@ exit:
 	return rc;
 }
 
-struct bounds_check_args {
-	sepol_handle_t *handle;
-	policydb_t *p;
-	avtab_t *cur_avtab;
-	uint32_t child;
-	uint32_t parent;
-	avtab_ptr_t bad;
-	int numbad;
-};
-
-static int bounds_check_rule_callback(avtab_key_t *k, avtab_datum_t *d,
-				      void *args)
+static int bounds_check_indexed_rules(sepol_handle_t *handle, policydb_t *p,
+				      struct bounds_index *idx,
+				      avtab_t *global_avtab, uint32_t child,
+				      uint32_t parent, avtab_ptr_t *bad,
+				      int *numbad)
 {
-	struct bounds_check_args *a = (struct bounds_check_args *)args;
-
-	if (!(k->specified & AVTAB_ALLOWED))
-		return 0;
+	int rc = 0;
+	uint32_t a, r, v;
+	avtab_ptr_t n;
+
+	for (a = idx->attr_start[child]; a < idx->attr_start[child + 1]; a++) {
+		v = idx->attrs[a];
+		for (r = idx->src_start[v]; r < idx->src_start[v + 1]; r++) {
+			n = idx->src_rules[r];
+			rc = bounds_check_rule(handle, p, NULL, global_avtab,
+					       child, parent, n->key.source_type,
+					       n->key.target_type,
+					       n->key.target_class,
+					       n->datum.data, BOUNDS_SOURCE,
+					       bad, numbad);
+			if (rc) goto exit;
+		}
+		for (r = idx->tgt_start[v]; r < idx->tgt_start[v + 1]; r++) {
+			n = idx->tgt_rules[r];
+			rc = bounds_check_rule(handle, p, NULL, global_avtab,
+					       child, parent, n->key.source_type,
+					       n->key.target_type,
+					       n->key.target_class,
+					       n->datum.data, BOUNDS_TARGET,
+					       bad, numbad);
+			if (rc) goto exit;
+		}
+	}
 
-	return bounds_check_rule(a->handle, a->p, NULL, a->cur_avtab, a->child,
-				 a->parent, k->source_type, k->target_type,
-				 k->target_class, d->data, &a->bad, &a->numbad);
+exit:
+	return rc;
 }
 
 static int bounds_check_child_rules(sepol_handle_t *handle, policydb_t *p,
+				    struct bounds_index *idx,
 				    avtab_t *global_avtab,
 				    struct bounds_cond_info *cond_info,
 				    uint32_t child, uint32_t parent,
 				    avtab_ptr_t *bad, int *numbad)
 {
 	int rc;
-	struct bounds_check_args args;
 	struct bounds_cond_info *cur;
+	avtab_ptr_t child_bad = NULL;
+	int child_numbad = 0;
 
-	args.handle = handle;
-	args.p = p;
-	args.cur_avtab = global_avtab;
-	args.child = child;
-	args.parent = parent;
-	args.bad = NULL;
-	args.numbad = 0;
-	rc = avtab_map(&p->te_avtab, bounds_check_rule_callback, &args);
+	rc = bounds_check_indexed_rules(handle, p, idx, global_avtab, child,
+					parent, &child_bad, &child_numbad);
 	if (rc) goto exit;
 
 	for (cur = cond_info; cur; cur = cur->next) {
@@ -433,20 +584,22 @@ static int bounds_check_child_rules(sepol_handle_t *handle, policydb_t *p,
 		rc = bounds_check_cond_rules(handle, p, global_avtab,
 					     &cur->true_avtab,
 					     node->true_list, child, parent,
-					     &args.bad, &args.numbad);
+					     &child_bad, &child_numbad);
 		if (rc) goto exit;
 
 		rc = bounds_check_cond_rules(handle, p, global_avtab,
 					     &cur->false_avtab,
 					     node->false_list, child, parent,
-					     &args.bad, &args.numbad);
+					     &child_bad, &child_numbad);
 		if (rc) goto exit;
 	}
 
-	*numbad += args.numbad;
-	*bad = args.bad;
+	*numbad += child_numbad;
+	*bad = child_bad;
+	return 0;
 
 exit:
+	bounds_destroy_bad(child_bad);
 	return rc;
 }
 
@@ -454,18 +607,25 @@ int bounds_check_type(sepol_handle_t *handle, policydb_t *p, uint32_t child,
 		      uint32_t parent, avtab_ptr_t *bad, int *numbad)
 {
 	int rc = 0;
+	struct bounds_index idx;
 	avtab_t global_avtab;
 	struct bounds_cond_info *cond_info = NULL;
 
-	rc = bounds_expand_parent_rules(handle, p, &global_avtab, &cond_info, parent);
+	rc = bounds_build_index(handle, p, &idx);
 	if (rc) goto exit;
 
-	rc = bounds_check_child_rules(handle, p, &global_avtab, cond_info,
-				      child, parent, bad, numbad);
+	rc = bounds_expand_parent_rules(handle, p, &idx, &global_avtab,
+					&cond_info, parent);
+	if (rc) goto destroy_index;
+
+	rc = bounds_check_child_rules(handle, p, &idx, &global_avtab,
+				      cond_info, child, parent, bad, numbad);
 
 	bounds_destroy_cond_info(cond_info);
 	avtab_destroy(&global_avtab);
 
+destroy_index:
+	bounds_destroy_index(&idx);
 exit:
 	return rc;
 }
@@ -503,25 +663,128 @@ void bounds_destroy_bad(avtab_ptr_t cur)
 	}
 }
 
-static int bounds_check_type_callback(hashtab_key_t k __attribute__ ((unused)),
-				      hashtab_datum_t d, void *args)
+struct bounds_pair {
+	uint32_t child;
+	uint32_t parent;
+};
+
+static int bounds_pair_cmp(const void *a, const void *b)
 {
-	int rc = 0;
-	struct bounds_args *a = (struct bounds_args *)args;
+	const struct bounds_pair *x = a;
+	const struct bounds_pair *y = b;
+
+	if (x->parent != y->parent)
+		return x->parent < y->parent ? -1 : 1;
+	if (x->child != y->child)
+		return x->child < y->child ? -1 : 1;
+	return 0;
+}
+
+static int bounds_collect_type_callback(hashtab_key_t k __attribute__ ((unused)),
+					hashtab_datum_t d, void *args)
+{
+	uint32_t *bounds = (uint32_t *)args;
 	type_datum_t *t = (type_datum_t *)d;
-	avtab_ptr_t bad = NULL;
-
-	if (t->bounds) {
-		rc = bounds_check_type(a->handle, a->p, t->s.value, t->bounds,
-				       &bad, &a->numbad);
-		if (bad) {
-			bounds_report(a->handle, a->p, t->s.value, t->bounds,
-				      bad);
+
+	if (t->bounds)
+		bounds[t->s.value - 1] = t->bounds;
+
+	return 0;
+}
+
+int bounds_check_types_map(sepol_handle_t *handle, policydb_t *p,
+			   int (*apply) (uint32_t child, uint32_t parent,
+					 avtab_ptr_t bad, void *args),
+			   void *args, int *numbad)
+{
+	int rc = 0;
+	uint32_t nprim = p->p_types.nprim;
+	uint32_t *bounds = NULL;
+	struct bounds_pair *pairs = NULL;
+	uint32_t npairs = 0, i, j;
+	struct bounds_index idx;
+	avtab_t global_avtab;
+	struct bounds_cond_info *cond_info = NULL;
+	avtab_ptr_t bad;
+
+	memset(&idx, 0, sizeof(idx));
+
+	bounds = calloc(nprim ? nprim : 1, sizeof(uint32_t));
+	if (!bounds) goto oom;
+	hashtab_map(p->p_types.table, bounds_collect_type_callback, bounds);
+
+	for (i = 0; i < nprim; i++) {
+		if (bounds[i])
+			npairs++;
+	}
+	if (!npairs)
+		goto exit;
+
+	pairs = malloc(npairs * sizeof(struct bounds_pair));
+	if (!pairs) goto oom;
+	for (i = 0, j = 0; i < nprim; i++) {
+		if (!bounds[i])
+			continue;
+		pairs[j].child = i + 1;
+		pairs[j].parent = bounds[i];
+		j++;
+	}
+	qsort(pairs, npairs, sizeof(struct bounds_pair), bounds_pair_cmp);
+
+	rc = bounds_build_index(handle, p, &idx);
+	if (rc) goto exit;
+
+	/* Children of the same parent share one expansion of its rules.
+	 * They are checked on the calling thread, unlike the neverallow
+	 * check in CIL: apply and the handle's message callback belong
+	 * to the caller and are not required to be thread-safe, and once
+	 * the expansion is shared a child only walks its indexed rules. */
+	for (i = 0; i < npairs; i = j) {
+		rc = bounds_expand_parent_rules(handle, p, &idx, &global_avtab,
+						&cond_info, pairs[i].parent);
+		if (rc) goto exit;
+
+		for (j = i; j < npairs && pairs[j].parent == pairs[i].parent; j++) {
+			bad = NULL;
+			rc = bounds_check_child_rules(handle, p, &idx,
+						      &global_avtab, cond_info,
+						      pairs[j].child,
+						      pairs[j].parent,
+						      &bad, numbad);
+			if (!rc && bad)
+				rc = apply(pairs[j].child, pairs[j].parent,
+					   bad, args);
 			bounds_destroy_bad(bad);
+			if (rc)
+				break;
 		}
+
+		bounds_destroy_cond_info(cond_info);
+		cond_info = NULL;
+		avtab_destroy(&global_avtab);
+		if (rc) goto exit;
 	}
 
+exit:
+	bounds_destroy_index(&idx);
+	free(pairs);
+	free(bounds);
 	return rc;
+
+oom:
+	ERR(handle, "Insufficient memory");
+	rc = SEPOL_ENOMEM;
+	goto exit;
+}
+
+static int bounds_report_callback(uint32_t child, uint32_t parent,
+				  avtab_ptr_t bad, void *args)
+{
+	struct bounds_args *a = (struct bounds_args *)args;
+
+	bounds_report(a->handle, a->p, child, parent, bad);
+
+	return 0;
 }
 
 int bounds_check_types(sepol_handle_t *handle, policydb_t *p)
@@ -533,7 +796,8 @@ int bounds_check_types(sepol_handle_t *handle, policydb_t *p)
 	args.p = p;
 	args.numbad = 0;
 
-	rc = hashtab_map(p->p_types.table, bounds_check_type_callback, &args);
+	rc = bounds_check_types_map(handle, p, bounds_report_callback, &args,
+				    &args.numbad);
 	if (rc) goto exit;
 
 	if (args.numbad > 0) {
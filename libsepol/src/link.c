@@ -38,6 +38,19 @@
 #undef min
 #define min(a,b) (((a) < (b)) ? (a) : (b))
 
+/* Size of the chunks the link pool allocates from. */
+#define LINK_POOL_CHUNK_SIZE (64 * 1024)
+
+/* The per-module remapping tables only live for the duration of
+ * link_modules(). They are carved out of a list of large chunks and
+ * released together at the end, rather than with a malloc() and free()
+ * pair for every table of every module. */
+typedef struct link_pool_chunk {
+	struct link_pool_chunk *next;
+	size_t used;
+	size_t size;
+} link_pool_chunk_t;
+
 typedef struct policy_module {
 	policydb_t *policy;
 	uint32_t num_decls;
@@ -70,6 +83,9 @@ typedef struct link_state {
 
 	/* error reporting fields */
 	sepol_handle_t *handle;
+
+	/* allocations that are released when linking is finished */
+	link_pool_chunk_t *pool;
 } link_state_t;
 
 typedef struct missing_requirement {
@@ -83,25 +99,41 @@ static const char *symtab_names[SYM_NUM] = {
 	"bool", "level", "category"
 };
 
-/* Deallocates all elements within a module, but NOT the policydb_t
- * structure within, as well as the pointer itself. */
-static void policy_module_destroy(policy_module_t * mod)
+/* Returns zeroed memory from the link pool, or NULL if out of memory.
+ * The memory must not be freed; see link_pool_destroy(). */
+static void *link_pool_alloc(link_state_t * state, size_t size)
 {
-	unsigned int i;
-	if (mod == NULL) {
-		return;
-	}
-	for (i = 0; i < SYM_NUM; i++) {
-		free(mod->map[i]);
-	}
-	for (i = 0; mod->perm_map != NULL && i < mod->policy->p_classes.nprim;
-	     i++) {
-		free(mod->perm_map[i]);
+	link_pool_chunk_t *chunk = state->pool;
+	size_t header = (sizeof(*chunk) + 7) & ~(size_t) 7;
+	void *ptr;
+
+	size = (size + 7) & ~(size_t) 7;
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		size_t chunk_size = LINK_POOL_CHUNK_SIZE;
+		if (size > chunk_size - header)
+			chunk_size = header + size;
+		chunk = calloc(1, chunk_size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->used = header;
+		chunk->size = chunk_size;
+		chunk->next = state->pool;
+		state->pool = chunk;
+	}
+	ptr = (char *)chunk + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+static void link_pool_destroy(link_state_t * state)
+{
+	link_pool_chunk_t *chunk, *next;
+
+	for (chunk = state->pool; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
 	}
-	free(mod->perm_map);
-	free(mod->perm_map_len);
-	free(mod->avdecl_map);
-	free(mod);
+	state->pool = NULL;
 }
 
 /***** functions that copy identifiers from a module to base *****/
@@ -183,16 +215,18 @@ static int permission_copy_callback(hashtab_key_t key, hashtab_datum_t datum,
 	 * unlike symbols, the permission map translates between
 	 * module permission bit to target permission bit.  that bit
 	 * may have originated from the class -or- it could be from
-	 * the class's common parent.*/
+	 * the class's common parent.  prepare_module() sizes the map
+	 * for all of the class's permissions, so it only grows here
+	 * for a value beyond them.*/
 	if (perm->s.value > mod->perm_map_len[sclassi]) {
-		uint32_t *newmap = calloc(perm->s.value, sizeof(*newmap));
+		uint32_t *newmap = link_pool_alloc(state, perm->s.value *
+						   sizeof(*newmap));
 		if (newmap == NULL) {
 			ERR(state->handle, "Out of memory!");
 			return -1;
 		}
 		memcpy(newmap, mod->perm_map[sclassi],
 		       mod->perm_map_len[sclassi] * sizeof(*newmap));
-		free(mod->perm_map[sclassi]);
 		mod->perm_map[sclassi] = newmap;
 		mod->perm_map_len[sclassi] = perm->s.value;
 	}
@@ -2296,13 +2330,14 @@ static int prepare_module(link_state_t * state, policy_module_t * module)
 	int i;
 	uint32_t items, num_decls = 0;
 	avrule_block_t *cur;
+	class_datum_t *cladatum;
 
 	/* allocate the maps */
 	for (i = 0; i < SYM_NUM; i++) {
 		items = module->policy->symtab[i].nprim;
 		if ((module->map[i] =
-		     (uint32_t *) calloc(items,
-					 sizeof(*module->map[i]))) == NULL) {
+		     link_pool_alloc(state,
+				     items * sizeof(*module->map[i]))) == NULL) {
 			ERR(state->handle, "Out of memory!");
 			return -1;
 		}
@@ -2311,15 +2346,28 @@ static int prepare_module(link_state_t * state, policy_module_t * module)
 	/* allocate the permissions remap here */
 	items = module->policy->p_classes.nprim;
 	if ((module->perm_map_len =
-	     calloc(items, sizeof(*module->perm_map_len))) == NULL) {
+	     link_pool_alloc(state,
+			     items * sizeof(*module->perm_map_len))) == NULL) {
 		ERR(state->handle, "Out of memory!");
 		return -1;
 	}
 	if ((module->perm_map =
-	     calloc(items, sizeof(*module->perm_map))) == NULL) {
+	     link_pool_alloc(state, items * sizeof(*module->perm_map))) == NULL) {
 		ERR(state->handle, "Out of memory!");
 		return -1;
 	}
+	for (i = 0; i < (int)items; i++) {
+		/* the class's own permissions and those of its common */
+		cladatum = module->policy->class_val_to_struct[i];
+		module->perm_map_len[i] =
+		    cladatum ? cladatum->permissions.nprim : 0;
+		if ((module->perm_map[i] =
+		     link_pool_alloc(state, module->perm_map_len[i] *
+				     sizeof(*module->perm_map[i]))) == NULL) {
+			ERR(state->handle, "Out of memory!");
+			return -1;
+		}
+	}
 
 	/* allocate a map for avrule_decls */
 	for (cur = module->policy->global; cur != NULL; cur = cur->next) {
@@ -2331,7 +2379,8 @@ static int prepare_module(link_state_t * state, policy_module_t * module)
 		}
 	}
 	num_decls++;
-	if ((module->avdecl_map = calloc(num_decls, sizeof(uint32_t))) == NULL) {
+	if ((module->avdecl_map =
+	     link_pool_alloc(state, num_decls * sizeof(uint32_t))) == NULL) {
 		ERR(state->handle, "Out of memory!");
 		return -1;
 	}
@@ -2570,9 +2619,7 @@ int link_modules(sepol_handle_t * handle,
 		}
 
 		if ((modules[i] =
-		     (policy_module_t *) calloc(1,
-						sizeof(policy_module_t))) ==
-		    NULL) {
+		     link_pool_alloc(&state, sizeof(policy_module_t))) == NULL) {
 			ERR(state.handle, "Out of memory!");
 			goto cleanup;
 		}
@@ -2659,9 +2706,7 @@ int link_modules(sepol_handle_t * handle,
 
 	retval = 0;
       cleanup:
-	for (i = 0; modules != NULL && i < len; i++) {
-		policy_module_destroy(modules[i]);
-	}
+	link_pool_destroy(&state);
 	free(modules);
 	free(state.decl_to_mod);
 	return retval;
@@ -260,8 +260,7 @@ int mls_context_isvalid(const policydb_t * p, const context_struct_t * c)
 
 	level_datum_t *levdatum;
 	user_datum_t *usrdatum;
-	unsigned int i, l;
-	ebitmap_node_t *cnode;
+	unsigned int l;
 
 	if (!p->mls)
 		return 1;
@@ -287,18 +286,16 @@ int mls_context_isvalid(const policydb_t * p, const context_struct_t * c)
 		if (!levdatum)
 			return 0;
 
-		ebitmap_for_each_bit(&c->range.level[l].cat, cnode, i) {
-			if (ebitmap_node_get_bit(cnode, i)) {
-				if (i > p->p_cats.nprim)
-					return 0;
-				if (!ebitmap_get_bit(&levdatum->level->cat, i))
-					/*
-					 * Category may not be associated with
-					 * sensitivity in low level.
-					 */
-					return 0;
-			}
-		}
+		if (ebitmap_highest_set_bit(&c->range.level[l].cat) >
+		    p->p_cats.nprim)
+			return 0;
+		if (!ebitmap_contains(&levdatum->level->cat,
+				      &c->range.level[l].cat))
+			/*
+			 * Category may not be associated with
+			 * sensitivity in low level.
+			 */
+			return 0;
 	}
 
 	if (c->role == OBJECT_R_VAL)
@@ -393,8 +390,6 @@ int mls_context_to_sid(const policydb_t * policydb,
 
 				/* If range, set all categories in range */
 				if (rngptr) {
-					unsigned int i;
-
 					rngdatum = (cat_datum_t *)
 					    hashtab_search(policydb->p_cats.
 							   table,
@@ -407,13 +402,11 @@ int mls_context_to_sid(const policydb_t * policydb,
 					    rngdatum->s.value)
 						goto err;
 
-					for (i = catdatum->s.value;
-					     i < rngdatum->s.value; i++) {
-						if (ebitmap_set_bit
-						    (&context->range.level[l].
-						     cat, i, 1))
-							goto err;
-					}
+					if (ebitmap_set_range
+					    (&context->range.level[l].cat,
+					     catdatum->s.value,
+					     rngdatum->s.value - 1))
+						goto err;
 				}
 
 				if (delim != ',')
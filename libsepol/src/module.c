@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <time.h>
 
 #define SEPOL_PACKAGE_SECTION_FC 0xf97cff90
 #define SEPOL_PACKAGE_SECTION_SEUSER 0x97cff91
@@ -341,28 +342,14 @@ int sepol_link_packages(sepol_handle_t * handle,
 	return 0;
 }
 
-/* buf must be large enough - no checks are performed */
-#define _read_helper_bufsize BUFSIZ
-static int read_helper(char *buf, struct policy_file *file, uint32_t bytes)
+/* buf must be large enough - no checks are performed.  The section is
+ * read with a single call, which for an in-memory file is one memcpy
+ * straight out of the mapped data. */
+static int read_helper(char *buf, struct policy_file *file, size_t bytes)
 {
-	uint32_t offset, nel, read_len;
-	int rc;
-
-	offset = 0;
-	nel = bytes;
-
-	while (nel) {
-		if (nel < _read_helper_bufsize)
-			read_len = nel;
-		else
-			read_len = _read_helper_bufsize;
-		rc = next_entry(&buf[offset], file, read_len);
-		if (rc < 0)
-			return -1;
-		offset += read_len;
-		nel -= read_len;
-	}
-	return 0;
+	if (!bytes)
+		return 0;
+	return next_entry(buf, file, bytes);
 }
 
 #define MAXSECTIONS 100
@@ -460,6 +447,37 @@ err:
 #define SEEN_USER_EXTRA 8
 #define SEEN_NETFILTER 16
 
+/* Read the body of one of the plain data sections of a module package,
+ * the magic number having already been consumed. */
+static int module_package_read_data(struct policy_file *file, unsigned i,
+				    size_t len, const char *name,
+				    char **data, size_t *data_len)
+{
+	*data_len = len - sizeof(uint32_t);
+	*data = (char *)malloc(*data_len);
+	if (!*data) {
+		ERR(file->handle, "out of memory");
+		return -1;
+	}
+	if (read_helper(*data, file, *data_len)) {
+		ERR(file->handle, "invalid %s section at section %u", name, i);
+		free(*data);
+		*data = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static long module_package_elapsed_usec(const struct timespec *start)
+{
+	struct timespec now;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now))
+		return 0;
+	return (now.tv_sec - start->tv_sec) * 1000000L +
+	    (now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
 int sepol_module_package_read(sepol_module_package_t * mod,
 			      struct sepol_policy_file *spf, int verbose)
 {
@@ -467,15 +485,26 @@ int sepol_module_package_read(sepol_module_package_t * mod,
 	uint32_t buf[1], nsec;
 	size_t *offsets, len;
 	int rc;
-	unsigned i, seen = 0;
+	unsigned i, seen = 0, flag;
+	const char *name;
+	char **data;
+	size_t *data_len;
+	struct timespec start;
 
 	if (module_package_read_offsets(mod, file, &offsets, &nsec))
 		return -1;
 
-	/* we know the section offsets, seek to them and read in the data */
+	/* we know the section offsets, seek to them and read in the data.
+	 * The sections are read in order on the calling thread: they come
+	 * from one policy file, which is a single stream when it is backed
+	 * by stdio.  Reading many packages concurrently is left to the
+	 * caller, which owns the files and handles involved. */
 
 	for (i = 0; i < nsec; i++) {
 
+		if (verbose)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+
 		if (policy_file_seek(file, offsets[i])) {
 			ERR(file->handle, "error seeking to offset %zu for "
 			    "module package section %u", offsets[i], i);
@@ -501,115 +530,55 @@ int sepol_module_package_read(sepol_module_package_t * mod,
 
 		switch (le32_to_cpu(buf[0])) {
 		case SEPOL_PACKAGE_SECTION_FC:
-			if (seen & SEEN_FC) {
-				ERR(file->handle,
-				    "found multiple file contexts sections in module package (at section %u)",
-				    i);
-				goto cleanup;
-			}
-
-			mod->file_contexts_len = len - sizeof(uint32_t);
-			mod->file_contexts =
-			    (char *)malloc(mod->file_contexts_len);
-			if (!mod->file_contexts) {
-				ERR(file->handle, "out of memory");
-				goto cleanup;
-			}
-			if (read_helper
-			    (mod->file_contexts, file,
-			     mod->file_contexts_len)) {
-				ERR(file->handle,
-				    "invalid file contexts section at section %u",
-				    i);
-				free(mod->file_contexts);
-				mod->file_contexts = NULL;
-				goto cleanup;
-			}
-			seen |= SEEN_FC;
+			flag = SEEN_FC;
+			name = "file contexts";
+			data = &mod->file_contexts;
+			data_len = &mod->file_contexts_len;
 			break;
 		case SEPOL_PACKAGE_SECTION_SEUSER:
-			if (seen & SEEN_SEUSER) {
-				ERR(file->handle,
-				    "found multiple seuser sections in module package (at section %u)",
-				    i);
-				goto cleanup;
-			}
-
-			mod->seusers_len = len - sizeof(uint32_t);
-			mod->seusers = (char *)malloc(mod->seusers_len);
-			if (!mod->seusers) {
-				ERR(file->handle, "out of memory");
-				goto cleanup;
-			}
-			if (read_helper(mod->seusers, file, mod->seusers_len)) {
-				ERR(file->handle,
-				    "invalid seuser section at section %u", i);
-				free(mod->seusers);
-				mod->seusers = NULL;
-				goto cleanup;
-			}
-			seen |= SEEN_SEUSER;
+			flag = SEEN_SEUSER;
+			name = "seuser";
+			data = &mod->seusers;
+			data_len = &mod->seusers_len;
 			break;
 		case SEPOL_PACKAGE_SECTION_USER_EXTRA:
-			if (seen & SEEN_USER_EXTRA) {
-				ERR(file->handle,
-				    "found multiple user_extra sections in module package (at section %u)",
-				    i);
-				goto cleanup;
-			}
-
-			mod->user_extra_len = len - sizeof(uint32_t);
-			mod->user_extra = (char *)malloc(mod->user_extra_len);
-			if (!mod->user_extra) {
-				ERR(file->handle, "out of memory");
-				goto cleanup;
-			}
-			if (read_helper
-			    (mod->user_extra, file, mod->user_extra_len)) {
-				ERR(file->handle,
-				    "invalid user_extra section at section %u",
-				    i);
-				free(mod->user_extra);
-				mod->user_extra = NULL;
-				goto cleanup;
-			}
-			seen |= SEEN_USER_EXTRA;
+			flag = SEEN_USER_EXTRA;
+			name = "user_extra";
+			data = &mod->user_extra;
+			data_len = &mod->user_extra_len;
 			break;
 		case SEPOL_PACKAGE_SECTION_NETFILTER:
-			if (seen & SEEN_NETFILTER) {
-				ERR(file->handle,
-				    "found multiple netfilter contexts sections in module package (at section %u)",
-				    i);
-				goto cleanup;
-			}
-
-			mod->netfilter_contexts_len = len - sizeof(uint32_t);
-			mod->netfilter_contexts =
-			    (char *)malloc(mod->netfilter_contexts_len);
-			if (!mod->netfilter_contexts) {
-				ERR(file->handle, "out of memory");
-				goto cleanup;
-			}
-			if (read_helper
-			    (mod->netfilter_contexts, file,
-			     mod->netfilter_contexts_len)) {
-				ERR(file->handle,
-				    "invalid netfilter contexts section at section %u",
-				    i);
-				free(mod->netfilter_contexts);
-				mod->netfilter_contexts = NULL;
-				goto cleanup;
-			}
-			seen |= SEEN_NETFILTER;
+			flag = SEEN_NETFILTER;
+			name = "netfilter contexts";
+			data = &mod->netfilter_contexts;
+			data_len = &mod->netfilter_contexts_len;
 			break;
 		case POLICYDB_MOD_MAGIC:
-			if (seen & SEEN_MOD) {
-				ERR(file->handle,
-				    "found multiple module sections in module package (at section %u)",
-				    i);
-				goto cleanup;
-			}
+			flag = SEEN_MOD;
+			name = "module";
+			data = NULL;
+			data_len = NULL;
+			break;
+		default:
+			/* unknown section, ignore */
+			ERR(file->handle,
+			    "unknown magic number at section %u, offset: %zx, number: %ux ",
+			    i, offsets[i], le32_to_cpu(buf[0]));
+			continue;
+		}
 
+		if (seen & flag) {
+			ERR(file->handle,
+			    "found multiple %s sections in module package (at section %u)",
+			    name, i);
+			goto cleanup;
+		}
+
+		if (data) {
+			if (module_package_read_data(file, i, len, name, data,
+						     data_len))
+				goto cleanup;
+		} else {
 			/* seek back to where the magic number was */
 			if (policy_file_seek(file, offsets[i]))
 				goto cleanup;
@@ -621,15 +590,13 @@ int sepol_module_package_read(sepol_module_package_t * mod,
 				    i);
 				goto cleanup;
 			}
-			seen |= SEEN_MOD;
-			break;
-		default:
-			/* unknown section, ignore */
-			ERR(file->handle,
-			    "unknown magic number at section %u, offset: %zx, number: %ux ",
-			    i, offsets[i], le32_to_cpu(buf[0]));
-			break;
 		}
+		seen |= flag;
+
+		if (verbose)
+			INFO(file->handle,
+			     "module package section %u: %s, %zu bytes, %ld us",
+			     i, name, len, module_package_elapsed_usec(&start));
 	}
 
 	if ((seen & SEEN_MOD) == 0) {
@@ -3636,6 +3636,15 @@ static int scope_read(policydb_t * p, int symnum, struct policy_file *fp)
  * representation file into a policy database structure.
  */
 int policydb_read(policydb_t * p, struct policy_file *fp, unsigned verbose)
+{
+	return policydb_read_sections(p, fp, verbose, POLICYDB_SECTION_ALL);
+}
+
+/* True if section s, or any section stored after it, was requested. */
+#define SECTION_NEEDED(sections, s) ((sections) >= (s))
+
+int policydb_read_sections(policydb_t * p, struct policy_file *fp,
+			   unsigned verbose, unsigned sections)
 {
 
 	unsigned int i, j, r_policyvers;
@@ -3777,6 +3786,10 @@ int policydb_read(policydb_t * p, struct policy_file *fp, unsigned verbose)
 
 	bufindex++;
 
+	if (policy_type != POLICY_KERN)
+		sections = POLICYDB_SECTION_ALL;
+	sections |= POLICYDB_SECTION_SYMTABS;
+
 	info = policydb_lookup_compat(r_policyvers, policy_type,
 					p->target_platform);
 	if (!info) {
@@ -3851,16 +3864,33 @@ int policydb_read(policydb_t * p, struct policy_file *fp, unsigned verbose)
 	}
 
 	if (policy_type == POLICY_KERN) {
-		if (avtab_read(&p->te_avtab, fp, r_policyvers))
+		if (SECTION_NEEDED(sections, POLICYDB_SECTION_AVTAB) &&
+		    avtab_read(&p->te_avtab, fp, r_policyvers))
 			goto bad;
-		if (r_policyvers >= POLICYDB_VERSION_BOOL)
+		if (SECTION_NEEDED(sections, POLICYDB_SECTION_CONDS) &&
+		    r_policyvers >= POLICYDB_VERSION_BOOL)
 			if (cond_read_list(p, &p->cond_list, fp))
 				goto bad;
-		if (role_trans_read(p, fp))
-			goto bad;
-		if (role_allow_read(&p->role_allow, fp))
-			goto bad;
-		if (r_policyvers >= POLICYDB_VERSION_FILENAME_TRANS &&
+		/* The rule tables had to be parsed to reach a later
+		 * section, but do not keep them if they were not asked for. */
+		if (!(sections & POLICYDB_SECTION_CONDS)) {
+			cond_list_destroy(p->cond_list);
+			p->cond_list = NULL;
+			avtab_destroy(&p->te_cond_avtab);
+			avtab_init(&p->te_cond_avtab);
+		}
+		if (!(sections & POLICYDB_SECTION_AVTAB)) {
+			avtab_destroy(&p->te_avtab);
+			avtab_init(&p->te_avtab);
+		}
+		if (SECTION_NEEDED(sections, POLICYDB_SECTION_ROLE_TRANS)) {
+			if (role_trans_read(p, fp))
+				goto bad;
+			if (role_allow_read(&p->role_allow, fp))
+				goto bad;
+		}
+		if (SECTION_NEEDED(sections, POLICYDB_SECTION_FILENAME_TRANS) &&
+		    r_policyvers >= POLICYDB_VERSION_FILENAME_TRANS &&
 		    filename_trans_read(&p->filename_trans, fp))
 			goto bad;
 	} else {
@@ -3892,25 +3922,29 @@ int policydb_read(policydb_t * p, struct policy_file *fp, unsigned verbose)
 	if (policydb_index_others(fp->handle, p, verbose))
 		goto bad;
 
-	if (ocontext_read(info, p, fp) == -1) {
+	if (SECTION_NEEDED(sections, POLICYDB_SECTION_OCONTEXTS) &&
+	    ocontext_read(info, p, fp) == -1) {
 		goto bad;
 	}
 
-	if (genfs_read(p, fp) == -1) {
+	if (SECTION_NEEDED(sections, POLICYDB_SECTION_GENFS) &&
+	    genfs_read(p, fp) == -1) {
 		goto bad;
 	}
 
-	if ((p->policy_type == POLICY_KERN
-	     && p->policyvers >= POLICYDB_VERSION_MLS)
-	    || (p->policy_type == POLICY_BASE
-		&& p->policyvers >= MOD_POLICYDB_VERSION_MLS
-		&& p->policyvers < MOD_POLICYDB_VERSION_RANGETRANS)) {
+	if (SECTION_NEEDED(sections, POLICYDB_SECTION_RANGE_TRANS) &&
+	    ((p->policy_type == POLICY_KERN
+	      && p->policyvers >= POLICYDB_VERSION_MLS)
+	     || (p->policy_type == POLICY_BASE
+		 && p->policyvers >= MOD_POLICYDB_VERSION_MLS
+		 && p->policyvers < MOD_POLICYDB_VERSION_RANGETRANS))) {
 		if (range_read(p, fp)) {
 			goto bad;
 		}
 	}
 
-	if (policy_type == POLICY_KERN) {
+	if (policy_type == POLICY_KERN &&
+	    (sections & POLICYDB_SECTION_TYPE_ATTR_MAP)) {
 		p->type_attr_map = malloc(p->p_types.nprim * sizeof(ebitmap_t));
 		p->attr_type_map = malloc(p->p_types.nprim * sizeof(ebitmap_t));
 		if (!p->type_attr_map || !p->attr_type_map)
@@ -0,0 +1,914 @@
+/*
+ * Semantic comparison of two policies.
+ *
+ * Every item of a policy is rendered as a line of text that only
+ * depends on symbol names, never on symbol values, e.g.
+ * "allow\tfoo_t bar_t:file read".  Both policies are loaded into hash
+ * tables of such lines and each table is probed with the lines of the
+ * other, so the comparison is linear in the size of the policies.
+ * Access vectors are split into one line per permission so that a
+ * changed rule shows up as the permissions that were added or removed.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <sepol/policydb/policydb.h>
+#include <sepol/policydb/conditional.h>
+#include <sepol/policydb/hashtab.h>
+#include <sepol/policydb/polcaps.h>
+#include <sepol/policydb/services.h>
+
+#include "debug.h"
+#include "context.h"
+#include "mls.h"
+#include "policydb_internal.h"
+
+#define DIFF_TABLE_SIZE 1024
+
+/* Permissions are bits of a 32-bit access vector */
+#define DIFF_MAX_PERMS 32
+
+struct diff_state {
+	sepol_handle_t *handle;
+	policydb_t *p;
+	hashtab_t lines;
+	/* perm_names[class - 1][perm - 1], including common permissions */
+	char *(*perm_names)[DIFF_MAX_PERMS];
+};
+
+static unsigned int diff_hash(hashtab_t h, hashtab_key_t key)
+{
+	return hashtab_hash_string(h, key);
+}
+
+static int diff_cmp(hashtab_t h __attribute__ ((unused)),
+		    hashtab_key_t key1, hashtab_key_t key2)
+{
+	return strcmp(key1, key2);
+}
+
+static int diff_add(struct diff_state *s, const char *kind,
+		    const char *fmt, ...)
+	__attribute__ ((format(printf, 3, 4)));
+
+/* Add the line "<kind>\t<item>" to the set of lines of the policy. */
+static int diff_add(struct diff_state *s, const char *kind,
+		    const char *fmt, ...)
+{
+	va_list ap;
+	char *item = NULL, *line = NULL;
+	int rc;
+
+	va_start(ap, fmt);
+	rc = vasprintf(&item, fmt, ap);
+	va_end(ap);
+	if (rc < 0)
+		goto omem;
+
+	rc = asprintf(&line, "%s\t%s", kind, item);
+	free(item);
+	if (rc < 0)
+		goto omem;
+
+	rc = hashtab_insert(s->lines, line, line);
+	if (rc == SEPOL_EEXIST) {
+		free(line);
+		return 0;
+	}
+	if (rc)
+		goto omem;
+
+	return 0;
+
+      omem:
+	ERR(s->handle, "out of memory");
+	return -1;
+}
+
+static int diff_perm_name(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	char **names = args;
+	perm_datum_t *perm = datum;
+
+	if (perm->s.value >= 1 && perm->s.value <= DIFF_MAX_PERMS)
+		names[perm->s.value - 1] = key;
+	return 0;
+}
+
+static int diff_index_perms(struct diff_state *s)
+{
+	policydb_t *p = s->p;
+	class_datum_t *cladatum;
+	uint32_t i;
+
+	s->perm_names = calloc(p->p_classes.nprim ? p->p_classes.nprim : 1,
+			       sizeof(*s->perm_names));
+	if (!s->perm_names) {
+		ERR(s->handle, "out of memory");
+		return -1;
+	}
+
+	for (i = 0; i < p->p_classes.nprim; i++) {
+		cladatum = p->class_val_to_struct[i];
+		if (!cladatum)
+			continue;
+		hashtab_map(cladatum->permissions.table, diff_perm_name,
+			    s->perm_names[i]);
+		if (cladatum->comdatum)
+			hashtab_map(cladatum->comdatum->permissions.table,
+				    diff_perm_name, s->perm_names[i]);
+	}
+
+	return 0;
+}
+
+/* Set *str to the string form of an MLS range, or to NULL on a non-MLS
+ * policy.  Returns -1 if out of memory. */
+static int diff_range_str(struct diff_state *s, mls_range_t * range,
+			  char **str)
+{
+	context_struct_t c;
+	char *ptr;
+	int len;
+
+	*str = NULL;
+	if (!s->p->mls)
+		return 0;
+
+	context_init(&c);
+	c.range = *range;
+	len = mls_compute_context_len(s->p, &c);
+	*str = malloc(len + 1);
+	if (!*str) {
+		ERR(s->handle, "out of memory");
+		return -1;
+	}
+	ptr = *str;
+	mls_sid_to_context(s->p, &c, &ptr);
+	*ptr = '\0';
+	/* skip the leading ':' */
+	memmove(*str, *str + 1, len);
+	return 0;
+}
+
+static int diff_add_context(struct diff_state *s, const char *kind,
+			    const char *item, context_struct_t * c)
+{
+	char *str = NULL;
+	size_t len;
+	int rc;
+
+	if (context_to_string(s->handle, s->p, c, &str, &len) < 0)
+		return -1;
+	rc = diff_add(s, kind, "%s %s", item, str);
+	free(str);
+	return rc;
+}
+
+/* Symbols */
+
+static int diff_common(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	common_datum_t *comdatum = datum;
+	char *names[DIFF_MAX_PERMS] = { NULL };
+	unsigned int i;
+
+	if (diff_add(s, "common", "%s", key))
+		return -1;
+
+	hashtab_map(comdatum->permissions.table, diff_perm_name, names);
+	for (i = 0; i < DIFF_MAX_PERMS; i++) {
+		if (names[i] && diff_add(s, "common", "%s %s", key, names[i]))
+			return -1;
+	}
+	return 0;
+}
+
+static const char *diff_default_str(int value)
+{
+	switch (value) {
+	case DEFAULT_SOURCE:
+		return "source";
+	case DEFAULT_TARGET:
+		return "target";
+	default:
+		return "unknown";
+	}
+}
+
+static const char *diff_default_range_str(int value)
+{
+	switch (value) {
+	case DEFAULT_SOURCE_LOW:
+		return "source low";
+	case DEFAULT_SOURCE_HIGH:
+		return "source high";
+	case DEFAULT_SOURCE_LOW_HIGH:
+		return "source low-high";
+	case DEFAULT_TARGET_LOW:
+		return "target low";
+	case DEFAULT_TARGET_HIGH:
+		return "target high";
+	case DEFAULT_TARGET_LOW_HIGH:
+		return "target low-high";
+	default:
+		return "unknown";
+	}
+}
+
+static int diff_class(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	class_datum_t *cladatum = datum;
+	char *names[DIFF_MAX_PERMS] = { NULL };
+	unsigned int i;
+
+	if (diff_add(s, "class", "%s", key))
+		return -1;
+
+	if ((cladatum->default_user &&
+	     diff_add(s, "default_user", "%s %s", key,
+		      diff_default_str(cladatum->default_user))) ||
+	    (cladatum->default_role &&
+	     diff_add(s, "default_role", "%s %s", key,
+		      diff_default_str(cladatum->default_role))) ||
+	    (cladatum->default_type &&
+	     diff_add(s, "default_type", "%s %s", key,
+		      diff_default_str(cladatum->default_type))) ||
+	    (cladatum->default_range &&
+	     diff_add(s, "default_range", "%s %s", key,
+		      diff_default_range_str(cladatum->default_range))))
+		return -1;
+
+	if (cladatum->comdatum &&
+	    diff_add(s, "class", "%s inherits %s", key,
+		     s->p->p_common_val_to_name[cladatum->comdatum->s.value - 1]))
+		return -1;
+
+	hashtab_map(cladatum->permissions.table, diff_perm_name, names);
+	for (i = 0; i < DIFF_MAX_PERMS; i++) {
+		if (names[i] && diff_add(s, "class", "%s %s", key, names[i]))
+			return -1;
+	}
+	return 0;
+}
+
+static int diff_role(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	role_datum_t *role = datum;
+	ebitmap_node_t *node;
+	unsigned int i;
+
+	if (diff_add(s, role->flavor == ROLE_ATTRIB ? "attribute_role" : "role",
+		     "%s", key))
+		return -1;
+
+	ebitmap_for_each_bit(&role->types.types, node, i) {
+		if (!ebitmap_node_get_bit(node, i))
+			continue;
+		if (diff_add(s, "roletype", "%s %s", key,
+			     s->p->p_type_val_to_name[i]))
+			return -1;
+	}
+	if (role->bounds &&
+	    diff_add(s, "rolebounds", "%s %s",
+		     s->p->p_role_val_to_name[role->bounds - 1], key))
+		return -1;
+	return 0;
+}
+
+static int diff_type(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	policydb_t *p = s->p;
+	type_datum_t *type = datum;
+	char *primary = p->p_type_val_to_name[type->s.value - 1];
+	ebitmap_node_t *node;
+	unsigned int i;
+
+	if (strcmp(key, primary))
+		return diff_add(s, "typealias", "%s %s", key, primary);
+
+	if (type->flavor == TYPE_ATTRIB)
+		return diff_add(s, "attribute", "%s", key);
+
+	if (diff_add(s, "type", "%s", key))
+		return -1;
+
+	if (type->bounds &&
+	    diff_add(s, "typebounds", "%s %s",
+		     p->p_type_val_to_name[type->bounds - 1], key))
+		return -1;
+
+	if (ebitmap_get_bit(&p->permissive_map, type->s.value) &&
+	    diff_add(s, "permissive", "%s", key))
+		return -1;
+
+	if (!p->type_attr_map)
+		return 0;
+
+	ebitmap_for_each_bit(&p->type_attr_map[type->s.value - 1], node, i) {
+		if (!ebitmap_node_get_bit(node, i) || i == type->s.value - 1)
+			continue;
+		if (diff_add(s, "typeattribute", "%s %s", key,
+			     p->p_type_val_to_name[i]))
+			return -1;
+	}
+	return 0;
+}
+
+static int diff_user(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	user_datum_t *user = datum;
+	ebitmap_node_t *node;
+	unsigned int i;
+	char *str;
+	int rc;
+
+	if (diff_add(s, "user", "%s", key))
+		return -1;
+
+	ebitmap_for_each_bit(&user->roles.roles, node, i) {
+		if (!ebitmap_node_get_bit(node, i))
+			continue;
+		if (diff_add(s, "userrole", "%s %s", key,
+			     s->p->p_role_val_to_name[i]))
+			return -1;
+	}
+	if (user->bounds &&
+	    diff_add(s, "userbounds", "%s %s",
+		     s->p->p_user_val_to_name[user->bounds - 1], key))
+		return -1;
+
+	if (diff_range_str(s, &user->exp_range, &str))
+		return -1;
+	if (str) {
+		rc = diff_add(s, "userrange", "%s %s", key, str);
+		free(str);
+		if (rc)
+			return -1;
+	}
+	return 0;
+}
+
+static int diff_bool(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	cond_bool_datum_t *booldatum = datum;
+
+	return diff_add(s, (booldatum->flags & COND_BOOL_FLAGS_TUNABLE) ?
+			"tunable" : "bool", "%s %s", key,
+			booldatum->state ? "true" : "false");
+}
+
+static int diff_level(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	level_datum_t *levdatum = datum;
+	char *primary = s->p->p_sens_val_to_name[levdatum->level->sens - 1];
+	ebitmap_node_t *node;
+	unsigned int i;
+
+	if (levdatum->isalias || strcmp(key, primary))
+		return diff_add(s, "sensitivityalias", "%s %s", key, primary);
+
+	if (diff_add(s, "sensitivity", "%s", key))
+		return -1;
+
+	ebitmap_for_each_bit(&levdatum->level->cat, node, i) {
+		if (!ebitmap_node_get_bit(node, i))
+			continue;
+		if (diff_add(s, "sensitivitycategory", "%s %s", key,
+			     s->p->p_cat_val_to_name[i]))
+			return -1;
+	}
+	return 0;
+}
+
+static int diff_cat(hashtab_key_t key, hashtab_datum_t datum, void *args)
+{
+	struct diff_state *s = args;
+	cat_datum_t *catdatum = datum;
+	char *primary = s->p->p_cat_val_to_name[catdatum->s.value - 1];
+
+	if (catdatum->isalias || strcmp(key, primary))
+		return diff_add(s, "categoryalias", "%s %s", key, primary);
+
+	return diff_add(s, "category", "%s", key);
+}
+
+static int (*diff_symtab[SYM_NUM]) (hashtab_key_t key, hashtab_datum_t datum,
+				     void *args) = {
+diff_common, diff_class, diff_role, diff_type, diff_user,
+	    diff_bool, diff_level, diff_cat};
+
+/* Rules */
+
+static int diff_avtab_node(struct diff_state *s, avtab_key_t * k,
+			   avtab_datum_t * d, const char *cond)
+{
+	policydb_t *p = s->p;
+	char *src = p->p_type_val_to_name[k->source_type - 1];
+	char *tgt = p->p_type_val_to_name[k->target_type - 1];
+	char *cls = p->p_class_val_to_name[k->target_class - 1];
+	char **perms = s->perm_names[k->target_class - 1];
+	uint16_t specified = k->specified & ~(AVTAB_ENABLED | AVTAB_ENABLED_OLD);
+	const char *kind;
+	unsigned int i;
+	uint32_t data;
+	int rc;
+
+	if (specified & AVTAB_AV) {
+		data = d->data;
+		if (specified & AVTAB_ALLOWED) {
+			kind = "allow";
+		} else if (specified & AVTAB_AUDITALLOW) {
+			kind = "auditallow";
+		} else {
+			/* auditdeny holds the permissions that are audited */
+			kind = "dontaudit";
+			data = ~data;
+		}
+		for (i = 0; i < DIFF_MAX_PERMS; i++) {
+			if (!(data & (1U << i)) || !perms[i])
+				continue;
+			if (diff_add(s, kind, "%s %s:%s %s%s", src, tgt, cls,
+				     perms[i], cond))
+				return -1;
+		}
+	} else if (specified & AVTAB_TYPE) {
+		if (specified & AVTAB_TRANSITION)
+			kind = "type_transition";
+		else if (specified & AVTAB_MEMBER)
+			kind = "type_member";
+		else
+			kind = "type_change";
+		return diff_add(s, kind, "%s %s:%s %s%s", src, tgt, cls,
+				p->p_type_val_to_name[d->data - 1], cond);
+	} else if ((specified & AVTAB_XPERMS) && d->xperms) {
+		if (specified & AVTAB_XPERMS_ALLOWED)
+			kind = "allowxperm";
+		else if (specified & AVTAB_XPERMS_AUDITALLOW)
+			kind = "auditallowxperm";
+		else
+			kind = "dontauditxperm";
+		for (i = 0; i < 256; i++) {
+			if (!(d->xperms->perms[i / 32] & (1U << (i % 32))))
+				continue;
+			if (d->xperms->specified == AVTAB_XPERMS_IOCTLFUNCTION)
+				rc = diff_add(s, kind, "%s %s:%s ioctl 0x%04x%s",
+					      src, tgt, cls,
+					      (d->xperms->driver << 8) | i,
+					      cond);
+			else
+				/* every function of driver i */
+				rc = diff_add(s, kind,
+					      "%s %s:%s ioctl 0x%02x00-0x%02xff%s",
+					      src, tgt, cls, i, i, cond);
+			if (rc)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int diff_avtab(struct diff_state *s)
+{
+	avtab_t *avtab = &s->p->te_avtab;
+	avtab_ptr_t node;
+	uint32_t i;
+
+	for (i = 0; i < avtab->nslot; i++) {
+		for (node = avtab->htable[i]; node; node = node->next) {
+			if (diff_avtab_node(s, &node->key, &node->datum, ""))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* The expression in reverse polish notation, e.g. "a b &&" */
+static char *diff_cond_expr_str(struct diff_state *s, cond_expr_t * expr)
+{
+	static const char *ops[] = {
+		NULL, NULL, "!", "||", "&&", "^", "==", "!="
+	};
+	size_t len = 0, n;
+	char *str = NULL, *tmp;
+	const char *tok;
+
+	for (; expr; expr = expr->next) {
+		if (expr->expr_type == COND_BOOL)
+			tok = s->p->p_bool_val_to_name[expr->bool - 1];
+		else if (expr->expr_type <= COND_LAST)
+			tok = ops[expr->expr_type];
+		else
+			tok = "?";
+		n = strlen(tok);
+		tmp = realloc(str, len + n + 2);
+		if (!tmp) {
+			free(str);
+			return NULL;
+		}
+		str = tmp;
+		if (len)
+			str[len++] = ' ';
+		memcpy(str + len, tok, n + 1);
+		len += n;
+	}
+	return str ? str : strdup("");
+}
+
+static int diff_cond_list(struct diff_state *s, cond_av_list_t * list,
+			  const char *expr, const char *branch)
+{
+	char *cond;
+	int rc = 0;
+
+	if (asprintf(&cond, " if (%s) %s", expr, branch) < 0) {
+		ERR(s->handle, "out of memory");
+		return -1;
+	}
+	for (; list; list = list->next) {
+		rc = diff_avtab_node(s, &list->node->key, &list->node->datum,
+				     cond);
+		if (rc)
+			break;
+	}
+	free(cond);
+	return rc;
+}
+
+static int diff_conds(struct diff_state *s)
+{
+	cond_list_t *cur;
+	char *expr;
+	int rc;
+
+	for (cur = s->p->cond_list; cur; cur = cur->next) {
+		expr = diff_cond_expr_str(s, cur->expr);
+		if (!expr) {
+			ERR(s->handle, "out of memory");
+			return -1;
+		}
+		rc = diff_cond_list(s, cur->true_list, expr, "true");
+		if (!rc)
+			rc = diff_cond_list(s, cur->false_list, expr, "false");
+		free(expr);
+		if (rc)
+			return -1;
+	}
+	return 0;
+}
+
+static int diff_transitions(struct diff_state *s)
+{
+	policydb_t *p = s->p;
+	role_trans_t *rt;
+	role_allow_t *ra;
+	filename_trans_t *ft;
+	range_trans_t *rtr;
+	char *str;
+	int rc;
+
+	for (rt = p->role_tr; rt; rt = rt->next) {
+		if (diff_add(s, "role_transition", "%s %s:%s %s",
+			     p->p_role_val_to_name[rt->role - 1],
+			     p->p_type_val_to_name[rt->type - 1],
+			     p->p_class_val_to_name[rt->tclass - 1],
+			     p->p_role_val_to_name[rt->new_role - 1]))
+			return -1;
+	}
+
+	for (ra = p->role_allow; ra; ra = ra->next) {
+		if (diff_add(s, "role_allow", "%s %s",
+			     p->p_role_val_to_name[ra->role - 1],
+			     p->p_role_val_to_name[ra->new_role - 1]))
+			return -1;
+	}
+
+	for (ft = p->filename_trans; ft; ft = ft->next) {
+		if (diff_add(s, "type_transition", "%s %s:%s %s \"%s\"",
+			     p->p_type_val_to_name[ft->stype - 1],
+			     p->p_type_val_to_name[ft->ttype - 1],
+			     p->p_class_val_to_name[ft->tclass - 1],
+			     p->p_type_val_to_name[ft->otype - 1], ft->name))
+			return -1;
+	}
+
+	for (rtr = p->range_tr; rtr; rtr = rtr->next) {
+		if (diff_range_str(s, &rtr->target_range, &str))
+			return -1;
+		if (!str)
+			continue;
+		rc = diff_add(s, "range_transition", "%s %s:%s %s",
+			      p->p_type_val_to_name[rtr->source_type - 1],
+			      p->p_type_val_to_name[rtr->target_type - 1],
+			      p->p_class_val_to_name[rtr->target_class - 1],
+			      str);
+		free(str);
+		if (rc)
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Labeling */
+
+static int diff_ocontexts(struct diff_state *s)
+{
+	policydb_t *p = s->p;
+	ocontext_t *c;
+	genfs_t *genfs;
+	char addr[INET6_ADDRSTRLEN], mask[INET6_ADDRSTRLEN];
+	char *item;
+	int rc;
+
+	if (p->target_platform != SEPOL_TARGET_SELINUX)
+		return 0;
+
+	for (c = p->ocontexts[OCON_ISID]; c; c = c->next) {
+		/* Initial SIDs read from a binary policy only have a value */
+		if (c->u.name) {
+			rc = diff_add_context(s, "sid", c->u.name,
+					      &c->context[0]);
+		} else {
+			if (asprintf(&item, "%u", c->sid[0]) < 0)
+				goto omem;
+			rc = diff_add_context(s, "sid", item, &c->context[0]);
+			free(item);
+		}
+		if (rc)
+			return -1;
+	}
+	for (c = p->ocontexts[OCON_FS]; c; c = c->next) {
+		if (diff_add_context(s, "fscon", c->u.name, &c->context[0]) ||
+		    diff_add_context(s, "fscon", c->u.name, &c->context[1]))
+			return -1;
+	}
+	for (c = p->ocontexts[OCON_PORT]; c; c = c->next) {
+		if (asprintf(&item, "%s %u-%u",
+			     c->u.port.protocol == IPPROTO_TCP ? "tcp" :
+			     c->u.port.protocol == IPPROTO_UDP ? "udp" : "dccp",
+			     c->u.port.low_port, c->u.port.high_port) < 0)
+			goto omem;
+		rc = diff_add_context(s, "portcon", item, &c->context[0]);
+		free(item);
+		if (rc)
+			return -1;
+	}
+	for (c = p->ocontexts[OCON_NETIF]; c; c = c->next) {
+		if (asprintf(&item, "%s interface", c->u.name) < 0)
+			goto omem;
+		rc = diff_add_context(s, "netifcon", item, &c->context[0]);
+		free(item);
+		if (rc)
+			return -1;
+		if (asprintf(&item, "%s packet", c->u.name) < 0)
+			goto omem;
+		rc = diff_add_context(s, "netifcon", item, &c->context[1]);
+		free(item);
+		if (rc)
+			return -1;
+	}
+	for (c = p->ocontexts[OCON_NODE]; c; c = c->next) {
+		if (!inet_ntop(AF_INET, &c->u.node.addr, addr, sizeof(addr)) ||
+		    !inet_ntop(AF_INET, &c->u.node.mask, mask, sizeof(mask)))
+			continue;
+		if (asprintf(&item, "%s %s", addr, mask) < 0)
+			goto omem;
+		rc = diff_add_context(s, "nodecon", item, &c->context[0]);
+		free(item);
+		if (rc)
+			return -1;
+	}
+	for (c = p->ocontexts[OCON_NODE6]; c; c = c->next) {
+		if (!inet_ntop(AF_INET6, c->u.node6.addr, addr, sizeof(addr)) ||
+		    !inet_ntop(AF_INET6, c->u.node6.mask, mask, sizeof(mask)))
+			continue;
+		if (asprintf(&item, "%s %s", addr, mask) < 0)
+			goto omem;
+		rc = diff_add_context(s, "nodecon", item, &c->context[0]);
+		free(item);
+		if (rc)
+			return -1;
+	}
+	for (c = p->ocontexts[OCON_FSUSE]; c; c = c->next) {
+		if (asprintf(&item, "%s %s",
+			     c->v.behavior == SECURITY_FS_USE_XATTR ? "xattr" :
+			     c->v.behavior == SECURITY_FS_USE_TRANS ? "trans" :
+			     "task", c->u.name) < 0)
+			goto omem;
+		rc = diff_add_context(s, "fsuse", item, &c->context[0]);
+		free(item);
+		if (rc)
+			return -1;
+	}
+
+	for (genfs = p->genfs; genfs; genfs = genfs->next) {
+		for (c = genfs->head; c; c = c->next) {
+			if (asprintf(&item, "%s %s%s%s", genfs->fstype,
+				     c->u.name, c->v.sclass ? " " : "",
+				     c->v.sclass ?
+				     p->p_class_val_to_name[c->v.sclass - 1] :
+				     "") < 0)
+				goto omem;
+			rc = diff_add_context(s, "genfscon", item,
+					      &c->context[0]);
+			free(item);
+			if (rc)
+				return -1;
+		}
+	}
+
+	return 0;
+
+      omem:
+	ERR(s->handle, "out of memory");
+	return -1;
+}
+
+static int diff_policy(struct diff_state *s)
+{
+	policydb_t *p = s->p;
+	ebitmap_node_t *node;
+	const char *name;
+	unsigned int i;
+
+	if (diff_add(s, "mls", "%s", p->mls ? "true" : "false") ||
+	    diff_add(s, "handle_unknown", "%s",
+		     p->handle_unknown == DENY_UNKNOWN ? "deny" :
+		     p->handle_unknown == REJECT_UNKNOWN ? "reject" : "allow"))
+		return -1;
+
+	ebitmap_for_each_bit(&p->policycaps, node, i) {
+		if (!ebitmap_node_get_bit(node, i))
+			continue;
+		name = sepol_polcap_getname(i);
+		if (name ? diff_add(s, "policycap", "%s", name) :
+		    diff_add(s, "policycap", "%u", i))
+			return -1;
+	}
+
+	for (i = 0; i < SYM_NUM; i++) {
+		if (hashtab_map(p->symtab[i].table, diff_symtab[i], s))
+			return -1;
+	}
+
+	if (diff_avtab(s) || diff_conds(s) || diff_transitions(s) ||
+	    diff_ocontexts(s))
+		return -1;
+
+	return 0;
+}
+
+static int diff_line_destroy(hashtab_key_t key,
+			     hashtab_datum_t datum __attribute__ ((unused)),
+			     void *args __attribute__ ((unused)))
+{
+	free(key);
+	return 0;
+}
+
+static void diff_state_destroy(struct diff_state *s)
+{
+	if (s->lines) {
+		hashtab_map(s->lines, diff_line_destroy, NULL);
+		hashtab_destroy(s->lines);
+	}
+	free(s->perm_names);
+	s->lines = NULL;
+	s->perm_names = NULL;
+}
+
+static int diff_state_init(struct diff_state *s, sepol_handle_t * handle,
+			   policydb_t * p)
+{
+	memset(s, 0, sizeof(*s));
+	s->handle = handle;
+	s->p = p;
+	s->lines = hashtab_create(diff_hash, diff_cmp, DIFF_TABLE_SIZE);
+	if (!s->lines) {
+		ERR(handle, "out of memory");
+		return -1;
+	}
+	if (diff_index_perms(s) || diff_policy(s)) {
+		diff_state_destroy(s);
+		return -1;
+	}
+	return 0;
+}
+
+struct diff_result {
+	char sign;
+	char *line;
+};
+
+struct diff_results {
+	hashtab_t other;
+	char sign;
+	struct diff_result *res;
+	uint32_t nres;
+};
+
+static int diff_find_missing(hashtab_key_t key,
+			     hashtab_datum_t datum __attribute__ ((unused)),
+			     void *args)
+{
+	struct diff_results *r = args;
+
+	if (hashtab_search(r->other, key))
+		return 0;
+	r->res[r->nres].sign = r->sign;
+	r->res[r->nres].line = key;
+	r->nres++;
+	return 0;
+}
+
+static int diff_result_cmp(const void *a, const void *b)
+{
+	const struct diff_result *x = a;
+	const struct diff_result *y = b;
+	int rc = strcmp(x->line, y->line);
+
+	if (rc)
+		return rc;
+	return x->sign - y->sign;
+}
+
+int sepol_policydb_diff(sepol_handle_t * handle,
+			const sepol_policydb_t * oldp,
+			const sepol_policydb_t * newp, FILE * fp)
+{
+	struct diff_state olds, news;
+	struct diff_results r;
+	uint32_t i;
+	int rc = -1;
+
+	memset(&olds, 0, sizeof(olds));
+	memset(&news, 0, sizeof(news));
+	memset(&r, 0, sizeof(r));
+
+	/* Rules are only compared as found in the expanded te_avtab and
+	 * cond_list, which base and module policies do not fill in. */
+	if (oldp->p.policy_type != POLICY_KERN ||
+	    newp->p.policy_type != POLICY_KERN) {
+		ERR(handle, "only kernel policies can be compared");
+		goto out;
+	}
+
+	if (diff_state_init(&olds, handle, (policydb_t *) & oldp->p) ||
+	    diff_state_init(&news, handle, (policydb_t *) & newp->p))
+		goto out;
+
+	r.res = malloc((olds.lines->nel + news.lines->nel + 1) *
+		       sizeof(*r.res));
+	if (!r.res) {
+		ERR(handle, "out of memory");
+		goto out;
+	}
+
+	r.other = olds.lines;
+	r.sign = '+';
+	hashtab_map(news.lines, diff_find_missing, &r);
+	r.other = news.lines;
+	r.sign = '-';
+	hashtab_map(olds.lines, diff_find_missing, &r);
+
+	qsort(r.res, r.nres, sizeof(*r.res), diff_result_cmp);
+	for (i = 0; i < r.nres; i++)
+		fprintf(fp, "%c\t%s\n", r.res[i].sign, r.res[i].line);
+
+	rc = r.nres;
+
+      out:
+	free(r.res);
+	diff_state_destroy(&olds);
+	diff_state_destroy(&news);
+	return rc;
+}
@@ -73,85 +73,201 @@
 
 static int selinux_enforcing = 1;
 
-static sidtab_t mysidtab, *sidtab = &mysidtab;
-static policydb_t mypolicydb, *policydb = &mypolicydb;
-
-/* Used by sepol_compute_av_reason_buffer() to keep track of entries */
-static int reason_buf_used;
-static int reason_buf_len;
+/*
+ * Optional precomputed access matrix, see sepol_secserver_precompute_av().
+ * Row i holds the entries for source type i + 1, sorted by target type
+ * and class.  Unconditional rules are folded into the access vectors,
+ * while conditional rules are kept as avtab nodes so that boolean
+ * changes are honoured at query time.
+ */
+typedef struct avmatrix_entry {
+	uint32_t target_type;
+	uint32_t target_class;
+	sepol_access_vector_t allowed;
+	sepol_access_vector_t auditallow;
+	sepol_access_vector_t auditdeny;
+	uint32_t cond_start;	/* index into cond_nodes */
+	uint32_t cond_count;
+} avmatrix_entry_t;
+
+typedef struct avmatrix {
+	uint32_t nrows;
+	uint32_t *row_start;	/* nrows + 1 offsets into entries */
+	avmatrix_entry_t *entries;
+	avtab_ptr_t *cond_nodes;
+} avmatrix_t;
+
+static void avmatrix_destroy(avmatrix_t * m)
+{
+	if (!m)
+		return;
 
-/* Stack services for RPN to infix conversion. */
-static char **stack;
-static int stack_len;
-static int next_stack_entry;
+	free(m->row_start);
+	free(m->entries);
+	free(m->cond_nodes);
+	free(m);
+}
 
-static void push(char *expr_ptr)
+/*
+ * A security server: the policydb and sidtab it serves, plus the
+ * scratch state used while evaluating constraints.  Nothing here is
+ * shared between servers.
+ */
+struct sepol_secserver {
+	policydb_t *policydb;
+	sidtab_t *sidtab;
+
+	/* Storage used unless sepol_set_policydb/sidtab() were called */
+	policydb_t mypolicydb;
+	sidtab_t mysidtab;
+
+	/* Used by sepol_compute_av_reason_buffer() to keep track of entries */
+	int reason_buf_used;
+	int reason_buf_len;
+
+	/* Stack services for RPN to infix conversion. */
+	char **stack;
+	int stack_len;
+	int next_stack_entry;
+
+	/* Expression text buffers, see cat_expr_buf() */
+	int expr_counter;
+	char **expr_list;
+	int expr_buf_used;
+	int expr_buf_len;
+
+	avmatrix_t *avmatrix;
+};
+
+/* The server used by the service functions without a server argument. */
+static sepol_secserver_t mysecserver = {
+	.policydb = &mysecserver.mypolicydb,
+	.sidtab = &mysecserver.mysidtab,
+};
+
+static void push(sepol_secserver_t * srv, char *expr_ptr)
 {
-	if (next_stack_entry >= stack_len) {
-		char **new_stack = stack;
+	if (srv->next_stack_entry >= srv->stack_len) {
+		char **new_stack = srv->stack;
 		int new_stack_len;
 
-		if (stack_len == 0)
+		if (srv->stack_len == 0)
 			new_stack_len = STACK_LEN;
 		else
-			new_stack_len = stack_len * 2;
+			new_stack_len = srv->stack_len * 2;
 
-		new_stack = realloc(stack, new_stack_len * sizeof(*stack));
+		new_stack = realloc(srv->stack,
+				    new_stack_len * sizeof(*srv->stack));
 		if (!new_stack) {
 			ERR(NULL, "unable to allocate stack space");
 			return;
 		}
-		stack_len = new_stack_len;
-		stack = new_stack;
+		srv->stack_len = new_stack_len;
+		srv->stack = new_stack;
 	}
-	stack[next_stack_entry] = expr_ptr;
-	next_stack_entry++;
+	srv->stack[srv->next_stack_entry] = expr_ptr;
+	srv->next_stack_entry++;
 }
 
-static char *pop(void)
+static char *pop(sepol_secserver_t * srv)
 {
-	next_stack_entry--;
-	if (next_stack_entry < 0) {
-		next_stack_entry = 0;
+	srv->next_stack_entry--;
+	if (srv->next_stack_entry < 0) {
+		srv->next_stack_entry = 0;
 		ERR(NULL, "pop called with no stack entries");
 		return NULL;
 	}
-	return stack[next_stack_entry];
+	return srv->stack[srv->next_stack_entry];
 }
 /* End Stack services */
 
 int hidden sepol_set_sidtab(sidtab_t * s)
 {
-	sidtab = s;
+	mysecserver.sidtab = s;
 	return 0;
 }
 
 int hidden sepol_set_policydb(policydb_t * p)
 {
-	policydb = p;
+	avmatrix_destroy(mysecserver.avmatrix);
+	mysecserver.avmatrix = NULL;
+	mysecserver.policydb = p;
 	return 0;
 }
 
 int sepol_set_policydb_from_file(FILE * fp)
 {
 	struct policy_file pf;
+	policydb_t *mypolicydb = &mysecserver.mypolicydb;
+
+	policy_file_init(&pf);
+	pf.fp = fp;
+	pf.type = PF_USE_STDIO;
+	avmatrix_destroy(mysecserver.avmatrix);
+	mysecserver.avmatrix = NULL;
+	if (mypolicydb->policy_type)
+		policydb_destroy(mypolicydb);
+	if (policydb_init(mypolicydb)) {
+		ERR(NULL, "Out of memory!");
+		return -1;
+	}
+	if (policydb_read(mypolicydb, &pf, 0)) {
+		policydb_destroy(mypolicydb);
+		ERR(NULL, "can't read binary policy: %s", strerror(errno));
+		return -1;
+	}
+	mysecserver.policydb = mypolicydb;
+	return sepol_sidtab_init(mysecserver.sidtab);
+}
+
+int sepol_secserver_create(sepol_secserver_t ** srv, FILE * fp)
+{
+	struct policy_file pf;
+	sepol_secserver_t *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		ERR(NULL, "Out of memory!");
+		return -1;
+	}
+	s->policydb = &s->mypolicydb;
+	s->sidtab = &s->mysidtab;
 
 	policy_file_init(&pf);
 	pf.fp = fp;
 	pf.type = PF_USE_STDIO;
-	if (mypolicydb.policy_type)
-		policydb_destroy(&mypolicydb);
-	if (policydb_init(&mypolicydb)) {
+	if (policydb_init(s->policydb)) {
 		ERR(NULL, "Out of memory!");
+		free(s);
 		return -1;
 	}
-	if (policydb_read(&mypolicydb, &pf, 0)) {
-		policydb_destroy(&mypolicydb);
+	if (policydb_read(s->policydb, &pf, 0)) {
 		ERR(NULL, "can't read binary policy: %s", strerror(errno));
+		policydb_destroy(s->policydb);
+		free(s);
+		return -1;
+	}
+	if (sepol_sidtab_init(s->sidtab)) {
+		ERR(NULL, "Out of memory!");
+		policydb_destroy(s->policydb);
+		free(s);
 		return -1;
 	}
-	policydb = &mypolicydb;
-	return sepol_sidtab_init(sidtab);
+
+	*srv = s;
+	return 0;
+}
+
+void sepol_secserver_destroy(sepol_secserver_t * srv)
+{
+	if (!srv)
+		return;
+
+	avmatrix_destroy(srv->avmatrix);
+	sepol_sidtab_destroy(srv->sidtab);
+	policydb_destroy(srv->policydb);
+	free(srv->stack);
+	free(srv);
 }
 
 /*
@@ -165,36 +281,32 @@ static uint32_t latest_granting = 0;
 /*
  * cat_expr_buf adds a string to an expression buffer and handles
  * realloc's if buffer is too small. The array of expression text
- * buffer pointers and its counter are globally defined here as
+ * buffer pointers and its counter are kept in the server as
  * constraint_expr_eval_reason() sets them up and cat_expr_buf
  * updates the e_buf pointer.
  */
-static int expr_counter;
-static char **expr_list;
-static int expr_buf_used;
-static int expr_buf_len;
-
-static void cat_expr_buf(char *e_buf, const char *string)
+static void cat_expr_buf(sepol_secserver_t * srv, char *e_buf,
+			 const char *string)
 {
 	int len, new_buf_len;
 	char *p, *new_buf = e_buf;
 
 	while (1) {
-		p = e_buf + expr_buf_used;
-		len = snprintf(p, expr_buf_len - expr_buf_used, "%s", string);
-		if (len < 0 || len >= expr_buf_len - expr_buf_used) {
-			new_buf_len = expr_buf_len + EXPR_BUF_SIZE;
+		p = e_buf + srv->expr_buf_used;
+		len = snprintf(p, srv->expr_buf_len - srv->expr_buf_used, "%s", string);
+		if (len < 0 || len >= srv->expr_buf_len - srv->expr_buf_used) {
+			new_buf_len = srv->expr_buf_len + EXPR_BUF_SIZE;
 			new_buf = realloc(e_buf, new_buf_len);
 			if (!new_buf) {
 				ERR(NULL, "failed to realloc expr buffer");
 				return;
 			}
 			/* Update new ptr in expr list and locally + new len */
-			expr_list[expr_counter] = new_buf;
+			srv->expr_list[srv->expr_counter] = new_buf;
 			e_buf = new_buf;
-			expr_buf_len = new_buf_len;
+			srv->expr_buf_len = new_buf_len;
 		} else {
-			expr_buf_used += len;
+			srv->expr_buf_used += len;
 			return;
 		}
 	}
@@ -208,7 +320,8 @@ static void cat_expr_buf(char *e_buf, const char *string)
  * For user and role plus types (for policy vers <
  * POLICYDB_VERSION_CONSTRAINT_NAMES) just read the e->names list.
  */
-static void get_name_list(constraint_expr_t *e, int type,
+static void get_name_list(sepol_secserver_t *srv,
+							constraint_expr_t *e, int type,
 							const char *src, const char *op, int failed)
 {
 	ebitmap_t *types;
@@ -217,8 +330,8 @@ static void get_name_list(constraint_expr_t *e, int type,
 	char tmp_buf[128];
 	int counter = 0;
 
-	if (policydb->policy_type == POLICY_KERN &&
-			policydb->policyvers >= POLICYDB_VERSION_CONSTRAINT_NAMES &&
+	if (srv->policydb->policy_type == POLICY_KERN &&
+			srv->policydb->policyvers >= POLICYDB_VERSION_CONSTRAINT_NAMES &&
 			type == CEXPR_TYPE)
 		types = &e->type_names->types;
 	else
@@ -233,12 +346,12 @@ static void get_name_list(constraint_expr_t *e, int type,
 			counter++;
 	}
 	snprintf(tmp_buf, sizeof(tmp_buf), "(%s%s", src, op);
-	cat_expr_buf(expr_list[expr_counter], tmp_buf);
+	cat_expr_buf(srv, srv->expr_list[srv->expr_counter], tmp_buf);
 
 	if (counter == 0)
-		cat_expr_buf(expr_list[expr_counter], "<empty_set> ");
+		cat_expr_buf(srv, srv->expr_list[srv->expr_counter], "<empty_set> ");
 	if (counter > 1)
-		cat_expr_buf(expr_list[expr_counter], " {");
+		cat_expr_buf(srv, srv->expr_list[srv->expr_counter], " {");
 	if (counter >= 1) {
 		for (i = ebitmap_startbit(types); i < ebitmap_length(types); i++) {
 			rc = ebitmap_get_bit(types, i);
@@ -249,31 +362,32 @@ static void get_name_list(constraint_expr_t *e, int type,
 			switch (type) {
 			case CEXPR_USER:
 				snprintf(tmp_buf, sizeof(tmp_buf), " %s",
-							policydb->p_user_val_to_name[i]);
+							srv->policydb->p_user_val_to_name[i]);
 				break;
 			case CEXPR_ROLE:
 				snprintf(tmp_buf, sizeof(tmp_buf), " %s",
-							policydb->p_role_val_to_name[i]);
+							srv->policydb->p_role_val_to_name[i]);
 				break;
 			case CEXPR_TYPE:
 				snprintf(tmp_buf, sizeof(tmp_buf), " %s",
-							policydb->p_type_val_to_name[i]);
+							srv->policydb->p_type_val_to_name[i]);
 				break;
 			}
-			cat_expr_buf(expr_list[expr_counter], tmp_buf);
+			cat_expr_buf(srv, srv->expr_list[srv->expr_counter], tmp_buf);
 		}
 	}
 	if (counter > 1)
-		cat_expr_buf(expr_list[expr_counter], " }");
+		cat_expr_buf(srv, srv->expr_list[srv->expr_counter], " }");
 	if (failed)
-		cat_expr_buf(expr_list[expr_counter], " -Fail-) ");
+		cat_expr_buf(srv, srv->expr_list[srv->expr_counter], " -Fail-) ");
 	else
-		cat_expr_buf(expr_list[expr_counter], ") ");
+		cat_expr_buf(srv, srv->expr_list[srv->expr_counter], ") ");
 
 	return;
 }
 
-static void msgcat(const char *src, const char *tgt, const char *op, int failed)
+static void msgcat(sepol_secserver_t *srv, const char *src, const char *tgt,
+					const char *op, int failed)
 {
 	char tmp_buf[128];
 	if (failed)
@@ -282,11 +396,12 @@ static void msgcat(const char *src, const char *tgt, const char *op, int failed)
 	else
 		snprintf(tmp_buf, sizeof(tmp_buf), "(%s %s %s) ",
 				src, op, tgt);
-	cat_expr_buf(expr_list[expr_counter], tmp_buf);
+	cat_expr_buf(srv, srv->expr_list[srv->expr_counter], tmp_buf);
 }
 
 /* Returns a buffer with class, statement type and permissions */
-static char *get_class_info(sepol_security_class_t tclass,
+static char *get_class_info(sepol_secserver_t *srv,
+							sepol_security_class_t tclass,
 							constraint_node_t *constraint,
 							context_struct_t *xcontext)
 {
@@ -340,7 +455,7 @@ static char *get_class_info(sepol_security_class_t tclass,
 		p += len;
 		buf_used += len;
 		len = snprintf(p, class_buf_len - buf_used, "%s ",
-				policydb->p_class_val_to_name[tclass - 1]);
+				srv->policydb->p_class_val_to_name[tclass - 1]);
 		if (len < 0 || len >= class_buf_len - buf_used)
 			continue;
 
@@ -349,7 +464,7 @@ static char *get_class_info(sepol_security_class_t tclass,
 		buf_used += len;
 		if (state_num < 2) {
 			len = snprintf(p, class_buf_len - buf_used, "{%s } (",
-			sepol_av_to_string(policydb, tclass,
+			sepol_av_to_string(srv->policydb, tclass,
 				constraint->permissions));
 		} else {
 			len = snprintf(p, class_buf_len - buf_used, "(");
@@ -361,6 +476,189 @@ static char *get_class_info(sepol_security_class_t tclass,
 	return class_buf;
 }
 
+/*
+ * Return the boolean value of a constraint expression
+ * when it is applied to the specified source and target
+ * security contexts.
+ *
+ * xcontext is a special beast...  It is used by the validatetrans rules
+ * only.  For these rules, scontext is the context before the transition,
+ * tcontext is the context after the transition, and xcontext is the
+ * context of the process performing the transition.  All other callers
+ * of constraint_expr_eval should pass in NULL for xcontext.
+ *
+ * This is the plain evaluator used when no reason buffer is wanted;
+ * constraint_expr_eval_reason() must compute the same result.
+ */
+static int constraint_expr_eval(sepol_secserver_t *srv,
+				context_struct_t *scontext,
+				context_struct_t *tcontext,
+				context_struct_t *xcontext,
+				constraint_expr_t *cexpr)
+{
+	uint32_t val1, val2;
+	context_struct_t *c;
+	role_datum_t *r1, *r2;
+	mls_level_t *l1, *l2;
+	constraint_expr_t *e;
+	int s[CEXPR_MAXDEPTH];
+	int sp = -1;
+
+	for (e = cexpr; e; e = e->next) {
+		switch (e->expr_type) {
+		case CEXPR_NOT:
+			BUG_ON(sp < 0);
+			s[sp] = !s[sp];
+			break;
+		case CEXPR_AND:
+			BUG_ON(sp < 1);
+			sp--;
+			s[sp] &= s[sp + 1];
+			break;
+		case CEXPR_OR:
+			BUG_ON(sp < 1);
+			sp--;
+			s[sp] |= s[sp + 1];
+			break;
+		case CEXPR_ATTR:
+			if (sp == (CEXPR_MAXDEPTH - 1))
+				return 0;
+
+			switch (e->attr) {
+			case CEXPR_USER:
+				val1 = scontext->user;
+				val2 = tcontext->user;
+				break;
+			case CEXPR_TYPE:
+				val1 = scontext->type;
+				val2 = tcontext->type;
+				break;
+			case CEXPR_ROLE:
+				val1 = scontext->role;
+				val2 = tcontext->role;
+				r1 = srv->policydb->role_val_to_struct[val1 - 1];
+				r2 = srv->policydb->role_val_to_struct[val2 - 1];
+				switch (e->op) {
+				case CEXPR_DOM:
+					s[++sp] = ebitmap_get_bit(&r1->dominates, val2 - 1);
+					continue;
+				case CEXPR_DOMBY:
+					s[++sp] = ebitmap_get_bit(&r2->dominates, val1 - 1);
+					continue;
+				case CEXPR_INCOMP:
+					s[++sp] = (!ebitmap_get_bit(&r1->dominates, val2 - 1)
+						 && !ebitmap_get_bit(&r2->dominates, val1 - 1));
+					continue;
+				default:
+					break;
+				}
+				break;
+			case CEXPR_L1L2:
+				l1 = &(scontext->range.level[0]);
+				l2 = &(tcontext->range.level[0]);
+				goto mls_ops;
+			case CEXPR_L1H2:
+				l1 = &(scontext->range.level[0]);
+				l2 = &(tcontext->range.level[1]);
+				goto mls_ops;
+			case CEXPR_H1L2:
+				l1 = &(scontext->range.level[1]);
+				l2 = &(tcontext->range.level[0]);
+				goto mls_ops;
+			case CEXPR_H1H2:
+				l1 = &(scontext->range.level[1]);
+				l2 = &(tcontext->range.level[1]);
+				goto mls_ops;
+			case CEXPR_L1H1:
+				l1 = &(scontext->range.level[0]);
+				l2 = &(scontext->range.level[1]);
+				goto mls_ops;
+			case CEXPR_L2H2:
+				l1 = &(tcontext->range.level[0]);
+				l2 = &(tcontext->range.level[1]);
+mls_ops:
+				switch (e->op) {
+				case CEXPR_EQ:
+					s[++sp] = mls_level_eq(l1, l2);
+					continue;
+				case CEXPR_NEQ:
+					s[++sp] = !mls_level_eq(l1, l2);
+					continue;
+				case CEXPR_DOM:
+					s[++sp] = mls_level_dom(l1, l2);
+					continue;
+				case CEXPR_DOMBY:
+					s[++sp] = mls_level_dom(l2, l1);
+					continue;
+				case CEXPR_INCOMP:
+					s[++sp] = mls_level_incomp(l2, l1);
+					continue;
+				default:
+					BUG();
+					return 0;
+				}
+				break;
+			default:
+				BUG();
+				return 0;
+			}
+
+			switch (e->op) {
+			case CEXPR_EQ:
+				s[++sp] = (val1 == val2);
+				break;
+			case CEXPR_NEQ:
+				s[++sp] = (val1 != val2);
+				break;
+			default:
+				BUG();
+				return 0;
+			}
+			break;
+		case CEXPR_NAMES:
+			if (sp == (CEXPR_MAXDEPTH - 1))
+				return 0;
+			c = scontext;
+			if (e->attr & CEXPR_TARGET)
+				c = tcontext;
+			else if (e->attr & CEXPR_XTARGET)
+				c = xcontext;
+			if (!c) {
+				BUG();
+				return 0;
+			}
+			if (e->attr & CEXPR_USER)
+				val1 = c->user;
+			else if (e->attr & CEXPR_ROLE)
+				val1 = c->role;
+			else if (e->attr & CEXPR_TYPE)
+				val1 = c->type;
+			else {
+				BUG();
+				return 0;
+			}
+
+			switch (e->op) {
+			case CEXPR_EQ:
+				s[++sp] = ebitmap_get_bit(&e->names, val1 - 1);
+				break;
+			case CEXPR_NEQ:
+				s[++sp] = !ebitmap_get_bit(&e->names, val1 - 1);
+				break;
+			default:
+				BUG();
+				return 0;
+			}
+			break;
+		default:
+			BUG();
+			return 0;
+		}
+	}
+
+	return s[0];
+}
+
 /*
  * Modified version of constraint_expr_eval that will process each
  * constraint as before but adds the information to text buffers that
@@ -382,7 +680,8 @@ static char *get_class_info(sepol_security_class_t tclass,
  * for analysis. If this option is not required, then:
  *      'tclass' should be '0' and r_buf MUST be NULL.
  */
-static int constraint_expr_eval_reason(context_struct_t *scontext,
+static int constraint_expr_eval_reason(sepol_secserver_t *srv,
+				context_struct_t *scontext,
 				context_struct_t *tcontext,
 				context_struct_t *xcontext,
 				sepol_security_class_t tclass,
@@ -423,7 +722,12 @@ static int constraint_expr_eval_reason(context_struct_t *scontext,
 	char **answer_list = NULL;
 	int answer_counter = 0;
 
-	class_buf = get_class_info(tclass, constraint, xcontext);
+	/* Nothing to explain, so skip building the expression text */
+	if (!r_buf)
+		return constraint_expr_eval(srv, scontext, tcontext, xcontext,
+					    constraint->expr);
+
+	class_buf = get_class_info(srv, tclass, constraint, xcontext);
 	if (!class_buf) {
 		ERR(NULL, "failed to allocate class buffer");
 		return -ENOMEM;
@@ -431,12 +735,12 @@ static int constraint_expr_eval_reason(context_struct_t *scontext,
 
 	/* Original function but with buffer support */
 	int expr_list_len = 0;
-	expr_counter = 0;
-	expr_list = NULL;
+	srv->expr_counter = 0;
+	srv->expr_list = NULL;
 	for (e = constraint->expr; e; e = e->next) {
 		/* Allocate a stack to hold expression buffer entries */
-		if (expr_counter >= expr_list_len) {
-			char **new_expr_list = expr_list;
+		if (srv->expr_counter >= expr_list_len) {
+			char **new_expr_list = srv->expr_list;
 			int new_expr_list_len;
 
 			if (expr_list_len == 0)
@@ -444,48 +748,48 @@ static int constraint_expr_eval_reason(context_struct_t *scontext,
 			else
 				new_expr_list_len = expr_list_len * 2;
 
-			new_expr_list = realloc(expr_list,
-					new_expr_list_len * sizeof(*expr_list));
+			new_expr_list = realloc(srv->expr_list,
+					new_expr_list_len * sizeof(*srv->expr_list));
 			if (!new_expr_list) {
 				ERR(NULL, "failed to allocate expr buffer stack");
 				rc = -ENOMEM;
 				goto out;
 			}
 			expr_list_len = new_expr_list_len;
-			expr_list = new_expr_list;
+			srv->expr_list = new_expr_list;
 		}
 
 		/*
 		 * malloc a buffer to store each expression text component. If
 		 * buffer is too small cat_expr_buf() will realloc extra space.
 		 */
-		expr_buf_len = EXPR_BUF_SIZE;
-		expr_list[expr_counter] = malloc(expr_buf_len);
-		if (!expr_list[expr_counter]) {
+		srv->expr_buf_len = EXPR_BUF_SIZE;
+		srv->expr_list[srv->expr_counter] = malloc(srv->expr_buf_len);
+		if (!srv->expr_list[srv->expr_counter]) {
 			ERR(NULL, "failed to allocate expr buffer");
 			rc = -ENOMEM;
 			goto out;
 		}
-		expr_buf_used = 0;
+		srv->expr_buf_used = 0;
 
 		/* Now process each expression of the constraint */
 		switch (e->expr_type) {
 		case CEXPR_NOT:
 			BUG_ON(sp < 0);
 			s[sp] = !s[sp];
-			cat_expr_buf(expr_list[expr_counter], "not");
+			cat_expr_buf(srv, srv->expr_list[srv->expr_counter], "not");
 			break;
 		case CEXPR_AND:
 			BUG_ON(sp < 1);
 			sp--;
 			s[sp] &= s[sp + 1];
-			cat_expr_buf(expr_list[expr_counter], "and");
+			cat_expr_buf(srv, srv->expr_list[srv->expr_counter], "and");
 			break;
 		case CEXPR_OR:
 			BUG_ON(sp < 1);
 			sp--;
 			s[sp] |= s[sp + 1];
-			cat_expr_buf(expr_list[expr_counter], "or");
+			cat_expr_buf(srv, srv->expr_list[srv->expr_counter], "or");
 			break;
 		case CEXPR_ATTR:
 			if (sp == (CEXPR_MAXDEPTH - 1))
@@ -507,27 +811,27 @@ static int constraint_expr_eval_reason(context_struct_t *scontext,
 			case CEXPR_ROLE:
 				val1 = scontext->role;
 				val2 = tcontext->role;
-				r1 = policydb->role_val_to_struct[val1 - 1];
-				r2 = policydb->role_val_to_struct[val2 - 1];
+				r1 = srv->policydb->role_val_to_struct[val1 - 1];
+				r2 = srv->policydb->role_val_to_struct[val2 - 1];
 				free(src); src = strdup("r1");
 				free(tgt); tgt = strdup("r2");
 
 				switch (e->op) {
 				case CEXPR_DOM:
 					s[++sp] = ebitmap_get_bit(&r1->dominates, val2 - 1);
-					msgcat(src, tgt, "dom", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "dom", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				case CEXPR_DOMBY:
 					s[++sp] = ebitmap_get_bit(&r2->dominates, val1 - 1);
-					msgcat(src, tgt, "domby", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "domby", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				case CEXPR_INCOMP:
 					s[++sp] = (!ebitmap_get_bit(&r1->dominates, val2 - 1)
 						 && !ebitmap_get_bit(&r2->dominates, val1 - 1));
-					msgcat(src, tgt, "incomp", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "incomp", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				default:
 					break;
@@ -572,28 +876,28 @@ mls_ops:
 				switch (e->op) {
 				case CEXPR_EQ:
 					s[++sp] = mls_level_eq(l1, l2);
-					msgcat(src, tgt, "eq", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "eq", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				case CEXPR_NEQ:
 					s[++sp] = !mls_level_eq(l1, l2);
-					msgcat(src, tgt, "!=", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "!=", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				case CEXPR_DOM:
 					s[++sp] = mls_level_dom(l1, l2);
-					msgcat(src, tgt, "dom", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "dom", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				case CEXPR_DOMBY:
 					s[++sp] = mls_level_dom(l2, l1);
-					msgcat(src, tgt, "domby", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "domby", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				case CEXPR_INCOMP:
 					s[++sp] = mls_level_incomp(l2, l1);
-					msgcat(src, tgt, "incomp", s[sp] == 0);
-					expr_counter++;
+					msgcat(srv, src, tgt, "incomp", s[sp] == 0);
+					srv->expr_counter++;
 					continue;
 				default:
 					BUG();
@@ -608,11 +912,11 @@ mls_ops:
 			switch (e->op) {
 			case CEXPR_EQ:
 				s[++sp] = (val1 == val2);
-				msgcat(src, tgt, "==", s[sp] == 0);
+				msgcat(srv, src, tgt, "==", s[sp] == 0);
 				break;
 			case CEXPR_NEQ:
 				s[++sp] = (val1 != val2);
-				msgcat(src, tgt, "!=", s[sp] == 0);
+				msgcat(srv, src, tgt, "!=", s[sp] == 0);
 				break;
 			default:
 				BUG();
@@ -658,12 +962,12 @@ mls_ops:
 			switch (e->op) {
 			case CEXPR_EQ:
 				s[++sp] = ebitmap_get_bit(&e->names, val1 - 1);
-				get_name_list(e, u_r_t, src, "==", s[sp] == 0);
+				get_name_list(srv, e, u_r_t, src, "==", s[sp] == 0);
 				break;
 
 			case CEXPR_NEQ:
 				s[++sp] = !ebitmap_get_bit(&e->names, val1 - 1);
-				get_name_list(e, u_r_t, src, "!=", s[sp] == 0);
+				get_name_list(srv, e, u_r_t, src, "!=", s[sp] == 0);
 				break;
 			default:
 				BUG();
@@ -674,7 +978,7 @@ mls_ops:
 			BUG();
 			goto out;
 		}
-		expr_counter++;
+		srv->expr_counter++;
 	}
 
 	/*
@@ -688,8 +992,8 @@ mls_ops:
 	 * expr_list malloc's. Normally they are released by the RPN to
 	 * infix code.
 	 */
-	int expr_count = expr_counter;
-	expr_counter = 0;
+	int expr_count = srv->expr_counter;
+	srv->expr_counter = 0;
 
 	/*
 	 * Generate the same number of answer buffer entries as expression
@@ -709,11 +1013,11 @@ mls_ops:
 
 	/* Convert constraint from RPN to infix notation. */
 	for (x = 0; x != expr_count; x++) {
-		if (strncmp(expr_list[x], "and", 3) == 0 || strncmp(expr_list[x],
+		if (strncmp(srv->expr_list[x], "and", 3) == 0 || strncmp(srv->expr_list[x],
 					"or", 2) == 0) {
-			b = pop();
+			b = pop(srv);
 			b_len = strlen(b);
-			a = pop();
+			a = pop(srv);
 			a_len = strlen(a);
 
 			/* get a buffer to hold the answer */
@@ -726,13 +1030,13 @@ mls_ops:
 			memset(answer_list[answer_counter], '\0', a_len + b_len + 8);
 
 			sprintf(answer_list[answer_counter], "%s %s %s", a,
-					expr_list[x], b);
-			push(answer_list[answer_counter++]);
+					srv->expr_list[x], b);
+			push(srv, answer_list[answer_counter++]);
 			free(a);
 			free(b);
-			free(expr_list[x]);
-		} else if (strncmp(expr_list[x], "not", 3) == 0) {
-			b = pop();
+			free(srv->expr_list[x]);
+		} else if (strncmp(srv->expr_list[x], "not", 3) == 0) {
+			b = pop(srv);
 			b_len = strlen(b);
 
 			answer_list[answer_counter] = malloc(b_len + 8);
@@ -745,19 +1049,19 @@ mls_ops:
 
 			if (strncmp(b, "not", 3) == 0)
 				sprintf(answer_list[answer_counter], "%s (%s)",
-						expr_list[x], b);
+						srv->expr_list[x], b);
 			else
 				sprintf(answer_list[answer_counter], "%s%s",
-						expr_list[x], b);
-			push(answer_list[answer_counter++]);
+						srv->expr_list[x], b);
+			push(srv, answer_list[answer_counter++]);
 			free(b);
-			free(expr_list[x]);
+			free(srv->expr_list[x]);
 		} else {
-			push(expr_list[x]);
+			push(srv, srv->expr_list[x]);
 		}
 	}
 	/* Get the final answer from tos and build constraint text */
-	a = pop();
+	a = pop(srv);
 
 	/* validatetrans / constraint calculation:
 				rc = 0 is denied, rc = 1 is granted */
@@ -777,29 +1081,29 @@ mls_ops:
 	 * This will add the constraints to the callers reason buffer (who is
 	 * responsible for freeing the memory). It will handle any realloc's
 	 * should the buffer be too short.
-	 * The reason_buf_used and reason_buf_len counters are defined
-	 * globally as multiple constraints can be in the buffer.
+	 * The reason_buf_used and reason_buf_len counters are kept in
+	 * the server as multiple constraints can be in the buffer.
 	 */
 
 	if (r_buf && ((s[0] == 0) || ((s[0] == 1 &&
 				(flags & SHOW_GRANTED) == SHOW_GRANTED)))) {
 		for (x = 0; buffers[x] != NULL; x++) {
 			while (1) {
-				p = *r_buf + reason_buf_used;
-				len = snprintf(p, reason_buf_len - reason_buf_used,
+				p = *r_buf + srv->reason_buf_used;
+				len = snprintf(p, srv->reason_buf_len - srv->reason_buf_used,
 						"%s", buffers[x]);
-				if (len < 0 || len >= reason_buf_len - reason_buf_used) {
-					new_buf_len = reason_buf_len + REASON_BUF_SIZE;
+				if (len < 0 || len >= srv->reason_buf_len - srv->reason_buf_used) {
+					new_buf_len = srv->reason_buf_len + REASON_BUF_SIZE;
 					*new_buf = realloc(*r_buf, new_buf_len);
 					if (!new_buf) {
 						ERR(NULL, "failed to realloc reason buffer");
 						goto out1;
 					}
 					**r_buf = **new_buf;
-					reason_buf_len = new_buf_len;
+					srv->reason_buf_len = new_buf_len;
 					continue;
 				} else {
-					reason_buf_used += len;
+					srv->reason_buf_used += len;
 					break;
 				}
 			}
@@ -815,20 +1119,293 @@ out:
 	free(src);
 	free(tgt);
 
-	if (expr_counter) {
-		for (x = 0; expr_list[x] != NULL; x++)
-			free(expr_list[x]);
+	if (srv->expr_counter) {
+		for (x = 0; srv->expr_list[x] != NULL; x++)
+			free(srv->expr_list[x]);
 	}
 	free(answer_list);
-	free(expr_list);
+	free(srv->expr_list);
 	return rc;
 }
 
+/* An avtab node applying to a single source type, before merging. */
+typedef struct avmatrix_item {
+	uint32_t target_type;
+	uint32_t target_class;
+	avtab_ptr_t node;
+	int cond;
+} avmatrix_item_t;
+
+static int avmatrix_item_cmp(const void *a, const void *b)
+{
+	const avmatrix_item_t *x = a, *y = b;
+
+	if (x->target_type != y->target_type)
+		return x->target_type < y->target_type ? -1 : 1;
+	if (x->target_class != y->target_class)
+		return x->target_class < y->target_class ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Count (rules == NULL) or collect the access vector rules of an avtab
+ * by source type.
+ */
+static void avmatrix_add_rules(avtab_t * h, int cond, uint32_t * pos,
+			       avmatrix_item_t * rules)
+{
+	avtab_ptr_t cur;
+	uint32_t i, src;
+
+	if (!h->htable)
+		return;
+
+	for (i = 0; i < h->nslot; i++) {
+		for (cur = h->htable[i]; cur; cur = cur->next) {
+			if (!(cur->key.specified & AVTAB_AV))
+				continue;
+			src = cur->key.source_type - 1;
+			if (rules) {
+				rules[pos[src]].node = cur;
+				rules[pos[src]].cond = cond;
+			}
+			pos[src]++;
+		}
+	}
+}
+
+/* Append the rule `rule' for target type `k' + 1 to the items of a row. */
+static int avmatrix_add_item(avmatrix_item_t ** items, uint32_t * nitems,
+			     uint32_t * items_len, uint32_t k,
+			     const avmatrix_item_t * rule)
+{
+	avmatrix_item_t *tmp_items, *item;
+
+	if (*nitems == *items_len) {
+		*items_len = *items_len ? *items_len * 2 : 64;
+		tmp_items = realloc(*items, *items_len * sizeof(**items));
+		if (!tmp_items)
+			return -1;
+		*items = tmp_items;
+	}
+	item = &(*items)[(*nitems)++];
+	item->target_type = k + 1;
+	item->target_class = rule->node->key.target_class;
+	item->node = rule->node;
+	item->cond = rule->cond;
+	return 0;
+}
+
+static avmatrix_t *avmatrix_build(policydb_t * p)
+{
+	avmatrix_t *m = NULL;
+	avmatrix_item_t *rules = NULL, *items = NULL, *item;
+	avmatrix_entry_t *e, *tmp_entries;
+	avtab_ptr_t *tmp_nodes;
+	ebitmap_node_t *anode, *tnode;
+	uint32_t *src_start = NULL, *pos = NULL;
+	uint32_t nprim = p->p_types.nprim, s, a, t, r, k;
+	uint32_t nitems, items_len = 0, nentries = 0, entries_len = 0;
+	uint32_t ncond = 0, cond_len = 0;
+
+	/* bucket the access vector rules by source type */
+	src_start = calloc(nprim + 1, sizeof(uint32_t));
+	pos = calloc(nprim, sizeof(uint32_t));
+	if (!src_start || !pos)
+		goto oom;
+	avmatrix_add_rules(&p->te_avtab, 0, pos, NULL);
+	avmatrix_add_rules(&p->te_cond_avtab, 1, pos, NULL);
+	for (s = 0; s < nprim; s++) {
+		src_start[s + 1] = src_start[s] + pos[s];
+		pos[s] = src_start[s];
+	}
+	rules = malloc((src_start[nprim] + 1) * sizeof(avmatrix_item_t));
+	if (!rules)
+		goto oom;
+	avmatrix_add_rules(&p->te_avtab, 0, pos, rules);
+	avmatrix_add_rules(&p->te_cond_avtab, 1, pos, rules);
+
+	m = calloc(1, sizeof(avmatrix_t));
+	if (!m)
+		goto oom;
+	m->nrows = nprim;
+	m->row_start = calloc(nprim + 1, sizeof(uint32_t));
+	if (!m->row_start)
+		goto oom;
+
+	for (s = 0; s < nprim; s++) {
+		/* every rule whose source is an attribute of s, per target type */
+		nitems = 0;
+		ebitmap_for_each_bit(&p->type_attr_map[s], anode, a) {
+			if (!ebitmap_node_get_bit(anode, a))
+				continue;
+			for (r = src_start[a]; r < src_start[a + 1]; r++) {
+				t = rules[r].node->key.target_type - 1;
+				ebitmap_for_each_bit(&p->attr_type_map[t], tnode, k) {
+					if (!ebitmap_node_get_bit(tnode, k))
+						continue;
+					if (avmatrix_add_item(&items, &nitems,
+							      &items_len, k,
+							      &rules[r]))
+						goto oom;
+				}
+				/* attr_type_map leaves out the attribute
+				 * itself, which type_attr_map includes */
+				if (p->type_val_to_struct[t] &&
+				    p->type_val_to_struct[t]->flavor ==
+				    TYPE_ATTRIB &&
+				    avmatrix_add_item(&items, &nitems,
+						      &items_len, t, &rules[r]))
+					goto oom;
+			}
+		}
+
+		if (nitems)
+			qsort(items, nitems, sizeof(*items), avmatrix_item_cmp);
+
+		/* merge the rules for each (target type, class) pair */
+		for (k = 0; k < nitems; k++) {
+			item = &items[k];
+			if (k == 0 || avmatrix_item_cmp(item, &items[k - 1])) {
+				if (nentries == entries_len) {
+					entries_len = entries_len ?
+					    entries_len * 2 : 64;
+					tmp_entries = realloc(m->entries,
+							      entries_len *
+							      sizeof(*m->entries));
+					if (!tmp_entries)
+						goto oom;
+					m->entries = tmp_entries;
+				}
+				e = &m->entries[nentries++];
+				e->target_type = item->target_type;
+				e->target_class = item->target_class;
+				e->allowed = 0;
+				e->auditallow = 0;
+				e->auditdeny = 0xffffffff;
+				e->cond_start = ncond;
+				e->cond_count = 0;
+			}
+			e = &m->entries[nentries - 1];
+
+			if (item->cond) {
+				if (ncond == cond_len) {
+					cond_len = cond_len ? cond_len * 2 : 64;
+					tmp_nodes = realloc(m->cond_nodes,
+							    cond_len *
+							    sizeof(*m->cond_nodes));
+					if (!tmp_nodes)
+						goto oom;
+					m->cond_nodes = tmp_nodes;
+				}
+				m->cond_nodes[ncond++] = item->node;
+				e->cond_count++;
+			} else if (item->node->key.specified == AVTAB_ALLOWED)
+				e->allowed |= item->node->datum.data;
+			else if (item->node->key.specified == AVTAB_AUDITALLOW)
+				e->auditallow |= item->node->datum.data;
+			else if (item->node->key.specified == AVTAB_AUDITDENY)
+				e->auditdeny &= item->node->datum.data;
+		}
+		m->row_start[s + 1] = nentries;
+	}
+
+	goto out;
+
+      oom:
+	avmatrix_destroy(m);
+	m = NULL;
+      out:
+	free(src_start);
+	free(pos);
+	free(rules);
+	free(items);
+	return m;
+}
+
+/*
+ * Fold the precomputed access vectors for a type pair into `avd',
+ * as the avtab walk in context_struct_compute_av() would.
+ */
+static void avmatrix_compute_av(avmatrix_t * m, uint32_t source_type,
+				uint32_t target_type, uint32_t target_class,
+				struct sepol_av_decision *avd)
+{
+	avmatrix_entry_t *e;
+	avtab_ptr_t node;
+	uint32_t lo, hi, end, mid, i;
+
+	if (!source_type || source_type > m->nrows)
+		return;
+
+	lo = m->row_start[source_type - 1];
+	hi = end = m->row_start[source_type];
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		e = &m->entries[mid];
+		if (e->target_type < target_type ||
+		    (e->target_type == target_type &&
+		     e->target_class < target_class))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == end)
+		return;
+	e = &m->entries[lo];
+	if (e->target_type != target_type || e->target_class != target_class)
+		return;
+
+	avd->allowed |= e->allowed;
+	avd->auditallow |= e->auditallow;
+	avd->auditdeny &= e->auditdeny;
+
+	/* conditional rules count only while enabled */
+	for (i = 0; i < e->cond_count; i++) {
+		node = m->cond_nodes[e->cond_start + i];
+		if ((uint16_t) (AVTAB_ALLOWED | AVTAB_ENABLED) ==
+		    (node->key.specified & (AVTAB_ALLOWED | AVTAB_ENABLED)))
+			avd->allowed |= node->datum.data;
+		if ((uint16_t) (AVTAB_AUDITDENY | AVTAB_ENABLED) ==
+		    (node->key.specified & (AVTAB_AUDITDENY | AVTAB_ENABLED)))
+			avd->auditdeny &= node->datum.data;
+		if ((uint16_t) (AVTAB_AUDITALLOW | AVTAB_ENABLED) ==
+		    (node->key.specified & (AVTAB_AUDITALLOW | AVTAB_ENABLED)))
+			avd->auditallow |= node->datum.data;
+	}
+}
+
+int sepol_secserver_precompute_av(sepol_secserver_t * srv)
+{
+	avmatrix_t *m;
+
+	if (!srv->policydb->type_attr_map || !srv->policydb->attr_type_map) {
+		ERR(NULL, "policy has no type attribute map");
+		return -EINVAL;
+	}
+
+	m = avmatrix_build(srv->policydb);
+	if (!m) {
+		ERR(NULL, "Out of memory!");
+		return -ENOMEM;
+	}
+
+	avmatrix_destroy(srv->avmatrix);
+	srv->avmatrix = m;
+	return 0;
+}
+
+int hidden sepol_precompute_av(void)
+{
+	return sepol_secserver_precompute_av(&mysecserver);
+}
+
 /*
  * Compute access vectors based on a context structure pair for
  * the permissions in a particular class.
  */
-static int context_struct_compute_av(context_struct_t * scontext,
+static int context_struct_compute_av(sepol_secserver_t * srv,
+				     context_struct_t * scontext,
 				     context_struct_t * tcontext,
 				     sepol_security_class_t tclass,
 				     sepol_access_vector_t requested,
@@ -846,11 +1423,11 @@ static int context_struct_compute_av(context_struct_t * scontext,
 	ebitmap_node_t *snode, *tnode;
 	unsigned int i, j;
 
-	if (!tclass || tclass > policydb->p_classes.nprim) {
+	if (!tclass || tclass > srv->policydb->p_classes.nprim) {
 		ERR(NULL, "unrecognized class %d", tclass);
 		return -EINVAL;
 	}
-	tclass_datum = policydb->class_val_to_struct[tclass - 1];
+	tclass_datum = srv->policydb->class_val_to_struct[tclass - 1];
 
 	/* 
 	 * Initialize the access vectors to the default values.
@@ -866,35 +1443,40 @@ static int context_struct_compute_av(context_struct_t * scontext,
 	 * If a specific type enforcement rule was defined for
 	 * this permission check, then use it.
 	 */
-	avkey.target_class = tclass;
-	avkey.specified = AVTAB_AV;
-	sattr = &policydb->type_attr_map[scontext->type - 1];
-	tattr = &policydb->type_attr_map[tcontext->type - 1];
-	ebitmap_for_each_bit(sattr, snode, i) {
-		if (!ebitmap_node_get_bit(snode, i))
-			continue;
-		ebitmap_for_each_bit(tattr, tnode, j) {
-			if (!ebitmap_node_get_bit(tnode, j))
+	if (srv->avmatrix) {
+		avmatrix_compute_av(srv->avmatrix, scontext->type,
+				    tcontext->type, tclass, avd);
+	} else {
+		avkey.target_class = tclass;
+		avkey.specified = AVTAB_AV;
+		sattr = &srv->policydb->type_attr_map[scontext->type - 1];
+		tattr = &srv->policydb->type_attr_map[tcontext->type - 1];
+		ebitmap_for_each_bit(sattr, snode, i) {
+			if (!ebitmap_node_get_bit(snode, i))
 				continue;
-			avkey.source_type = i + 1;
-			avkey.target_type = j + 1;
-			for (node =
-			     avtab_search_node(&policydb->te_avtab, &avkey);
-			     node != NULL;
-			     node =
-			     avtab_search_node_next(node, avkey.specified)) {
-				if (node->key.specified == AVTAB_ALLOWED)
-					avd->allowed |= node->datum.data;
-				else if (node->key.specified ==
-					 AVTAB_AUDITALLOW)
-					avd->auditallow |= node->datum.data;
-				else if (node->key.specified == AVTAB_AUDITDENY)
-					avd->auditdeny &= node->datum.data;
-			}
+			ebitmap_for_each_bit(tattr, tnode, j) {
+				if (!ebitmap_node_get_bit(tnode, j))
+					continue;
+				avkey.source_type = i + 1;
+				avkey.target_type = j + 1;
+				for (node =
+				     avtab_search_node(&srv->policydb->te_avtab, &avkey);
+				     node != NULL;
+				     node =
+				     avtab_search_node_next(node, avkey.specified)) {
+					if (node->key.specified == AVTAB_ALLOWED)
+						avd->allowed |= node->datum.data;
+					else if (node->key.specified ==
+						 AVTAB_AUDITALLOW)
+						avd->auditallow |= node->datum.data;
+					else if (node->key.specified == AVTAB_AUDITDENY)
+						avd->auditdeny &= node->datum.data;
+				}
 
-			/* Check conditional av table for additional permissions */
-			cond_compute_av(&policydb->te_cond_avtab, &avkey, avd);
+				/* Check conditional av table for additional permissions */
+				cond_compute_av(&srv->policydb->te_cond_avtab, &avkey, avd);
 
+			}
 		}
 	}
 
@@ -910,7 +1492,7 @@ static int context_struct_compute_av(context_struct_t * scontext,
 	constraint = tclass_datum->constraints;
 	while (constraint) {
 		if ((constraint->permissions & (avd->allowed)) &&
-		    !constraint_expr_eval_reason(scontext, tcontext, NULL,
+		    !constraint_expr_eval_reason(srv, scontext, tcontext, NULL,
 					  tclass, constraint, r_buf, flags)) {
 			avd->allowed =
 			    (avd->allowed) & ~(constraint->permissions);
@@ -931,7 +1513,7 @@ static int context_struct_compute_av(context_struct_t * scontext,
 	if (tclass == SECCLASS_PROCESS &&
 	    (avd->allowed & (PROCESS__TRANSITION | PROCESS__DYNTRANSITION)) &&
 	    scontext->role != tcontext->role) {
-		for (ra = policydb->role_allow; ra; ra = ra->next) {
+		for (ra = srv->policydb->role_allow; ra; ra = ra->next) {
 			if (scontext->role == ra->role &&
 			    tcontext->role == ra->new_role)
 				break;
@@ -954,6 +1536,9 @@ int hidden sepol_validate_transition(sepol_security_id_t oldsid,
 				     sepol_security_id_t tasksid,
 				     sepol_security_class_t tclass)
 {
+	sepol_secserver_t *srv = &mysecserver;
+	policydb_t *policydb = srv->policydb;
+	sidtab_t *sidtab = srv->sidtab;
 	context_struct_t *ocontext;
 	context_struct_t *ncontext;
 	context_struct_t *tcontext;
@@ -986,8 +1571,8 @@ int hidden sepol_validate_transition(sepol_security_id_t oldsid,
 
 	constraint = tclass_datum->validatetrans;
 	while (constraint) {
-		if (!constraint_expr_eval_reason(ocontext, ncontext, tcontext,
-					  0, constraint, NULL, 0)) {
+		if (!constraint_expr_eval_reason(srv, ocontext, ncontext,
+					  tcontext, 0, constraint, NULL, 0)) {
 			return -EPERM;
 		}
 		constraint = constraint->next;
@@ -1007,6 +1592,9 @@ int hidden sepol_validate_transition_reason_buffer(sepol_security_id_t oldsid,
 				     char **reason_buf,
 				     unsigned int flags)
 {
+	sepol_secserver_t *srv = &mysecserver;
+	policydb_t *policydb = srv->policydb;
+	sidtab_t *sidtab = srv->sidtab;
 	context_struct_t *ocontext;
 	context_struct_t *ncontext;
 	context_struct_t *tcontext;
@@ -1045,12 +1633,12 @@ int hidden sepol_validate_transition_reason_buffer(sepol_security_id_t oldsid,
 	 * We just make sure these start from zero.
 	 */
 	*reason_buf = NULL;
-	reason_buf_used = 0;
-	reason_buf_len = 0;
+	srv->reason_buf_used = 0;
+	srv->reason_buf_len = 0;
 	constraint = tclass_datum->validatetrans;
 	while (constraint) {
-		if (!constraint_expr_eval_reason(ocontext, ncontext, tcontext,
-				tclass, constraint, reason_buf, flags)) {
+		if (!constraint_expr_eval_reason(srv, ocontext, ncontext,
+				tcontext, tclass, constraint, reason_buf, flags)) {
 			return -EPERM;
 		}
 		constraint = constraint->next;
@@ -1058,35 +1646,48 @@ int hidden sepol_validate_transition_reason_buffer(sepol_security_id_t oldsid,
 	return 0;
 }
 
-int hidden sepol_compute_av_reason(sepol_security_id_t ssid,
-				   sepol_security_id_t tsid,
-				   sepol_security_class_t tclass,
-				   sepol_access_vector_t requested,
-				   struct sepol_av_decision *avd,
-				   unsigned int *reason)
+int sepol_secserver_compute_av_reason(sepol_secserver_t * srv,
+				      sepol_security_id_t ssid,
+				      sepol_security_id_t tsid,
+				      sepol_security_class_t tclass,
+				      sepol_access_vector_t requested,
+				      struct sepol_av_decision *avd,
+				      unsigned int *reason)
 {
 	context_struct_t *scontext = 0, *tcontext = 0;
 	int rc = 0;
 
-	scontext = sepol_sidtab_search(sidtab, ssid);
+	scontext = sepol_sidtab_search(srv->sidtab, ssid);
 	if (!scontext) {
 		ERR(NULL, "unrecognized SID %d", ssid);
 		rc = -EINVAL;
 		goto out;
 	}
-	tcontext = sepol_sidtab_search(sidtab, tsid);
+	tcontext = sepol_sidtab_search(srv->sidtab, tsid);
 	if (!tcontext) {
 		ERR(NULL, "unrecognized SID %d", tsid);
 		rc = -EINVAL;
 		goto out;
 	}
 
-	rc = context_struct_compute_av(scontext, tcontext, tclass,
+	rc = context_struct_compute_av(srv, scontext, tcontext, tclass,
 					requested, avd, reason, NULL, 0);
       out:
 	return rc;
 }
 
+int hidden sepol_compute_av_reason(sepol_security_id_t ssid,
+				   sepol_security_id_t tsid,
+				   sepol_security_class_t tclass,
+				   sepol_access_vector_t requested,
+				   struct sepol_av_decision *avd,
+				   unsigned int *reason)
+{
+	return sepol_secserver_compute_av_reason(&mysecserver, ssid, tsid,
+						 tclass, requested, avd,
+						 reason);
+}
+
 /*
  * sepol_compute_av_reason_buffer - the reason buffer is malloc'd to
  * REASON_BUF_SIZE. If the buffer size is exceeded, then it is realloc'd
@@ -1101,6 +1702,8 @@ int hidden sepol_compute_av_reason_buffer(sepol_security_id_t ssid,
 				   char **reason_buf,
 				   unsigned int flags)
 {
+	sepol_secserver_t *srv = &mysecserver;
+	sidtab_t *sidtab = srv->sidtab;
 	context_struct_t *scontext = 0, *tcontext = 0;
 	int rc = 0;
 
@@ -1125,15 +1728,27 @@ int hidden sepol_compute_av_reason_buffer(sepol_security_id_t ssid,
 	 * We just make sure these start from zero.
 	 */
 	*reason_buf = NULL;
-	reason_buf_used = 0;
-	reason_buf_len = 0;
+	srv->reason_buf_used = 0;
+	srv->reason_buf_len = 0;
 
-	rc = context_struct_compute_av(scontext, tcontext, tclass,
+	rc = context_struct_compute_av(srv, scontext, tcontext, tclass,
 					   requested, avd, reason, reason_buf, flags);
 out:
 	return rc;
 }
 
+int sepol_secserver_compute_av(sepol_secserver_t * srv,
+			       sepol_security_id_t ssid,
+			       sepol_security_id_t tsid,
+			       sepol_security_class_t tclass,
+			       sepol_access_vector_t requested,
+			       struct sepol_av_decision *avd)
+{
+	unsigned int reason = 0;
+	return sepol_secserver_compute_av_reason(srv, ssid, tsid, tclass,
+						 requested, avd, &reason);
+}
+
 int hidden sepol_compute_av(sepol_security_id_t ssid,
 			    sepol_security_id_t tsid,
 			    sepol_security_class_t tclass,
@@ -1152,6 +1767,7 @@ int hidden sepol_compute_av(sepol_security_id_t ssid,
 int hidden sepol_string_to_security_class(const char *class_name,
 			sepol_security_class_t *tclass)
 {
+	policydb_t *policydb = mysecserver.policydb;
 	char *class = NULL;
 	sepol_security_class_t id;
 
@@ -1176,6 +1792,7 @@ int hidden sepol_string_to_av_perm(sepol_security_class_t tclass,
 					const char *perm_name,
 					sepol_access_vector_t *av)
 {
+	policydb_t *policydb = mysecserver.policydb;
 	class_datum_t *tclass_datum;
 	perm_datum_t *perm_datum;
 
@@ -1217,42 +1834,55 @@ out:
  * to point to this string and set `*scontext_len' to
  * the length of the string.
  */
-int hidden sepol_sid_to_context(sepol_security_id_t sid,
-				sepol_security_context_t * scontext,
-				size_t * scontext_len)
+int sepol_secserver_sid_to_context(sepol_secserver_t * srv,
+				   sepol_security_id_t sid,
+				   sepol_security_context_t * scontext,
+				   size_t * scontext_len)
 {
 	context_struct_t *context;
 	int rc = 0;
 
-	context = sepol_sidtab_search(sidtab, sid);
+	context = sepol_sidtab_search(srv->sidtab, sid);
 	if (!context) {
 		ERR(NULL, "unrecognized SID %d", sid);
 		rc = -EINVAL;
 		goto out;
 	}
-	rc = context_to_string(NULL, policydb, context, scontext, scontext_len);
+	rc = context_to_string(NULL, srv->policydb, context, scontext,
+			       scontext_len);
       out:
 	return rc;
 
 }
 
+int hidden sepol_sid_to_context(sepol_security_id_t sid,
+				sepol_security_context_t * scontext,
+				size_t * scontext_len)
+{
+	return sepol_secserver_sid_to_context(&mysecserver, sid, scontext,
+					      scontext_len);
+}
+
 /*
  * Return a SID associated with the security context that
  * has the string representation specified by `scontext'.
  */
-int hidden sepol_context_to_sid(const sepol_security_context_t scontext,
-				size_t scontext_len, sepol_security_id_t * sid)
+int sepol_secserver_context_to_sid(sepol_secserver_t * srv,
+				   const sepol_security_context_t scontext,
+				   size_t scontext_len,
+				   sepol_security_id_t * sid)
 {
 
 	context_struct_t *context = NULL;
 
 	/* First, create the context */
-	if (context_from_string(NULL, policydb, &context,
+	if (context_from_string(NULL, srv->policydb, &context,
 				scontext, scontext_len) < 0)
 		goto err;
 
 	/* Obtain the new sid */
-	if (sid && (sepol_sidtab_context_to_sid(sidtab, context, sid) < 0))
+	if (sid &&
+	    (sepol_sidtab_context_to_sid(srv->sidtab, context, sid) < 0))
 		goto err;
 
 	context_destroy(context);
@@ -1268,7 +1898,15 @@ int hidden sepol_context_to_sid(const sepol_security_context_t scontext,
 	return STATUS_ERR;
 }
 
-static inline int compute_sid_handle_invalid_context(context_struct_t *
+int hidden sepol_context_to_sid(const sepol_security_context_t scontext,
+				size_t scontext_len, sepol_security_id_t * sid)
+{
+	return sepol_secserver_context_to_sid(&mysecserver, scontext,
+					      scontext_len, sid);
+}
+
+static inline int compute_sid_handle_invalid_context(sepol_secserver_t * srv,
+						     context_struct_t *
 						     scontext,
 						     context_struct_t *
 						     tcontext,
@@ -1283,12 +1921,12 @@ static inline int compute_sid_handle_invalid_context(context_struct_t *
 		sepol_security_context_t s, t, n;
 		size_t slen, tlen, nlen;
 
-		context_to_string(NULL, policydb, scontext, &s, &slen);
-		context_to_string(NULL, policydb, tcontext, &t, &tlen);
-		context_to_string(NULL, policydb, newcontext, &n, &nlen);
+		context_to_string(NULL, srv->policydb, scontext, &s, &slen);
+		context_to_string(NULL, srv->policydb, tcontext, &t, &tlen);
+		context_to_string(NULL, srv->policydb, newcontext, &n, &nlen);
 		ERR(NULL, "invalid context %s for "
 		    "scontext=%s tcontext=%s tclass=%s",
-		    n, s, t, policydb->p_class_val_to_name[tclass - 1]);
+		    n, s, t, srv->policydb->p_class_val_to_name[tclass - 1]);
 		free(s);
 		free(t);
 		free(n);
@@ -1296,11 +1934,14 @@ static inline int compute_sid_handle_invalid_context(context_struct_t *
 	}
 }
 
-static int sepol_compute_sid(sepol_security_id_t ssid,
+static int sepol_compute_sid(sepol_secserver_t * srv,
+			     sepol_security_id_t ssid,
 			     sepol_security_id_t tsid,
 			     sepol_security_class_t tclass,
 			     uint32_t specified, sepol_security_id_t * out_sid)
 {
+	policydb_t *policydb = srv->policydb;
+	sidtab_t *sidtab = srv->sidtab;
 	context_struct_t *scontext = 0, *tcontext = 0, newcontext;
 	struct role_trans *roletr = 0;
 	avtab_key_t avkey;
@@ -1403,7 +2044,7 @@ static int sepol_compute_sid(sepol_security_id_t ssid,
 
 	/* Check the validity of the context. */
 	if (!policydb_context_isvalid(policydb, &newcontext)) {
-		rc = compute_sid_handle_invalid_context(scontext,
+		rc = compute_sid_handle_invalid_context(srv, scontext,
 							tcontext,
 							tclass, &newcontext);
 		if (rc)
@@ -1425,7 +2066,18 @@ int hidden sepol_transition_sid(sepol_security_id_t ssid,
 				sepol_security_class_t tclass,
 				sepol_security_id_t * out_sid)
 {
-	return sepol_compute_sid(ssid, tsid, tclass, AVTAB_TRANSITION, out_sid);
+	return sepol_compute_sid(&mysecserver, ssid, tsid, tclass,
+				 AVTAB_TRANSITION, out_sid);
+}
+
+int sepol_secserver_transition_sid(sepol_secserver_t * srv,
+				   sepol_security_id_t ssid,
+				   sepol_security_id_t tsid,
+				   sepol_security_class_t tclass,
+				   sepol_security_id_t * out_sid)
+{
+	return sepol_compute_sid(srv, ssid, tsid, tclass, AVTAB_TRANSITION,
+				 out_sid);
 }
 
 /*
@@ -1438,7 +2090,8 @@ int hidden sepol_member_sid(sepol_security_id_t ssid,
 			    sepol_security_class_t tclass,
 			    sepol_security_id_t * out_sid)
 {
-	return sepol_compute_sid(ssid, tsid, tclass, AVTAB_MEMBER, out_sid);
+	return sepol_compute_sid(&mysecserver, ssid, tsid, tclass,
+				 AVTAB_MEMBER, out_sid);
 }
 
 /*
@@ -1450,7 +2103,8 @@ int hidden sepol_change_sid(sepol_security_id_t ssid,
 			    sepol_security_class_t tclass,
 			    sepol_security_id_t * out_sid)
 {
-	return sepol_compute_sid(ssid, tsid, tclass, AVTAB_CHANGE, out_sid);
+	return sepol_compute_sid(&mysecserver, ssid, tsid, tclass,
+				 AVTAB_CHANGE, out_sid);
 }
 
 /*
@@ -1537,6 +2191,7 @@ static int clone_sid(sepol_security_id_t sid,
 static inline int convert_context_handle_invalid_context(context_struct_t *
 							 context)
 {
+	policydb_t *policydb = mysecserver.policydb;
 	if (selinux_enforcing) {
 		return -EINVAL;
 	} else {
@@ -1565,6 +2220,7 @@ typedef struct {
 static int convert_context(sepol_security_id_t key __attribute__ ((unused)),
 			   context_struct_t * c, void *p)
 {
+	policydb_t *policydb = mysecserver.policydb;
 	convert_context_args_t *args;
 	context_struct_t oldc;
 	role_datum_t *role;
@@ -1701,6 +2357,8 @@ size_t hidden put_entry(const void *ptr, size_t size, size_t n,
  */
 int hidden sepol_load_policy(void *data, size_t len)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	policydb_t oldpolicydb, newpolicydb;
 	sidtab_t oldsidtab, newsidtab;
 	convert_context_args_t args;
@@ -1717,7 +2375,7 @@ int hidden sepol_load_policy(void *data, size_t len)
 		return -ENOMEM;
 
 	if (policydb_read(&newpolicydb, fp, 1)) {
-		policydb_destroy(&mypolicydb);
+		policydb_destroy(&mysecserver.mypolicydb);
 		return -EINVAL;
 	}
 
@@ -1749,6 +2407,8 @@ int hidden sepol_load_policy(void *data, size_t len)
 	sepol_sidtab_set(&oldsidtab, sidtab);
 
 	/* Install the new policydb and SID table. */
+	avmatrix_destroy(mysecserver.avmatrix);
+	mysecserver.avmatrix = NULL;
 	memcpy(policydb, &newpolicydb, sizeof *policydb);
 	sepol_sidtab_set(sidtab, &newsidtab);
 
@@ -1776,6 +2436,8 @@ int hidden sepol_fs_sid(char *name,
 			sepol_security_id_t * fs_sid,
 			sepol_security_id_t * file_sid)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	int rc = 0;
 	ocontext_t *c;
 
@@ -1819,6 +2481,8 @@ int hidden sepol_port_sid(uint16_t domain __attribute__ ((unused)),
 			  uint8_t protocol,
 			  uint16_t port, sepol_security_id_t * out_sid)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	ocontext_t *c;
 	int rc = 0;
 
@@ -1858,6 +2522,8 @@ int hidden sepol_netif_sid(char *name,
 			   sepol_security_id_t * if_sid,
 			   sepol_security_id_t * msg_sid)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	int rc = 0;
 	ocontext_t *c;
 
@@ -1916,6 +2582,8 @@ int hidden sepol_node_sid(uint16_t domain,
 			  void *addrp,
 			  size_t addrlen, sepol_security_id_t * out_sid)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	int rc = 0;
 	ocontext_t *c;
 
@@ -1989,6 +2657,8 @@ int hidden sepol_get_user_sids(sepol_security_id_t fromsid,
 			       char *username,
 			       sepol_security_id_t ** sids, uint32_t * nel)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	context_struct_t *fromcon, usercon;
 	sepol_security_id_t *mysids, *mysids2, sid;
 	uint32_t mynel = 0, maxnel = SIDS_NEL;
@@ -2036,7 +2706,8 @@ int hidden sepol_get_user_sids(sepol_security_id_t fromsid,
 			    (fromcon, user, &usercon, policydb->mls))
 				continue;
 
-			rc = context_struct_compute_av(fromcon, &usercon,
+			rc = context_struct_compute_av(&mysecserver, fromcon,
+						       &usercon,
 						       SECCLASS_PROCESS,
 						       PROCESS__TRANSITION,
 						       &avd, &reason, NULL, 0);
@@ -2089,6 +2760,8 @@ int hidden sepol_genfs_sid(const char *fstype,
 			   sepol_security_class_t sclass,
 			   sepol_security_id_t * sid)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	size_t len;
 	genfs_t *genfs;
 	ocontext_t *c;
@@ -2134,6 +2807,8 @@ int hidden sepol_genfs_sid(const char *fstype,
 int hidden sepol_fs_use(const char *fstype,
 			unsigned int *behavior, sepol_security_id_t * sid)
 {
+	policydb_t *policydb = mysecserver.policydb;
+	sidtab_t *sidtab = mysecserver.sidtab;
 	int rc = 0;
 	ocontext_t *c;
 
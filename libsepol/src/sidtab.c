@@ -19,10 +19,91 @@
 #define SIDTAB_HASH(sid) \
 (sid & SIDTAB_HASH_MASK)
 
+#define SIDTAB_CONTEXT_HASH(s, context) \
+(sidtab_context_hash(context) & ((s)->ctable_size - 1))
+
 #define INIT_SIDTAB_LOCK(s)
 #define SIDTAB_LOCK(s)
 #define SIDTAB_UNLOCK(s)
 
+/* hash the contents of a context for the context index */
+static uint32_t sidtab_context_hash(context_struct_t * context)
+{
+	uint32_t hash;
+	ebitmap_node_t *n;
+	int l;
+
+	hash = context->user;
+	hash = hash * 31 + context->role;
+	hash = hash * 31 + context->type;
+	for (l = 0; l < 2; l++) {
+		hash = hash * 31 + context->range.level[l].sens;
+		for (n = context->range.level[l].cat.node; n; n = n->next) {
+			if (!n->map)
+				continue;
+			hash = hash * 31 + n->startbit;
+			hash = hash * 31 + (uint32_t) (n->map ^ (n->map >> 32));
+		}
+	}
+	return hash;
+}
+
+static void sidtab_context_index_insert(sidtab_t * s, sidtab_node_t * node)
+{
+	unsigned int hvalue;
+
+	hvalue = SIDTAB_CONTEXT_HASH(s, &node->context);
+	node->context_next = s->ctable[hvalue];
+	s->ctable[hvalue] = node;
+}
+
+static void sidtab_context_index_remove(sidtab_t * s, sidtab_node_t * node)
+{
+	unsigned int hvalue;
+	sidtab_node_t *cur, *last;
+
+	hvalue = SIDTAB_CONTEXT_HASH(s, &node->context);
+	last = NULL;
+	cur = s->ctable[hvalue];
+	while (cur != NULL && cur != node) {
+		last = cur;
+		cur = cur->context_next;
+	}
+
+	if (cur == NULL)
+		return;
+
+	if (last == NULL)
+		s->ctable[hvalue] = cur->context_next;
+	else
+		last->context_next = cur->context_next;
+}
+
+/* double the size of the context index, keeping the old one on failure */
+static void sidtab_context_index_grow(sidtab_t * s)
+{
+	unsigned int i, old_size;
+	sidtab_ptr_t *old_table, cur, next;
+
+	old_table = s->ctable;
+	old_size = s->ctable_size;
+
+	s->ctable = calloc(old_size * 2, sizeof(sidtab_ptr_t));
+	if (!s->ctable) {
+		s->ctable = old_table;
+		return;
+	}
+	s->ctable_size = old_size * 2;
+
+	for (i = 0; i < old_size; i++) {
+		for (cur = old_table[i]; cur != NULL; cur = next) {
+			next = cur->context_next;
+			sidtab_context_index_insert(s, cur);
+		}
+	}
+	free(old_table);
+}
+
 int sepol_sidtab_init(sidtab_t * s)
 {
 	int i;
@@ -32,6 +113,13 @@ int sepol_sidtab_init(sidtab_t * s)
 		return -ENOMEM;
 	for (i = 0; i < SIDTAB_SIZE; i++)
 		s->htable[i] = (sidtab_ptr_t) NULL;
+	s->ctable = calloc(SIDTAB_CONTEXT_SIZE, sizeof(sidtab_ptr_t));
+	if (!s->ctable) {
+		free(s->htable);
+		s->htable = NULL;
+		return -ENOMEM;
+	}
+	s->ctable_size = SIDTAB_CONTEXT_SIZE;
 	s->nel = 0;
 	s->next_sid = 1;
 	s->shutdown = 0;
@@ -79,6 +167,9 @@ int sepol_sidtab_insert(sidtab_t * s, sepol_security_id_t sid,
 	}
 
 	s->nel++;
+	if (s->nel > s->ctable_size)
+		sidtab_context_index_grow(s);
+	sidtab_context_index_insert(s, newnode);
 	if (sid >= s->next_sid)
 		s->next_sid = sid + 1;
 	return 0;
@@ -108,6 +199,7 @@ int sepol_sidtab_remove(sidtab_t * s, sepol_security_id_t sid)
 	else
 		last->next = cur->next;
 
+	sidtab_context_index_remove(s, cur);
 	context_destroy(&cur->context);
 
 	free(cur);
@@ -180,6 +272,8 @@ void sepol_sidtab_map_remove_on_error(sidtab_t * s,
 		last = NULL;
 		cur = s->htable[i];
 		while (cur != NULL) {
+			/* apply may rewrite the context, so reindex it */
+			sidtab_context_index_remove(s, cur);
 			ret = apply(cur->sid, &cur->context, args);
 			if (ret) {
 				if (last) {
@@ -194,6 +288,7 @@ void sepol_sidtab_map_remove_on_error(sidtab_t * s,
 				free(temp);
 				s->nel--;
 			} else {
+				sidtab_context_index_insert(s, cur);
 				last = cur;
 				cur = cur->next;
 			}
@@ -207,16 +302,13 @@ static inline sepol_security_id_t sepol_sidtab_search_context(sidtab_t * s,
 							      context_struct_t *
 							      context)
 {
-	int i;
+	unsigned int hvalue;
 	sidtab_node_t *cur;
 
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur != NULL) {
-			if (context_cmp(&cur->context, context))
-				return cur->sid;
-			cur = cur->next;
-		}
+	hvalue = SIDTAB_CONTEXT_HASH(s, context);
+	for (cur = s->ctable[hvalue]; cur != NULL; cur = cur->context_next) {
+		if (context_cmp(&cur->context, context))
+			return cur->sid;
 	}
 	return 0;
 }
@@ -304,6 +396,9 @@ void sepol_sidtab_destroy(sidtab_t * s)
 	}
 	free(s->htable);
 	s->htable = NULL;
+	free(s->ctable);
+	s->ctable = NULL;
+	s->ctable_size = 0;
 	s->nel = 0;
 	s->next_sid = 1;
 }
@@ -312,6 +407,8 @@ void sepol_sidtab_set(sidtab_t * dst, sidtab_t * src)
 {
 	SIDTAB_LOCK(src);
 	dst->htable = src->htable;
+	dst->ctable = src->ctable;
+	dst->ctable_size = src->ctable_size;
 	dst->nel = src->nel;
 	dst->next_sid = src->next_sid;
 	dst->shutdown = 0;
@@ -23,6 +23,9 @@
 #include "test-expander.h"
 #include "test-deps.h"
 #include "test-downgrade.h"
+#include "test-services.h"
+#include "test-ebitmap.h"
+#include "test-policydb-diff.h"
 
 #include <CUnit/Basic.h>
 #include <CUnit/Console.h>
@@ -63,6 +66,9 @@ static int do_tests(int interactive, int verbose)
 	DECLARE_SUITE(expander);
 	DECLARE_SUITE(deps);
 	DECLARE_SUITE(downgrade);
+	DECLARE_SUITE(services);
+	DECLARE_SUITE(ebitmap);
+	DECLARE_SUITE(policydb_diff);
 
 	if (verbose)
 		CU_basic_set_mode(CU_BRM_VERBOSE);
@@ -0,0 +1,213 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests for the word-level ebitmap helpers: ebitmap_set_range(),
+ * ebitmap_highest_set_bit() and ebitmap_cardinality(). */
+
+#include "test-ebitmap.h"
+
+#include <sepol/policydb/ebitmap.h>
+
+#include <errno.h>
+
+int ebitmap_test_init(void)
+{
+	return 0;
+}
+
+int ebitmap_test_cleanup(void)
+{
+	return 0;
+}
+
+static unsigned int count_nodes(const ebitmap_t * e)
+{
+	const ebitmap_node_t *n;
+	unsigned int count = 0;
+
+	for (n = e->node; n; n = n->next) {
+		/* nodes are kept in ascending order and never empty */
+		CU_ASSERT(n->map != 0);
+		CU_ASSERT(!n->next || n->startbit < n->next->startbit);
+		count++;
+	}
+	return count;
+}
+
+/* Check that exactly the bits minbit..maxbit are set, up to limit */
+static void check_range(const ebitmap_t * e, unsigned int minbit,
+			unsigned int maxbit, unsigned int limit)
+{
+	unsigned int i;
+
+	for (i = 0; i < limit; i++)
+		CU_ASSERT(ebitmap_get_bit(e, i) == (i >= minbit && i <= maxbit));
+}
+
+static void test_empty(void)
+{
+	ebitmap_t e;
+
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_cardinality(&e) == 0);
+	CU_ASSERT(ebitmap_highest_set_bit(&e) == 0);
+
+	/* an inverted range is rejected and leaves the bitmap empty */
+	CU_ASSERT(ebitmap_set_range(&e, 10, 9) == -EINVAL);
+	CU_ASSERT(e.node == NULL);
+	CU_ASSERT(e.highbit == 0);
+	CU_ASSERT(ebitmap_cardinality(&e) == 0);
+
+	ebitmap_destroy(&e);
+}
+
+static void test_range_in_one_node(void)
+{
+	ebitmap_t e;
+
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_set_range(&e, 3, 10) == 0);
+	check_range(&e, 3, 10, 128);
+	CU_ASSERT(count_nodes(&e) == 1);
+	CU_ASSERT(ebitmap_cardinality(&e) == 8);
+	CU_ASSERT(ebitmap_highest_set_bit(&e) == 10);
+	CU_ASSERT(e.highbit == MAPSIZE);
+	ebitmap_destroy(&e);
+
+	/* a single bit */
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_set_range(&e, 70, 70) == 0);
+	check_range(&e, 70, 70, 192);
+	CU_ASSERT(count_nodes(&e) == 1);
+	CU_ASSERT(ebitmap_cardinality(&e) == 1);
+	CU_ASSERT(ebitmap_highest_set_bit(&e) == 70);
+	CU_ASSERT(e.highbit == 2 * MAPSIZE);
+	ebitmap_destroy(&e);
+
+	/* exactly one whole node */
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_set_range(&e, MAPSIZE, 2 * MAPSIZE - 1) == 0);
+	check_range(&e, MAPSIZE, 2 * MAPSIZE - 1, 256);
+	CU_ASSERT(count_nodes(&e) == 1);
+	CU_ASSERT(e.node->map == ~(MAPTYPE) 0);
+	CU_ASSERT(ebitmap_cardinality(&e) == MAPSIZE);
+	CU_ASSERT(ebitmap_highest_set_bit(&e) == 2 * MAPSIZE - 1);
+	ebitmap_destroy(&e);
+}
+
+static void test_range_across_nodes(void)
+{
+	ebitmap_t e;
+
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_set_range(&e, 60, 200) == 0);
+	check_range(&e, 60, 200, 320);
+	CU_ASSERT(count_nodes(&e) == 4);
+	CU_ASSERT(ebitmap_cardinality(&e) == 141);
+	CU_ASSERT(ebitmap_highest_set_bit(&e) == 200);
+	CU_ASSERT(e.highbit == 4 * MAPSIZE);
+	ebitmap_destroy(&e);
+
+	/* ending on the last bit of a node */
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_set_range(&e, MAPSIZE - 1, 2 * MAPSIZE - 1) == 0);
+	check_range(&e, MAPSIZE - 1, 2 * MAPSIZE - 1, 256);
+	CU_ASSERT(count_nodes(&e) == 2);
+	CU_ASSERT(ebitmap_cardinality(&e) == MAPSIZE + 1);
+	CU_ASSERT(e.highbit == 2 * MAPSIZE);
+	ebitmap_destroy(&e);
+}
+
+static void test_range_into_existing_bits(void)
+{
+	ebitmap_t e;
+	unsigned int i;
+
+	/* the range fills the gap between, and merges into, existing nodes */
+	ebitmap_init(&e);
+	CU_ASSERT(ebitmap_set_bit(&e, 10, 1) == 0);
+	CU_ASSERT(ebitmap_set_bit(&e, 300, 1) == 0);
+	CU_ASSERT(ebitmap_set_range(&e, 62, 130) == 0);
+	for (i = 0; i < 384; i++)
+		CU_ASSERT(ebitmap_get_bit(&e, i) ==
+			  (i == 10 || i == 300 || (i >= 62 && i <= 130)));
+	CU_ASSERT(count_nodes(&e) == 4);
+	CU_ASSERT(ebitmap_cardinality(&e) == 71);
+	CU_ASSERT(ebitmap_highest_set_bit(&e) == 300);
+	CU_ASSERT(e.highbit == 5 * MAPSIZE);
+
+	/* setting bits that are already set changes nothing */
+	CU_ASSERT(ebitmap_set_range(&e, 100, 120) == 0);
+	CU_ASSERT(ebitmap_cardinality(&e) == 71);
+	CU_ASSERT(count_nodes(&e) == 4);
+	ebitmap_destroy(&e);
+}
+
+/* ebitmap_set_range() must agree with setting the bits one at a time */
+static void test_range_matches_set_bit(void)
+{
+	static const unsigned int bounds[] = {
+		0, 1, 62, 63, 64, 65, 127, 128, 129, 255, 256, 1023
+	};
+	unsigned int nbounds = sizeof(bounds) / sizeof(bounds[0]);
+	unsigned int i, j, bit;
+	ebitmap_t range, bits;
+
+	for (i = 0; i < nbounds; i++) {
+		for (j = i; j < nbounds; j++) {
+			ebitmap_init(&range);
+			ebitmap_init(&bits);
+			CU_ASSERT(ebitmap_set_bit(&range, 500, 1) == 0);
+			CU_ASSERT(ebitmap_set_bit(&bits, 500, 1) == 0);
+
+			CU_ASSERT(ebitmap_set_range(&range, bounds[i], bounds[j]) == 0);
+			for (bit = bounds[i]; bit <= bounds[j]; bit++)
+				CU_ASSERT(ebitmap_set_bit(&bits, bit, 1) == 0);
+
+			CU_ASSERT(ebitmap_cmp(&range, &bits));
+			CU_ASSERT(ebitmap_cardinality(&range) ==
+				  ebitmap_cardinality(&bits));
+			CU_ASSERT(ebitmap_highest_set_bit(&range) ==
+				  (bounds[j] > 500 ? bounds[j] : 500));
+			ebitmap_destroy(&range);
+			ebitmap_destroy(&bits);
+		}
+	}
+}
+
+int ebitmap_add_tests(CU_pSuite suite)
+{
+	if (NULL == CU_add_test(suite, "empty", test_empty)) {
+		return CU_get_error();
+	}
+	if (NULL == CU_add_test(suite, "range_in_one_node",
+				test_range_in_one_node)) {
+		return CU_get_error();
+	}
+	if (NULL == CU_add_test(suite, "range_across_nodes",
+				test_range_across_nodes)) {
+		return CU_get_error();
+	}
+	if (NULL == CU_add_test(suite, "range_into_existing_bits",
+				test_range_into_existing_bits)) {
+		return CU_get_error();
+	}
+	if (NULL == CU_add_test(suite, "range_matches_set_bit",
+				test_range_matches_set_bit)) {
+		return CU_get_error();
+	}
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests for sepol_policydb_diff(): a policy compared with itself or with
+ * a separately loaded copy gives no output, a copy with known changes
+ * gives exactly the lines for those changes, and base policies are
+ * rejected. */
+
+#include "test-policydb-diff.h"
+#include "parse_util.h"
+#include "helpers.h"
+
+#include <sepol/policydb.h>
+#include <sepol/policydb/policydb.h>
+#include <sepol/policydb/link.h>
+#include <sepol/policydb/expand.h>
+#include <sepol/policydb/conditional.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern int mls;
+
+static policydb_t basemod_old, basemod_new;
+static policydb_t expanded_old, expanded_new;
+
+static int load_expanded(policydb_t * basemod, policydb_t * expanded)
+{
+	if (policydb_init(expanded)) {
+		fprintf(stderr, "out of memory!\n");
+		return -1;
+	}
+
+	if (test_load_policy(basemod, POLICY_BASE, mls, "test-cond", "refpolicy-base.conf"))
+		return -1;
+
+	if (link_modules(NULL, basemod, NULL, 0, 0)) {
+		fprintf(stderr, "link modules failed\n");
+		return -1;
+	}
+
+	if (expand_module(NULL, basemod, expanded, 0, 1)) {
+		fprintf(stderr, "expand module failed\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int policydb_diff_test_init(void)
+{
+	if (load_expanded(&basemod_old, &expanded_old) ||
+	    load_expanded(&basemod_new, &expanded_new)) {
+		policydb_diff_test_cleanup();
+		return -1;
+	}
+	return 0;
+}
+
+int policydb_diff_test_cleanup(void)
+{
+	policydb_destroy(&basemod_old);
+	policydb_destroy(&basemod_new);
+	policydb_destroy(&expanded_old);
+	policydb_destroy(&expanded_new);
+
+	return 0;
+}
+
+/* Run the diff, returning its result and its output in *out */
+static int run_diff(policydb_t * oldp, policydb_t * newp, char **out)
+{
+	size_t len;
+	FILE *fp;
+	int rc;
+
+	fp = open_memstream(out, &len);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(fp);
+	rc = sepol_policydb_diff(NULL, (sepol_policydb_t *) oldp,
+				 (sepol_policydb_t *) newp, fp);
+	fclose(fp);
+	return rc;
+}
+
+static void test_diff_identical(void)
+{
+	char *out = NULL;
+
+	/* the same policydb */
+	CU_ASSERT(run_diff(&expanded_old, &expanded_old, &out) == 0);
+	CU_ASSERT_STRING_EQUAL(out, "");
+	free(out);
+
+	/* a separately built copy */
+	CU_ASSERT(run_diff(&expanded_old, &expanded_new, &out) == 0);
+	CU_ASSERT_STRING_EQUAL(out, "");
+	free(out);
+}
+
+/* Find an unconditional allow rule with at least two permissions */
+static avtab_ptr_t find_allow_rule(policydb_t * p)
+{
+	avtab_ptr_t node;
+	uint32_t i;
+
+	for (i = 0; i < p->te_avtab.nslot; i++) {
+		for (node = p->te_avtab.htable[i]; node; node = node->next) {
+			if ((node->key.specified & AVTAB_ALLOWED) &&
+			    __builtin_popcount(node->datum.data) >= 2)
+				return node;
+		}
+	}
+	return NULL;
+}
+
+static int perm_name_callback(hashtab_key_t key, hashtab_datum_t datum,
+			      void *args)
+{
+	perm_datum_t *perm = datum;
+	void **a = args;
+
+	if (perm->s.value == *(uint32_t *) a[0])
+		a[1] = key;
+	return 0;
+}
+
+static char *perm_name(policydb_t * p, uint32_t tclass, uint32_t value)
+{
+	class_datum_t *cladatum = p->class_val_to_struct[tclass - 1];
+	void *args[2] = { &value, NULL };
+
+	hashtab_map(cladatum->permissions.table, perm_name_callback, args);
+	if (!args[1] && cladatum->comdatum)
+		hashtab_map(cladatum->comdatum->permissions.table,
+			    perm_name_callback, args);
+	return args[1];
+}
+
+static void test_diff_changes(void)
+{
+	policydb_t *p = &expanded_new;
+	cond_bool_datum_t *booldatum;
+	avtab_ptr_t rule;
+	uint32_t perm, type;
+	char *bool_name, *type_name, *out = NULL;
+	char expected[1024];
+
+	CU_ASSERT_FATAL(p->p_bools.nprim > 0);
+
+	/* flip the default of a boolean */
+	booldatum = p->bool_val_to_struct[0];
+	bool_name = p->p_bool_val_to_name[0];
+	booldatum->state = !booldatum->state;
+
+	/* drop the lowest permission of an allow rule */
+	rule = find_allow_rule(p);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(rule);
+	perm = __builtin_ctz(rule->datum.data);
+	rule->datum.data &= ~(1U << perm);
+
+	/* make a type permissive */
+	for (type = 0; type < p->p_types.nprim; type++) {
+		if (p->type_val_to_struct[type] &&
+		    p->type_val_to_struct[type]->flavor != TYPE_ATTRIB &&
+		    !ebitmap_get_bit(&p->permissive_map, type + 1))
+			break;
+	}
+	CU_ASSERT_FATAL(type < p->p_types.nprim);
+	type_name = p->p_type_val_to_name[type];
+	CU_ASSERT_FATAL(ebitmap_set_bit(&p->permissive_map, type + 1, 1) == 0);
+
+	/* lines are sorted by kind and item, so the boolean's "false"
+	 * line comes first whichever side it is on */
+	CU_ASSERT_FATAL(snprintf(expected, sizeof(expected),
+				 "-\tallow\t%s %s:%s %s\n"
+				 "%c\tbool\t%s false\n"
+				 "%c\tbool\t%s true\n"
+				 "+\tpermissive\t%s\n",
+				 p->p_type_val_to_name[rule->key.source_type - 1],
+				 p->p_type_val_to_name[rule->key.target_type - 1],
+				 p->p_class_val_to_name[rule->key.target_class - 1],
+				 perm_name(p, rule->key.target_class, perm + 1),
+				 booldatum->state ? '-' : '+', bool_name,
+				 booldatum->state ? '+' : '-', bool_name,
+				 type_name) < (int)sizeof(expected));
+
+	CU_ASSERT(run_diff(&expanded_old, p, &out) == 4);
+	CU_ASSERT_STRING_EQUAL(out, expected);
+	free(out);
+
+	/* restore the copy */
+	booldatum->state = !booldatum->state;
+	rule->datum.data |= 1U << perm;
+	CU_ASSERT(ebitmap_set_bit(&p->permissive_map, type + 1, 0) == 0);
+	CU_ASSERT(run_diff(&expanded_old, p, &out) == 0);
+	free(out);
+}
+
+static void test_diff_rejects_base(void)
+{
+	char *out = NULL;
+
+	CU_ASSERT(run_diff(&basemod_old, &expanded_new, &out) == -1);
+	free(out);
+	CU_ASSERT(run_diff(&expanded_old, &basemod_new, &out) == -1);
+	free(out);
+}
+
+int policydb_diff_add_tests(CU_pSuite suite)
+{
+	if (NULL == CU_add_test(suite, "diff_identical", test_diff_identical)) {
+		return CU_get_error();
+	}
+	if (NULL == CU_add_test(suite, "diff_changes", test_diff_changes)) {
+		return CU_get_error();
+	}
+	if (NULL == CU_add_test(suite, "diff_rejects_base",
+				test_diff_rejects_base)) {
+		return CU_get_error();
+	}
+	return 0;
+}
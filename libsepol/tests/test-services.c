@@ -0,0 +1,246 @@
+/*
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests for the security server's precomputed access vectors: every
+ * decision taken from the precomputed table must match the one computed
+ * by walking the attributes of the source and target types, both with
+ * the booleans as loaded and with every boolean flipped afterwards. */
+
+#include "test-services.h"
+#include "parse_util.h"
+#include "helpers.h"
+
+#include <sepol/policydb/policydb.h>
+#include <sepol/policydb/link.h>
+#include <sepol/policydb/expand.h>
+#include <sepol/policydb/conditional.h>
+#include <sepol/policydb/sidtab.h>
+#include <sepol/policydb/services.h>
+
+#include <stdlib.h>
+
+extern int mls;
+
+struct av_result {
+	sepol_access_vector_t allowed;
+	sepol_access_vector_t auditallow;
+	sepol_access_vector_t auditdeny;
+};
+
+static policydb_t basemod;
+static policydb_t base_expanded;
+static sidtab_t sidtab;
+
+/* one SID per type, and the classes named by an access vector rule */
+static sepol_security_id_t *type_sids;
+static uint32_t ntypes;
+static sepol_security_class_t *classes;
+static uint32_t nclasses;
+
+static int add_class(avtab_key_t * k, avtab_datum_t * d
+		     __attribute__ ((unused)), void *args
+		     __attribute__ ((unused)))
+{
+	uint32_t i;
+
+	if (!(k->specified & AVTAB_AV))
+		return 0;
+	for (i = 0; i < nclasses; i++) {
+		if (classes[i] == k->target_class)
+			return 0;
+	}
+	classes[nclasses++] = k->target_class;
+	return 0;
+}
+
+int services_test_init(void)
+{
+	context_struct_t *base_context, context;
+	uint32_t i;
+
+	if (policydb_init(&base_expanded)) {
+		fprintf(stderr, "out of memory!\n");
+		return -1;
+	}
+
+	if (test_load_policy(&basemod, POLICY_BASE, mls, "test-cond", "refpolicy-base.conf"))
+		goto cleanup;
+
+	if (link_modules(NULL, &basemod, NULL, 0, 0)) {
+		fprintf(stderr, "link modules failed\n");
+		goto cleanup;
+	}
+
+	if (expand_module(NULL, &basemod, &base_expanded, 0, 1)) {
+		fprintf(stderr, "expand module failed\n");
+		goto cleanup;
+	}
+
+	if (sepol_sidtab_init(&sidtab)) {
+		fprintf(stderr, "sidtab init failed\n");
+		goto cleanup;
+	}
+	sepol_set_policydb(&base_expanded);
+	sepol_set_sidtab(&sidtab);
+
+	/* the contexts differ from an initial SID's context only in type */
+	if (!base_expanded.ocontexts[OCON_ISID]) {
+		fprintf(stderr, "policy has no initial SIDs\n");
+		goto cleanup;
+	}
+	base_context = &base_expanded.ocontexts[OCON_ISID]->context[0];
+
+	type_sids = calloc(base_expanded.p_types.nprim, sizeof(*type_sids));
+	classes = calloc(base_expanded.p_classes.nprim, sizeof(*classes));
+	if (!type_sids || !classes) {
+		fprintf(stderr, "out of memory!\n");
+		goto cleanup;
+	}
+
+	ntypes = 0;
+	for (i = 0; i < base_expanded.p_types.nprim; i++) {
+		if (!base_expanded.type_val_to_struct[i] ||
+		    base_expanded.type_val_to_struct[i]->flavor == TYPE_ATTRIB)
+			continue;
+		context = *base_context;
+		context.type = i + 1;
+		if (sepol_sidtab_context_to_sid(&sidtab, &context, &type_sids[ntypes])) {
+			fprintf(stderr, "could not get a SID for type %s\n",
+				base_expanded.p_type_val_to_name[i]);
+			goto cleanup;
+		}
+		ntypes++;
+	}
+
+	nclasses = 0;
+	avtab_map(&base_expanded.te_avtab, add_class, NULL);
+	avtab_map(&base_expanded.te_cond_avtab, add_class, NULL);
+
+	return 0;
+
+      cleanup:
+	services_test_cleanup();
+	return -1;
+}
+
+int services_test_cleanup(void)
+{
+	sepol_set_policydb(NULL);
+	sepol_set_sidtab(NULL);
+	sepol_sidtab_destroy(&sidtab);
+	policydb_destroy(&basemod);
+	policydb_destroy(&base_expanded);
+	free(type_sids);
+	type_sids = NULL;
+	free(classes);
+	classes = NULL;
+
+	return 0;
+}
+
+static void flip_booleans(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < base_expanded.p_bools.nprim; i++) {
+		base_expanded.bool_val_to_struct[i]->state =
+		    !base_expanded.bool_val_to_struct[i]->state;
+	}
+	CU_ASSERT_FATAL(evaluate_conds(&base_expanded) == 0);
+}
+
+/* Compute the decision of every (source type, target type, class) triple */
+static struct av_result *compute_all(void)
+{
+	struct av_result *results, *r;
+	struct sepol_av_decision avd;
+	uint32_t s, t, c;
+
+	results = calloc((size_t)ntypes * ntypes * nclasses, sizeof(*results));
+	CU_ASSERT_PTR_NOT_NULL_FATAL(results);
+
+	r = results;
+	for (s = 0; s < ntypes; s++) {
+		for (t = 0; t < ntypes; t++) {
+			for (c = 0; c < nclasses; c++, r++) {
+				CU_ASSERT_FATAL(sepol_compute_av(type_sids[s], type_sids[t], classes[c], 0, &avd) == 0);
+				r->allowed = avd.allowed;
+				r->auditallow = avd.auditallow;
+				r->auditdeny = avd.auditdeny;
+			}
+		}
+	}
+
+	return results;
+}
+
+static int count_mismatches(struct av_result *expected, struct av_result *actual)
+{
+	size_t i, n = (size_t)ntypes * ntypes * nclasses;
+	int mismatches = 0;
+
+	for (i = 0; i < n; i++) {
+		if (expected[i].allowed != actual[i].allowed ||
+		    expected[i].auditallow != actual[i].auditallow ||
+		    expected[i].auditdeny != actual[i].auditdeny)
+			mismatches++;
+	}
+
+	return mismatches;
+}
+
+static void test_precompute_av(void)
+{
+	struct av_result *walked, *walked_flipped, *precomputed;
+
+	CU_ASSERT_FATAL(ntypes > 0 && nclasses > 0);
+
+	/* reference decisions, without the precomputed table */
+	walked = compute_all();
+	flip_booleans();
+	walked_flipped = compute_all();
+	flip_booleans();
+
+	/* the flipped booleans must change some decision, or the second
+	 * comparison below would prove nothing */
+	CU_ASSERT(count_mismatches(walked, walked_flipped) > 0);
+
+	CU_ASSERT_FATAL(sepol_precompute_av() == 0);
+	precomputed = compute_all();
+	CU_ASSERT(count_mismatches(walked, precomputed) == 0);
+	free(precomputed);
+
+	/* boolean changes after precomputation must still be honoured */
+	flip_booleans();
+	precomputed = compute_all();
+	CU_ASSERT(count_mismatches(walked_flipped, precomputed) == 0);
+	free(precomputed);
+	flip_booleans();
+
+	/* replacing the policy discards the table */
+	sepol_set_policydb(&base_expanded);
+
+	free(walked);
+	free(walked_flipped);
+}
+
+int services_add_tests(CU_pSuite suite)
+{
+	if (NULL == CU_add_test(suite, "precompute_av", test_precompute_av)) {
+		return CU_get_error();
+	}
+	return 0;
+}
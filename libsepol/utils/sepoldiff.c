@@ -0,0 +1,64 @@
+#include <sepol/sepol.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+void usage(char*) __attribute__((noreturn));
+
+void usage(char *progname)
+{
+	printf("usage:  %s old_policy new_policy\n", progname);
+	exit(2);
+}
+
+static sepol_policydb_t *load_policy(const char *path)
+{
+	sepol_policydb_t *p = NULL;
+	sepol_policy_file_t *pf = NULL;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Can't open '%s':  %s\n", path, strerror(errno));
+		exit(2);
+	}
+	if (sepol_policy_file_create(&pf) < 0 ||
+	    sepol_policydb_create(&p) < 0) {
+		fprintf(stderr, "Out of memory\n");
+		exit(2);
+	}
+	sepol_policy_file_set_fp(pf, fp);
+	if (sepol_policydb_read(p, pf) < 0) {
+		fprintf(stderr, "Error while processing %s:  %s\n",
+			path, strerror(errno));
+		exit(2);
+	}
+	sepol_policy_file_free(pf);
+	fclose(fp);
+	return p;
+}
+
+int main(int argc, char **argv)
+{
+	sepol_policydb_t *oldp, *newp;
+	int rc;
+
+	if (argc != 3)
+		usage(argv[0]);
+
+	oldp = load_policy(argv[1]);
+	newp = load_policy(argv[2]);
+
+	rc = sepol_policydb_diff(NULL, oldp, newp, stdout);
+
+	sepol_policydb_free(oldp);
+	sepol_policydb_free(newp);
+
+	if (rc < 0) {
+		fprintf(stderr, "Error while comparing %s and %s\n",
+			argv[1], argv[2]);
+		exit(2);
+	}
+	exit(rc ? 1 : 0);
+}
@@ -172,7 +172,12 @@ static policydb_t *load_policy(const char *filename)
 		return NULL;
 	}
 
-	ret = policydb_read(policydb, &pf, 1);
+	/* Only the symbols and the (conditional) access vector rules are
+	 * used, so do not load the rest of the policy. */
+	ret = policydb_read_sections(policydb, &pf, 1,
+				     POLICYDB_SECTION_SYMTABS |
+				     POLICYDB_SECTION_AVTAB |
+				     POLICYDB_SECTION_CONDS);
 	if (ret) {
 		fprintf(stderr,
 			"error(s) encountered while parsing configuration\n");
@@ -41,6 +41,8 @@
 #endif
 #include <sepol/policydb.h>
 
+#define SECILC_OPT_PROFILE 256
+
 void usage(char *prog)
 {
 	printf("Usage: %s [OPTION]... FILE...\n", prog);
@@ -64,6 +66,10 @@ void usage(char *prog)
 	printf("  -D, --disable-dontaudit        do not add dontaudit rules to the binary policy\n");
 	printf("  -P, --preserve-tunables        treat tunables as booleans\n");
 	printf("  -N, --disable-neverallow       do not check neverallow rules\n");
+	printf("  -C, --cache-dir=<directory>    keep parse trees in <directory> and reuse\n");
+	printf("                                 them for unchanged files\n");
+	printf("      --profile[=<file>]         write per-phase timings and memory usage as\n");
+	printf("                                 JSON to <file> (default: stdout)\n");
 	printf("  -v, --verbose                  increment verbosity level\n");
 	printf("  -h, --help                     display usage information\n");
 	exit(1);
@@ -77,11 +83,18 @@ int main(int argc, char *argv[])
 	FILE *binary = NULL;
 	FILE *file_contexts;
 	FILE *file = NULL;
-	char *buffer = NULL;
+	char **buffers = NULL;
+	size_t *file_sizes = NULL;
+	int num_files = 0;
 	struct stat filedata;
-	uint32_t file_size;
 	char *output = NULL;
 	char *filecontexts = NULL;
+	char *cache_dir = NULL;
+	int profile = 0;
+	char *profile_file = NULL;
+	char *profile_buf = NULL;
+	size_t profile_size;
+	FILE *profile_out = NULL;
 	struct cil_db *db = NULL;
 	int target = SEPOL_TARGET_SELINUX;
 	int mls = -1;
@@ -107,12 +120,14 @@ int main(int argc, char *argv[])
 		{"preserve-tunables", no_argument, 0, 'P'},
 		{"output", required_argument, 0, 'o'},
 		{"filecontexts", required_argument, 0, 'f'},
+		{"cache-dir", required_argument, 0, 'C'},
+		{"profile", optional_argument, 0, SECILC_OPT_PROFILE},
 		{0, 0, 0, 0}
 	};
 	int i;
 
 	while (1) {
-		opt_char = getopt_long(argc, argv, "o:f:U:hvt:M:PDNc:", long_opts, &opt_index);
+		opt_char = getopt_long(argc, argv, "o:f:U:hvt:M:PDNc:C:", long_opts, &opt_index);
 		if (opt_char == -1) {
 			break;
 		}
@@ -180,6 +195,16 @@ int main(int argc, char *argv[])
 			case 'f':
 				filecontexts = strdup(optarg);
 				break;
+			case 'C':
+				cache_dir = strdup(optarg);
+				break;
+			case SECILC_OPT_PROFILE:
+				profile = 1;
+				if (optarg != NULL) {
+					free(profile_file);
+					profile_file = strdup(optarg);
+				}
+				break;
 			case 'h':
 				usage(argv[0]);
 			case '?':
@@ -210,6 +235,16 @@ int main(int argc, char *argv[])
 	cil_set_mls(db, mls);
 	cil_set_target_platform(db, target);
 	cil_set_policy_version(db, policyvers);
+	cil_set_parse_cache_dir(db, cache_dir);
+	cil_set_profile(db, profile);
+
+	buffers = calloc(argc - optind, sizeof(*buffers));
+	file_sizes = calloc(argc - optind, sizeof(*file_sizes));
+	if (buffers == NULL || file_sizes == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		rc = SEPOL_ERR;
+		goto exit;
+	}
 
 	for (i = optind; i < argc; i++) {
 		file = fopen(argv[i], "r");
@@ -223,25 +258,29 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "Could not stat file: %s\n", argv[i]);
 			goto exit;
 		}
-		file_size = filedata.st_size;	
+		file_sizes[num_files] = filedata.st_size;	
 
-		buffer = malloc(file_size);
-		rc = fread(buffer, file_size, 1, file);
+		buffers[num_files] = malloc(file_sizes[num_files]);
+		rc = fread(buffers[num_files], file_sizes[num_files], 1, file);
+		num_files++;
 		if (rc != 1) {
 			fprintf(stderr, "Failure reading file: %s\n", argv[i]);
 			goto exit;
 		}
 		fclose(file);
 		file = NULL;
+	}
 
-		rc = cil_add_file(db, argv[i], buffer, file_size);
-		if (rc != SEPOL_OK) {
-			fprintf(stderr, "Failure adding %s\n", argv[i]);
-			goto exit;
-		}
+	/* cil_add_files() logs "Failure adding <file>" for each input that
+	 * could not be added */
+	rc = cil_add_files(db, num_files, &argv[optind], buffers, file_sizes);
+	if (rc != SEPOL_OK) {
+		goto exit;
+	}
 
-		free(buffer);
-		buffer = NULL;
+	for (i = 0; i < num_files; i++) {
+		free(buffers[i]);
+		buffers[i] = NULL;
 	}
 
 	rc = cil_compile(db);
@@ -271,6 +310,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	cil_profile_begin(db, "write");
+
 	binary = fopen(output, "w");
 	if (binary == NULL) {
 		fprintf(stderr, "Failure opening binary file for writing\n");
@@ -320,6 +361,33 @@ int main(int argc, char *argv[])
 	fclose(file_contexts);
 	file_contexts = NULL;
 
+	cil_profile_end(db);
+
+	if (profile) {
+		rc = cil_profile_to_json(db, &profile_buf, &profile_size);
+		if (rc != SEPOL_OK) {
+			fprintf(stderr, "Failed to get profile data\n");
+			goto exit;
+		}
+
+		if (profile_file == NULL) {
+			profile_out = stdout;
+		} else {
+			profile_out = fopen(profile_file, "w");
+			if (profile_out == NULL) {
+				fprintf(stderr, "Failed to open profile file\n");
+				rc = SEPOL_ERR;
+				goto exit;
+			}
+		}
+
+		if (fwrite(profile_buf, sizeof(char), profile_size, profile_out) != profile_size) {
+			fprintf(stderr, "Failed to write profile data\n");
+			rc = SEPOL_ERR;
+			goto exit;
+		}
+	}
+
 	rc = SEPOL_OK;
 
 exit:
@@ -329,9 +397,19 @@ exit:
 	if (file != NULL) {
 		fclose(file);
 	}
-	free(buffer);
+	if (profile_out != NULL && profile_out != stdout) {
+		fclose(profile_out);
+	}
+	for (i = 0; i < num_files; i++) {
+		free(buffers[i]);
+	}
+	free(buffers);
+	free(file_sizes);
 	free(output);
 	free(filecontexts);
+	free(cache_dir);
+	free(profile_file);
+	free(profile_buf);
 	cil_db_destroy(&db);
 	sepol_policydb_free(pdb);
 	sepol_policy_file_free(pf);